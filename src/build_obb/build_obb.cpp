@@ -5,6 +5,7 @@
 int main(int argc, char* argv[]) {
   std::string dag_file;
   std::string out_file;
+  std::string cache_file;
   bool verbose = false;
 
   ProgOptions po("build_obb: A tool to prebuild your DAGMC OBB Tree");
@@ -16,6 +17,9 @@ int main(int argc, char* argv[]) {
                          "Specify the output filename (default "
                          ")",
                          &out_file);
+  po.addOpt<std::string>("bvh-cache,c",
+                         "Also write a flat BVH cache file for the output file",
+                         &cache_file);
 
   po.addOptionHelpHeading("Options for loading files");
 
@@ -60,5 +64,22 @@ int main(int argc, char* argv[]) {
     exit(EXIT_FAILURE);
   }
 
+  // the cache is tied to the model as loaded, so build it from the new file
+  if (cache_file != "") {
+    moab::DagMC* OUT_DAG = new moab::DagMC();
+    rval = OUT_DAG->load_file(out_file.c_str());
+    if (moab::MB_SUCCESS != rval) {
+      std::cerr << "DAGMC failed to read output file: " << out_file
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    rval = OUT_DAG->set_bvh_cache(cache_file);
+    if (moab::MB_SUCCESS == rval) rval = OUT_DAG->init_OBBTree();
+    if (moab::MB_SUCCESS != rval || !OUT_DAG->has_flat_bvh()) {
+      std::cerr << "DAGMC failed to write the BVH cache" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
   return 0;
 }
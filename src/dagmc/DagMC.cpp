@@ -8,6 +8,7 @@
 
 #include <algorithm>
 #include <array>
+#include <chrono>
 #include <climits>
 #include <fstream>
 #include <iostream>
@@ -27,6 +28,7 @@
 
 #define MB_OBB_TREE_TAG_NAME "OBB_TREE"
 #define FACETING_TOL_TAG_NAME "FACETING_TOL"
+#define MEASURE_TAG_NAME "DAGMC_MEASURE"
 static const int null_delimiter_length = 1;
 
 namespace moab {
@@ -97,6 +99,21 @@ DagMC::DagMC(Interface* mb_impl, double overlap_tolerance,
 
 // Destructor
 DagMC::~DagMC() {
+  if (queryStats && !queryStatsFile.empty()) {
+    std::ofstream out(queryStatsFile.c_str());
+    if (!out || MB_SUCCESS != write_query_stats(out))
+      std::cerr << "Failed to write the query statistics to "
+                << queryStatsFile << std::endl;
+  }
+  if (bvhSharedOwner) FlatBVH::unlink_shared(bvhSharedName);
+  if (lostParticles.total() && !lostParticleFile.empty()) {
+    std::ofstream out(lostParticleFile.c_str());
+    if (!out ||
+        MB_SUCCESS != write_lost_particle_report(out, lostClusterRadius))
+      std::cerr << "Failed to write the lost particle report to "
+                << lostParticleFile << std::endl;
+  }
+
   // if we created the moab instance
   // clear it
   if (moab_instance_created) {
@@ -121,8 +138,6 @@ ErrorCode DagMC::load_file(const char* cfile) {
   std::stringstream ss;
   ss << "Loading file " << cfile;
   logger.message(ss.str());
-  // load options
-  char options[120] = {0};
   std::string file_ext = "";  // file extension
 
   // get the last 4 chars of file .i.e .h5m .sat etc
@@ -134,7 +149,15 @@ ErrorCode DagMC::load_file(const char* cfile) {
   rval = MBI->create_meshset(MESHSET_SET, file_set);
   if (MB_SUCCESS != rval) return rval;
 
-  rval = MBI->load_file(cfile, &file_set, options, NULL, 0, 0);
+  // a partial read of the sets with these geometric dimensions, which
+  // brings in their children and contents
+  const int geom_dims[] = {2, 3, 4};
+  if (loadGeometryOnly && file_ext == ".h5m") {
+    rval = MBI->load_file(cfile, &file_set, loadOptions.c_str(),
+                          GEOM_DIMENSION_TAG_NAME, geom_dims, 3);
+  } else {
+    rval = MBI->load_file(cfile, &file_set, loadOptions.c_str(), NULL, 0, 0);
+  }
 
   if (MB_UNHANDLED_OPTION == rval) {
     // Some options were unhandled; this is common for loading h5m files.
@@ -195,10 +218,16 @@ ErrorCode DagMC::setup_obbs() {
 
   // If we havent got an OBB Tree, build one.
   if (!GTT->have_obb_tree()) {
-    logger.message("Building acceleration data structures...");
 #ifdef DOUBLE_DOWN
+    logger.message("Building acceleration data structures...");
     rval = ray_tracer->init();
 #else
+    // parallel or cached path, the flat BVH is set up along with the indices
+    if (1 != buildThreads || !bvhCacheFile.empty() || !bvhSharedName.empty()) {
+      obbsDeferred = true;
+      return MB_SUCCESS;
+    }
+    logger.message("Building acceleration data structures...");
     rval = GTT->construct_obb_trees();
 #endif
     MB_CHK_SET_ERR(rval, "Failed to build obb trees");
@@ -206,18 +235,407 @@ ErrorCode DagMC::setup_obbs() {
   return MB_SUCCESS;
 }
 
+ErrorCode DagMC::build_deferred_obbs() {
+  if (!obbsDeferred) return MB_SUCCESS;
+
+  std::lock_guard<std::mutex> lock(obbMutex);
+  if (obbsDeferred) {
+    logger.message("Building deferred acceleration data structures...");
+    ErrorCode rval = GTT->construct_obb_trees();
+    MB_CHK_SET_ERR(rval, "Failed to build obb trees");
+    obbsDeferred = false;
+  }
+  return MB_SUCCESS;
+}
+
 // setups of the indices for the problem, builds a list of surface and volumes
 // indices
 ErrorCode DagMC::setup_indices() {
   Range surfs, vols;
   ErrorCode rval = setup_geometry(surfs, vols);
 
+  // the distance caches are stored by index, note which volumes have them
+  std::vector<std::pair<EntityHandle, int>> cached_vols;
+  for (size_t i = 0; i < distanceCaches.size(); i++)
+    if (distanceCaches[i])
+      cached_vols.emplace_back(vol_handles()[i],
+                               distanceCaches[i]->max_depth());
+  distanceCaches.clear();
+
   // build the various index vectors used for efficiency
   rval = build_indices(surfs, vols);
   MB_CHK_SET_ERR(rval, "Failed to build surface/volume indices");
+
+  // the query statistics are kept by volume index
+  if (queryStats) queryStats->resize(vol_handles().size());
+
+  // the flat BVH refers to entities by index, keep it in step
+  if ((flat_bvh || obbsDeferred || !bvhCacheFile.empty() ||
+       !bvhSharedName.empty()) &&
+      (bvhSharedName.empty() || MB_SUCCESS != share_flat_bvh()) &&
+      (bvhCacheFile.empty() || MB_SUCCESS != load_bvh_cache(bvhCacheFile))) {
+    rval = build_flat_bvh();
+    MB_CHK_SET_ERR(rval, "Failed to rebuild the flat BVH");
+
+    // a cache that cannot be written only costs the next run
+    if (!bvhCacheFile.empty() && MB_SUCCESS != write_bvh_cache(bvhCacheFile))
+      logger.warning("Failed to write the flat BVH cache " + bvhCacheFile);
+  }
+
+  // the boxes of the volumes may have changed
+  if (volume_tree) {
+    rval = build_volume_tree();
+    MB_CHK_SET_ERR(rval, "Failed to rebuild the top-level trees");
+  }
+
+#if MOAB_VERSION_MAJOR == 5 && MOAB_VERSION_MINOR > 2
+  // so does the point location grid
+  if (point_locator) {
+    rval = build_point_locator(point_locator->max_cells());
+    MB_CHK_SET_ERR(rval, "Failed to rebuild the point location grid");
+  }
+#endif
+
+  // the boundaries may have changed, rebuild the distance caches
+  for (const auto& cached : cached_vols) {
+    if (!entIndices.count(cached.first)) continue;
+    rval = build_distance_cache(cached.first, cached.second);
+    MB_CHK_SET_ERR(rval, "Failed to rebuild a distance cache");
+  }
+  return MB_SUCCESS;
+}
+
+ErrorCode DagMC::build_flat_bvh() {
+#ifdef DOUBLE_DOWN
+  MB_SET_ERR(MB_NOT_IMPLEMENTED,
+             "The flat BVH is not available with double-down");
+#else
+  ErrorCode rval;
+  std::unique_ptr<FlatBVH> bvh(new FlatBVH());
+  bvh->set_single_precision(singlePrecision);
+  bvh->set_winding_numbers(windingNumbers);
+  if (GTT->have_obb_tree()) {
+    rval = bvh->build(GTT.get(), surf_handles(), vol_handles());
+  } else {
+    logger.message("Building acceleration data structures...");
+    rval = bvh->construct(GTT.get(), surf_handles(), vol_handles(),
+                          buildThreads);
+  }
+  MB_CHK_SET_ERR(rval, "Failed to build the flat BVH");
+  rval = setup_complement(*bvh);
+  MB_CHK_SET_ERR(rval, "Failed to build the implicit complement tree");
+  flat_bvh = std::move(bvh);
+  return MB_SUCCESS;
+#endif
+}
+
+ErrorCode DagMC::build_volume_tree() {
+  std::vector<int> ids;
+  std::vector<double> boxes;
+  for (size_t i = 1; i < vol_handles().size(); i++) {
+    if (is_implicit_complement(vol_handles()[i])) continue;
+    double box[6];
+    ErrorCode rval = volume_box(i, box, box + 3);
+    MB_CHK_SET_ERR(rval, "Failed to get the box of volume " << i);
+    ids.push_back(i);
+    boxes.insert(boxes.end(), box, box + 6);
+  }
+  std::unique_ptr<VolumeTree> tree(new VolumeTree());
+  tree->build(ids, boxes);
+  volume_tree = std::move(tree);
+
+  instance_tree.reset();
+  if (instances.empty()) return MB_SUCCESS;
+  ids.clear();
+  boxes.clear();
+  for (size_t i = 0; i < instances.size(); i++) {
+    double box[6];
+    ErrorCode rval = get_instance_box(i, box, box + 3);
+    MB_CHK_SET_ERR(rval, "Failed to get the box of instance " << i);
+    ids.push_back(i);
+    boxes.insert(boxes.end(), box, box + 6);
+  }
+  tree.reset(new VolumeTree());
+  tree->build(ids, boxes);
+  instance_tree = std::move(tree);
   return MB_SUCCESS;
 }
 
+ErrorCode DagMC::volume_box(int vol_idx, double lower[3], double upper[3]) {
+  if (flat_bvh) return flat_bvh->get_bounding_box(vol_idx, 3, lower, upper);
+  return getobb(entity_by_index(3, vol_idx), lower, upper);
+}
+
+#if MOAB_VERSION_MAJOR == 5 && MOAB_VERSION_MINOR > 2
+ErrorCode DagMC::build_point_locator(int max_cells) {
+  // the regions are located with the plain find_volume()
+  point_locator.reset();
+
+  std::unique_ptr<PointLocator> locator(new PointLocator());
+  double tol = std::max(numerical_precision(), overlap_thickness());
+  ErrorCode rval =
+      locator->build(MBI, surf_handles(), surfVols, max_cells, tol);
+  MB_CHK_SET_ERR(rval, "Failed to build the point location grid");
+
+  // regions that cannot be located are left to find_volume()
+  int located = 0;
+  for (int region = 0; region < locator->num_regions(); region++) {
+    double xyz[3];
+    locator->region_point(region, xyz);
+    EntityHandle volume = 0;
+    rval = find_volume(xyz, volume);
+    if (MB_SUCCESS != rval || !volume) continue;
+    locator->set_region_volume(region, index_by_handle(volume));
+    located++;
+  }
+
+  std::stringstream ss;
+  ss << "Built a point location grid with " << locator->num_regions()
+     << " regions free of triangles, " << located << " located";
+  logger.message(ss.str());
+
+  point_locator = std::move(locator);
+  return MB_SUCCESS;
+}
+#endif
+
+ErrorCode DagMC::set_bvh_cache(const std::string& filename) {
+#ifdef _WIN32
+  if (!filename.empty()) {
+    MB_SET_ERR(MB_NOT_IMPLEMENTED,
+               "The flat BVH cache is not available on Windows");
+  }
+#endif
+  bvhCacheFile = filename;
+  return MB_SUCCESS;
+}
+
+ErrorCode DagMC::write_bvh_cache(const std::string& filename) {
+  if (!flat_bvh) {
+    MB_SET_ERR(MB_FAILURE, "There is no flat BVH to write");
+  }
+
+  uint64_t hash;
+  ErrorCode rval =
+      FlatBVH::model_hash(GTT.get(), surf_handles(), vol_handles(), hash);
+  MB_CHK_SET_ERR(rval, "Failed to hash the model");
+  rval = flat_bvh->write(filename, surf_handles(), vol_handles(), hash);
+  MB_CHK_SET_ERR(rval, "Failed to write the flat BVH cache");
+  return MB_SUCCESS;
+}
+
+ErrorCode DagMC::load_bvh_cache(const std::string& filename) {
+  uint64_t hash;
+  ErrorCode rval =
+      FlatBVH::model_hash(GTT.get(), surf_handles(), vol_handles(), hash);
+  MB_CHK_SET_ERR(rval, "Failed to hash the model");
+
+  std::unique_ptr<FlatBVH> bvh(new FlatBVH());
+  bvh->set_single_precision(singlePrecision);
+  bvh->set_winding_numbers(windingNumbers);
+  rval = bvh->load(filename, GTT.get(), surf_handles(), vol_handles(), hash);
+  if (MB_FILE_DOES_NOT_EXIST == rval) {
+    logger.message("No flat BVH cache found at " + filename);
+    return rval;
+  } else if (MB_SUCCESS != rval) {
+    logger.message("The flat BVH cache " + filename +
+                   " does not match the model");
+    return rval;
+  }
+
+  rval = setup_complement(*bvh);
+  MB_CHK_SET_ERR(rval, "Failed to build the implicit complement tree");
+  logger.message("Loaded the flat BVH cache " + filename);
+  flat_bvh = std::move(bvh);
+  return MB_SUCCESS;
+}
+
+ErrorCode DagMC::set_bvh_shared_memory(const std::string& name,
+                                       double timeout) {
+#ifdef _WIN32
+  if (!name.empty()) {
+    MB_SET_ERR(MB_NOT_IMPLEMENTED,
+               "Shared memory segments are not available on Windows");
+  }
+#endif
+  bvhSharedName = name;
+  bvhSharedTimeout = timeout;
+  return MB_SUCCESS;
+}
+
+ErrorCode DagMC::share_flat_bvh() {
+#ifdef _WIN32
+  MB_SET_ERR(MB_NOT_IMPLEMENTED,
+             "Shared memory segments are not available on Windows");
+#else
+  uint64_t hash;
+  ErrorCode rval =
+      FlatBVH::model_hash(GTT.get(), surf_handles(), vol_handles(), hash);
+  MB_CHK_SET_ERR(rval, "Failed to hash the model");
+
+  auto map_segment = [&]() {
+    std::unique_ptr<FlatBVH> bvh(new FlatBVH());
+    bvh->set_single_precision(singlePrecision);
+    bvh->set_winding_numbers(windingNumbers);
+    ErrorCode rval = bvh->load_shared(bvhSharedName, GTT.get(), surf_handles(),
+                                      vol_handles(), hash, bvhSharedTimeout);
+    if (MB_SUCCESS != rval) return rval;
+    rval = setup_complement(*bvh);
+    MB_CHK_SET_ERR(rval, "Failed to build the implicit complement tree");
+    logger.message("Mapped the shared flat BVH " + bvhSharedName);
+    flat_bvh = std::move(bvh);
+    return MB_SUCCESS;
+  };
+
+  for (int attempt = 0; attempt < 2; attempt++) {
+    rval = map_segment();
+    if (MB_SUCCESS == rval) return MB_SUCCESS;
+    if (MB_FILE_DOES_NOT_EXIST != rval) break;
+
+    // no segment, or a stale one was removed
+    int fd;
+    rval = FlatBVH::create_shared(bvhSharedName, fd);
+    // another process is writing the segment
+    if (MB_ALREADY_ALLOCATED == rval) continue;
+    MB_CHK_SET_ERR(rval, "Failed to create the shared flat BVH");
+    rval = build_flat_bvh();
+    if (MB_SUCCESS != rval) FlatBVH::unlink_shared(bvhSharedName, fd);
+    MB_CHK_SET_ERR(rval, "Failed to build the flat BVH");
+    rval = flat_bvh->write_shared(fd, surf_handles(), vol_handles(), hash);
+    if (MB_SUCCESS != rval) FlatBVH::unlink_shared(bvhSharedName);
+    MB_CHK_SET_ERR(rval, "Failed to write the shared flat BVH");
+    bvhSharedOwner = true;
+
+    // the writer maps the segment back like the others, so the node holds a
+    // single copy
+    rval = map_segment();
+    if (MB_SUCCESS == rval) return MB_SUCCESS;
+    break;
+  }
+  logger.warning("The shared flat BVH " + bvhSharedName +
+                 " was not written in time or was replaced");
+  return MB_FAILURE;
+#endif
+}
+
+void DagMC::set_query_stats(bool enable) {
+  if (!enable) {
+    queryStats.reset();
+    return;
+  }
+  queryStats.reset(new QueryStats());
+  queryStats->resize(vol_handles().size());
+}
+
+void DagMC::set_query_stats_file(const std::string& filename) {
+  queryStatsFile = filename;
+  if (!queryStats) set_query_stats(true);
+}
+
+ErrorCode DagMC::write_query_stats(std::ostream& os) {
+  if (!queryStats) {
+    MB_SET_ERR(MB_FAILURE, "The query statistics are not enabled");
+  }
+  std::vector<int> ids(queryStats->size(), 0);
+  for (size_t i = 1; i < ids.size() && i < vol_handles().size(); i++)
+    ids[i] = id_by_index(3, i);
+  queryStats->write_json(os, ids);
+  return os ? MB_SUCCESS : MB_FAILURE;
+}
+
+ErrorCode DagMC::recover_lost_particle(int vol_idx, const double xyz[3],
+                                       const double uvw[3],
+                                       const std::string& query,
+                                       LostParticles::Record& record) {
+  record = LostParticles::Record();
+  std::copy(xyz, xyz + 3, record.xyz);
+  std::copy(uvw, uvw + 3, record.uvw);
+  record.volume = vol_idx;
+  record.query = query;
+
+  // the physics codes may have lost track of the volume too
+  EntityHandle volume = 0;
+  if (vol_idx > 0 && (size_t)vol_idx < vol_handles().size())
+    volume = entity_by_index(3, vol_idx);
+  if (volume) {
+    ErrorCode rval = build_deferred_obbs();
+    MB_CHK_SET_ERR(rval, "Failed to build the OBB trees");
+    EntityHandle surface = 0;
+#ifdef DOUBLE_DOWN
+    rval = ray_tracer->closest_to_location(volume, xyz, record.distance,
+                                           &surface);
+    MB_CHK_SET_ERR(rval, "Failed to find the nearest surface");
+#else
+    EntityHandle root;
+    rval = get_root(volume, root);
+    MB_CHK_SET_ERR(rval, "Failed to get the OBB tree of the volume");
+    double nearest[3];
+    rval = obb_tree()->closest_to_location(xyz, root, nearest, record.facet,
+                                           &surface);
+    MB_CHK_SET_ERR(rval, "Failed to find the nearest facet");
+    record.distance = (CartVect(nearest) - CartVect(xyz)).length();
+#endif
+    record.surface = surface ? index_by_handle(surface) : 0;
+  }
+
+  // look for the particle where it is, then a little further along in case
+  // it slipped through a gap between the surfaces
+  const double nudges[] = {0.0, 1.0, 10.0, 100.0};
+  for (double nudge : nudges) {
+    nudge *= numerical_precision();
+    double point[3];
+    for (int d = 0; d < 3; d++) point[d] = xyz[d] + nudge * uvw[d];
+    EntityHandle found = 0;
+#if MOAB_VERSION_MAJOR == 5 && MOAB_VERSION_MINOR > 2
+    // fails if the point is in no volume
+    if (MB_SUCCESS != find_volume(point, found, uvw)) found = 0;
+#else
+    std::vector<EntityHandle> volumes;
+    ErrorCode rval = find_volumes(point, volumes, uvw);
+    MB_CHK_SET_ERR(rval, "Failed to find the volumes containing a point");
+    for (EntityHandle candidate : volumes)
+      if (candidate != volume) {
+        found = candidate;
+        break;
+      }
+#endif
+    if (found && found != volume) {
+      record.recovered = index_by_handle(found);
+      record.nudge = nudge;
+      break;
+    }
+  }
+
+  lostParticles.add(record);
+  return MB_SUCCESS;
+}
+
+ErrorCode DagMC::write_lost_particle_report(std::ostream& os,
+                                            double cluster_radius) {
+  std::vector<int> vol_ids(vol_handles().size(), 0);
+  for (size_t i = 1; i < vol_ids.size(); i++) vol_ids[i] = id_by_index(3, i);
+  std::vector<int> surf_ids(surf_handles().size(), 0);
+  for (size_t i = 1; i < surf_ids.size(); i++)
+    surf_ids[i] = id_by_index(2, i);
+  lostParticles.write_report(os, cluster_radius, vol_ids, surf_ids);
+  return os ? MB_SUCCESS : MB_FAILURE;
+}
+
+void DagMC::set_lost_particle_report(const std::string& filename,
+                                     double cluster_radius) {
+  lostParticleFile = filename;
+  lostClusterRadius = cluster_radius;
+}
+
+ErrorCode DagMC::setup_complement(FlatBVH& bvh) {
+  EntityHandle implicit_complement = 0;
+  ErrorCode rval = GTT->get_implicit_complement(implicit_complement);
+  if (MB_SUCCESS != rval || !implicit_complement ||
+      !entIndices.count(implicit_complement))
+    return MB_SUCCESS;
+  return bvh.build_complement(index_by_handle(implicit_complement));
+}
+
 bool DagMC::has_graveyard() {
   EntityHandle eh;
   return get_graveyard_group(eh) == MB_SUCCESS && eh != 0;
@@ -586,6 +1004,138 @@ ErrorCode DagMC::create_graveyard(bool overwrite) {
   return rval;
 }
 
+ErrorCode DagMC::transform_volume(EntityHandle volume, const double matrix[9],
+                                  const double translation[3]) {
+  std::vector<EntityHandle> surfs;
+  ErrorCode rval = MBI->get_child_meshsets(volume, surfs);
+  MB_CHK_SET_ERR(rval, "Failed to get the surfaces of the volume");
+
+  // every vertex of the triangles of the volume moves
+  std::vector<EntityHandle> verts;
+  for (auto surf : surfs) {
+    std::vector<EntityHandle> tris, conn;
+    rval = MBI->get_entities_by_type(surf, MBTRI, tris);
+    MB_CHK_SET_ERR(rval, "Failed to get the triangles of a surface");
+    rval = MBI->get_connectivity(tris.data(), tris.size(), conn, true);
+    MB_CHK_SET_ERR(rval, "Failed to get the triangle connectivity");
+    verts.insert(verts.end(), conn.begin(), conn.end());
+  }
+  std::sort(verts.begin(), verts.end());
+  verts.erase(std::unique(verts.begin(), verts.end()), verts.end());
+
+  std::vector<double> coords(3 * verts.size());
+  rval = MBI->get_coords(verts.data(), verts.size(), coords.data());
+  MB_CHK_SET_ERR(rval, "Failed to get the vertex coordinates");
+  for (size_t i = 0; i < coords.size(); i += 3) {
+    double moved[3];
+    for (int r = 0; r < 3; r++)
+      moved[r] = matrix[3 * r] * coords[i] + matrix[3 * r + 1] * coords[i + 1] +
+                 matrix[3 * r + 2] * coords[i + 2] + translation[r];
+    std::copy(moved, moved + 3, &coords[i]);
+  }
+  rval = MBI->set_coords(verts.data(), verts.size(), coords.data());
+  MB_CHK_SET_ERR(rval, "Failed to set the vertex coordinates");
+
+  // surfaces of other volumes sharing the vertices have moved as well
+  std::vector<EntityHandle> moved_surfs = surfs;
+  std::sort(surfs.begin(), surfs.end());
+  for (size_t i = 1; i < surf_handles().size(); i++) {
+    EntityHandle surf = surf_handles()[i];
+    if (std::binary_search(surfs.begin(), surfs.end(), surf)) continue;
+    std::vector<EntityHandle> tris, conn;
+    rval = MBI->get_entities_by_type(surf, MBTRI, tris);
+    MB_CHK_SET_ERR(rval, "Failed to get the triangles of a surface");
+    rval = MBI->get_connectivity(tris.data(), tris.size(), conn, true);
+    MB_CHK_SET_ERR(rval, "Failed to get the triangle connectivity");
+    for (auto vert : conn) {
+      if (std::binary_search(verts.begin(), verts.end(), vert)) {
+        moved_surfs.push_back(surf);
+        break;
+      }
+    }
+  }
+
+  return update_surfaces(moved_surfs);
+}
+
+ErrorCode DagMC::update_surfaces(const std::vector<EntityHandle>& surfaces) {
+  // the volumes bounded by the surfaces
+  std::vector<int> surf_indices;
+  std::vector<bool> vol_moved(vol_handles().size(), false);
+  for (auto surf : surfaces) {
+    int surf_idx = table_index(2, surf);
+    if (!surf_idx) {
+      MB_SET_ERR(MB_ENTITY_NOT_FOUND, "Not a surface of the model: " << surf);
+    }
+    surf_indices.push_back(surf_idx);
+    vol_moved[surfVols[2 * surf_idx]] = true;
+    vol_moved[surfVols[2 * surf_idx + 1]] = true;
+  }
+  std::vector<EntityHandle> vols;
+  for (size_t i = 1; i < vol_moved.size(); i++)
+    if (vol_moved[i]) vols.push_back(vol_handles()[i]);
+
+  // the measures cached by measure_all() are stale
+  Tag measure_tag;
+  ErrorCode rval =
+      MBI->tag_get_handle(MEASURE_TAG_NAME, 3, MB_TYPE_DOUBLE, measure_tag);
+  if (MB_SUCCESS == rval) {
+    for (auto surf : surfaces) {
+      rval = MBI->tag_delete_data(measure_tag, &surf, 1);
+      if (MB_SUCCESS != rval && MB_TAG_NOT_FOUND != rval)
+        MB_SET_ERR(rval, "Failed to remove the measures of a moved surface");
+    }
+  }
+
+  // rebuild the trees of the surfaces and join them into the volume trees
+  if (has_acceleration_datastructures()) {
+    for (auto vol : vols) {
+      rval = remove_bvh(vol, true);
+      MB_CHK_SET_ERR(rval, "Failed to delete the tree of a volume");
+    }
+#ifndef DOUBLE_DOWN
+    for (auto surf : surfaces) {
+      rval = geom_tool()->delete_obb_tree(surf);
+      MB_CHK_SET_ERR(rval, "Failed to delete the tree of a surface");
+    }
+#endif
+    for (auto vol : vols) {
+      rval = build_bvh(vol);
+      MB_CHK_SET_ERR(rval, "Failed to rebuild the tree of a volume");
+    }
+  }
+
+  // a mapped flat BVH is read-only, build a new one instead
+  if (flat_bvh && flat_bvh->mapped()) {
+    rval = build_flat_bvh();
+    MB_CHK_SET_ERR(rval, "Failed to rebuild the flat BVH");
+  } else if (flat_bvh) {
+    rval = flat_bvh->refit(surf_indices);
+    MB_CHK_SET_ERR(rval, "Failed to refit the flat BVH");
+  }
+
+  if (volume_tree) {
+    rval = build_volume_tree();
+    MB_CHK_SET_ERR(rval, "Failed to rebuild the top-level trees");
+  }
+
+#if MOAB_VERSION_MAJOR == 5 && MOAB_VERSION_MINOR > 2
+  if (point_locator) {
+    rval = build_point_locator(point_locator->max_cells());
+    MB_CHK_SET_ERR(rval, "Failed to rebuild the point location grid");
+  }
+#endif
+
+  for (auto vol : vols) {
+    int vol_idx = index_by_handle(vol);
+    if ((size_t)vol_idx >= distanceCaches.size() || !distanceCaches[vol_idx])
+      continue;
+    rval = build_distance_cache(vol, distanceCaches[vol_idx]->max_depth());
+    MB_CHK_SET_ERR(rval, "Failed to rebuild a distance cache");
+  }
+  return MB_SUCCESS;
+}
+
 ErrorCode DagMC::box_to_surf(const double llc[3], const double urc[3],
                              EntityHandle& surface_set) {
   ErrorCode rval;
@@ -688,6 +1238,12 @@ ErrorCode DagMC::init_OBBTree() {
   rval = setup_indices();
   MB_CHK_SET_ERR(rval, "Failed to setup problem indices");
 
+  // the parallel path only defers the obbs to build the flat BVH first
+  if (1 != buildThreads && bvhCacheFile.empty() && bvhSharedName.empty()) {
+    rval = build_deferred_obbs();
+    MB_CHK_SET_ERR(rval, "Failed to build the deferred OBBs");
+  }
+
   return MB_SUCCESS;
 }
 
@@ -776,25 +1332,260 @@ ErrorCode DagMC::finish_loading() {
 
 /* SECTION II: Fundamental Geometry Operations/Queries */
 
+// times a query, or num_calls queries made together, and records it with its
+// traversal counts, if stats is given
+class QueryTimer {
+ public:
+  QueryTimer(QueryStats* stats, int vol_idx, QueryStats::Query query,
+             uint64_t num_calls = 1)
+      : stats(stats), volIdx(vol_idx), query(query), numCalls(num_calls) {
+    if (stats) start = std::chrono::steady_clock::now();
+  }
+
+  ~QueryTimer() {
+    if (!stats) return;
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    stats->record(
+        volIdx, query,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+        counts, numCalls);
+  }
+
+  /** the counts to add the traversal work to, NULL if not recording */
+  QueryStats::Counts* traversal() { return stats ? &counts : nullptr; }
+
+ private:
+  QueryStats* stats;
+  int volIdx;
+  QueryStats::Query query;
+  uint64_t numCalls;
+  std::chrono::steady_clock::time_point start;
+  QueryStats::Counts counts;
+};
+
 ErrorCode DagMC::ray_fire(const EntityHandle volume, const double point[3],
                           const double dir[3], EntityHandle& next_surf,
                           double& next_surf_dist, RayHistory* history,
                           double user_dist_limit, int ray_orientation,
                           OrientedBoxTreeTool::TrvStats* stats) {
-  ErrorCode rval =
+  // traversal statistics are only collected by the OBB trees
+  if (flat_bvh && !stats) {
+    int next_surf_idx;
+    ErrorCode rval = ray_fire_idx(index_by_handle(volume), point, dir,
+                                  next_surf_idx, next_surf_dist, history,
+                                  user_dist_limit, ray_orientation);
+    if (MB_SUCCESS != rval) return rval;
+    next_surf = next_surf_idx ? surf_handles()[next_surf_idx] : 0;
+    return MB_SUCCESS;
+  }
+
+  ErrorCode rval = build_deferred_obbs();
+  MB_CHK_SET_ERR(rval, "Failed to build the OBB trees");
+  QueryTimer timer(queryStats.get(), queryStats ? index_by_handle(volume) : 0,
+                   QueryStats::RAY_FIRE);
+#ifndef DOUBLE_DOWN
+  // collect the traversal counts of this ray unless the caller does
+  OrientedBoxTreeTool::TrvStats ray_stats;
+  if (queryStats && !stats) stats = &ray_stats;
+#endif
+  rval =
       ray_tracer->ray_fire(volume, point, dir, next_surf, next_surf_dist,
                            history, user_dist_limit, ray_orientation, stats);
+#ifndef DOUBLE_DOWN
+  if (stats == &ray_stats) {
+    QueryStats::Counts* counts = timer.traversal();
+    for (unsigned nodes : ray_stats.nodes_visited()) counts->nodes += nodes;
+    for (unsigned leaves : ray_stats.leaves_visited())
+      counts->leaves += leaves;
+    counts->triangles = ray_stats.ray_tri_tests();
+  }
+#endif
   return rval;
 }
 
+ErrorCode DagMC::ray_fire_batch(size_t num_rays, const EntityHandle* volumes,
+                                const double* const ray_starts[3],
+                                const double* const ray_dirs[3],
+                                EntityHandle* next_surfs,
+                                double* next_surf_dists, RayHistory* histories,
+                                const double* dist_limits,
+                                int ray_orientation) {
+  if (0 == num_rays) return MB_SUCCESS;
+
+  // group the rays into packets: all rays in the same volume, sub-sorted by
+  // the octant of their direction so that neighbouring rays descend the same
+  // branches of the volume's tree
+  std::vector<std::pair<std::pair<EntityHandle, int>, size_t>> order(
+      num_rays);
+  for (size_t i = 0; i < num_rays; i++) {
+    int octant = (ray_dirs[0][i] < 0.0 ? 1 : 0) |
+                 (ray_dirs[1][i] < 0.0 ? 2 : 0) |
+                 (ray_dirs[2][i] < 0.0 ? 4 : 0);
+    order[i] = {{volumes[i], octant}, i};
+  }
+  std::sort(order.begin(), order.end());
+
+  const double neg_ray_len =
+      overlap_thickness() > 0 ? overlap_thickness() : numerical_precision();
+  const double tol = numerical_precision();
+  size_t begin = 0;
+  while (begin < num_rays) {
+    // the rays of one volume
+    const EntityHandle volume = order[begin].first.first;
+    size_t end = begin;
+    while (end < num_rays && order[end].first.first == volume) end++;
+
+    if (!flat_bvh) {
+      for (size_t k = begin; k < end; k++) {
+        size_t i = order[k].second;
+        double point[3] = {ray_starts[0][i], ray_starts[1][i],
+                           ray_starts[2][i]};
+        double dir[3] = {ray_dirs[0][i], ray_dirs[1][i], ray_dirs[2][i]};
+        ErrorCode rval = ray_fire(volume, point, dir, next_surfs[i],
+                                  next_surf_dists[i],
+                                  histories ? &histories[i] : NULL,
+                                  dist_limits ? dist_limits[i] : 0,
+                                  ray_orientation);
+        MB_CHK_SET_ERR(rval, "Failed to fire ray " << i << " of the batch");
+      }
+      begin = end;
+      continue;
+    }
+
+    // traverse the flat BVH with packets of the volume's rays
+    const int vol_idx = index_by_handle(volume);
+    for (size_t first = begin; first < end; first += FlatBVH::MAX_PACKET) {
+      const int count = std::min<size_t>(FlatBVH::MAX_PACKET, end - first);
+      double points[FlatBVH::MAX_PACKET][3], dirs[FlatBVH::MAX_PACKET][3];
+      double limits[FlatBVH::MAX_PACKET];
+      RayHistory* packet_histories[FlatBVH::MAX_PACKET];
+      int surf_idxs[FlatBVH::MAX_PACKET];
+      double dists[FlatBVH::MAX_PACKET];
+      for (int r = 0; r < count; r++) {
+        size_t i = order[first + r].second;
+        for (int d = 0; d < 3; d++) {
+          points[r][d] = ray_starts[d][i];
+          dirs[r][d] = ray_dirs[d][i];
+        }
+        limits[r] = dist_limits ? dist_limits[i] : 0;
+        packet_histories[r] = histories ? &histories[i] : NULL;
+      }
+
+      {
+        QueryTimer timer(queryStats.get(), vol_idx, QueryStats::RAY_FIRE,
+                         count);
+        ErrorCode rval = flat_bvh->ray_fire_packet(
+            vol_idx, count, points, dirs, surf_idxs, dists, packet_histories,
+            limits, ray_orientation, neg_ray_len, tol, timer.traversal());
+        MB_CHK_SET_ERR(rval, "Flat BVH packet ray fire failed");
+      }
+
+      for (int r = 0; r < count; r++) {
+        size_t i = order[first + r].second;
+        next_surfs[i] = surf_idxs[r] ? surf_handles()[surf_idxs[r]] : 0;
+        next_surf_dists[i] = dists[r];
+      }
+    }
+    begin = end;
+  }
+
+  return MB_SUCCESS;
+}
+
 ErrorCode DagMC::point_in_volume(const EntityHandle volume, const double xyz[3],
                                  int& result, const double* uvw,
                                  const RayHistory* history) {
-  ErrorCode rval =
-      ray_tracer->point_in_volume(volume, xyz, result, uvw, history);
+  if (flat_bvh)
+    return point_in_volume_idx(index_by_handle(volume), xyz, result, uvw,
+                               history);
+
+  ErrorCode rval = build_deferred_obbs();
+  MB_CHK_SET_ERR(rval, "Failed to build the OBB trees");
+  QueryTimer timer(queryStats.get(), queryStats ? index_by_handle(volume) : 0,
+                   QueryStats::POINT_IN_VOLUME);
+  rval = ray_tracer->point_in_volume(volume, xyz, result, uvw, history);
   return rval;
 }
 
+ErrorCode DagMC::ray_fire_idx(int vol_idx, const double point[3],
+                              const double dir[3], int& next_surf_idx,
+                              double& next_surf_dist, RayHistory* history,
+                              double user_dist_limit, int ray_orientation,
+                              OrientedBoxTreeTool::TrvStats* stats) {
+  if (flat_bvh && !stats) {
+    QueryTimer timer(queryStats.get(), vol_idx, QueryStats::RAY_FIRE);
+    double neg_ray_len = overlap_thickness() > 0 ? overlap_thickness()
+                                                 : numerical_precision();
+    ErrorCode rval = flat_bvh->ray_fire(
+        vol_idx, point, dir, next_surf_idx, next_surf_dist, history,
+        user_dist_limit, ray_orientation, neg_ray_len, numerical_precision(),
+        nullptr, timer.traversal());
+    MB_CHK_SET_ERR(rval, "Flat BVH ray fire failed");
+    return MB_SUCCESS;
+  }
+
+  EntityHandle next_surf;
+  ErrorCode rval = ray_fire(entity_by_index(3, vol_idx), point, dir, next_surf,
+                            next_surf_dist, history, user_dist_limit,
+                            ray_orientation, stats);
+  if (MB_SUCCESS != rval) return rval;
+  next_surf_idx = next_surf ? index_by_handle(next_surf) : 0;
+  return MB_SUCCESS;
+}
+
+ErrorCode DagMC::point_in_volume_idx(int vol_idx, const double xyz[3],
+                                     int& result, const double* uvw,
+                                     const RayHistory* history) {
+  EntityHandle volume = entity_by_index(3, vol_idx);
+  if (!flat_bvh) return point_in_volume(volume, xyz, result, uvw, history);
+
+  QueryTimer timer(queryStats.get(), vol_idx, QueryStats::POINT_IN_VOLUME);
+  if (flat_bvh->has_winding_data()) {
+    double winding;
+    ErrorCode rval = flat_bvh->winding_number(vol_idx, xyz, winding);
+    MB_CHK_SET_ERR(rval, "Flat BVH winding number failed");
+    // the winding number is a whole number away from the boundary; the
+    // implicit complement also contains the points of winding number 0
+    // outside the model, leave those to a ray
+    if (winding > 0.75 || winding < -0.25 ||
+        (winding < 0.25 && !is_implicit_complement(volume))) {
+      result = winding > 0.75 ? 1 : 0;
+      return MB_SUCCESS;
+    }
+  }
+
+  ErrorCode rval = flat_bvh->point_in_volume(
+      vol_idx, xyz, result, uvw, history, overlap_thickness() != 0,
+      is_implicit_complement(volume), numerical_precision(),
+      timer.traversal());
+  MB_CHK_SET_ERR(rval, "Flat BVH point in volume failed");
+  return MB_SUCCESS;
+}
+
+ErrorCode DagMC::surface_sense_idx(int vol_idx, int surf_idx, int& sense_out) {
+  assert(0 < surf_idx && 2 * (size_t)surf_idx < surfVols.size());
+  const int* sides = &surfVols[2 * surf_idx];
+  // surfaces without senses in the table are left to GeomTopoTool
+  if (!sides[0] && !sides[1])
+    return GTT->get_sense(entity_by_index(2, surf_idx),
+                          entity_by_index(3, vol_idx), sense_out);
+
+  if (sides[0] == vol_idx && sides[1] == vol_idx)
+    sense_out = 0;
+  else if (sides[0] == vol_idx)
+    sense_out = 1;
+  else if (sides[1] == vol_idx)
+    sense_out = -1;
+  else
+    return MB_ENTITY_NOT_FOUND;
+  return MB_SUCCESS;
+}
+
+ErrorCode DagMC::get_angle_idx(int surf_idx, const double xyz[3],
+                               double angle[3], const RayHistory* history) {
+  return get_angle(entity_by_index(2, surf_idx), xyz, angle, history);
+}
+
 ErrorCode DagMC::test_volume_boundary(const EntityHandle volume,
                                       const EntityHandle surface,
                                       const double xyz[3], const double uvw[3],
@@ -807,6 +1598,8 @@ ErrorCode DagMC::test_volume_boundary(const EntityHandle volume,
 // use spherical area test to determine inside/outside of a polyhedron.
 ErrorCode DagMC::point_in_volume_slow(EntityHandle volume, const double xyz[3],
                                       int& result) {
+  QueryTimer timer(queryStats.get(), queryStats ? index_by_handle(volume) : 0,
+                   QueryStats::POINT_IN_VOLUME_SLOW);
   ErrorCode rval = ray_tracer->point_in_volume_slow(volume, xyz, result);
   return rval;
 }
@@ -815,20 +1608,374 @@ ErrorCode DagMC::point_in_volume_slow(EntityHandle volume, const double xyz[3],
 // find a which volume contains the current point
 ErrorCode DagMC::find_volume(const double xyz[3], EntityHandle& volume,
                              const double* uvw) {
-  ErrorCode rval = ray_tracer->find_volume(xyz, volume, uvw);
+  if (point_locator) {
+    const int* candidates;
+    int num_candidates;
+    int vol_idx = point_locator->locate(xyz, candidates, num_candidates);
+    for (int i = 0; !vol_idx && i < num_candidates; i++) {
+      int result;
+      ErrorCode rval = point_in_volume_idx(candidates[i], xyz, result, uvw);
+      MB_CHK_SET_ERR(rval, "Failed to test volume " << candidates[i]);
+      if (result) vol_idx = candidates[i];
+    }
+    if (vol_idx) {
+      volume = vol_handles()[vol_idx];
+      return MB_SUCCESS;
+    }
+  }
+
+  if (volume_tree) {
+    std::vector<EntityHandle> found;
+    ErrorCode rval = find_volumes(xyz, found, uvw, true);
+    if (MB_SUCCESS != rval) return rval;
+    if (!found.empty()) {
+      volume = found[0];
+      return MB_SUCCESS;
+    }
+    // points in no other volume are in the implicit complement, if any
+    EntityHandle ic;
+    if (MB_SUCCESS == geom_tool()->get_implicit_complement(ic) && ic) {
+      int result;
+      rval = point_in_volume(ic, xyz, result, uvw);
+      MB_CHK_SET_ERR(rval, "Failed to test the implicit complement");
+      if (result) {
+        volume = ic;
+        return MB_SUCCESS;
+      }
+    }
+  }
+
+  ErrorCode rval = build_deferred_obbs();
+  MB_CHK_SET_ERR(rval, "Failed to build the OBB trees");
+  rval = ray_tracer->find_volume(xyz, volume, uvw);
   return rval;
 }
 #endif
 
+ErrorCode DagMC::find_volumes(const double xyz[3],
+                              std::vector<EntityHandle>& volumes,
+                              const double* uvw) {
+  return find_volumes(xyz, volumes, uvw, false);
+}
+
+ErrorCode DagMC::find_volumes(const double xyz[3],
+                              std::vector<EntityHandle>& volumes,
+                              const double* uvw, bool first_only) {
+  volumes.clear();
+  std::vector<int> candidates;
+  if (volume_tree) {
+    volume_tree->find_point(xyz, numerical_precision(), candidates);
+    std::sort(candidates.begin(), candidates.end());
+  } else {
+    for (size_t i = 1; i < vol_handles().size(); i++)
+      if (!is_implicit_complement(vol_handles()[i])) candidates.push_back(i);
+  }
+
+  for (int vol_idx : candidates) {
+    int result;
+    ErrorCode rval = point_in_volume_idx(vol_idx, xyz, result, uvw);
+    MB_CHK_SET_ERR(rval, "Failed to test volume " << vol_idx);
+    if (!result) continue;
+    volumes.push_back(vol_handles()[vol_idx]);
+    if (first_only) break;
+  }
+  return MB_SUCCESS;
+}
+
+ErrorCode DagMC::ray_fire(QueryContext& context, const EntityHandle volume,
+                          const double point[3], const double dir[3],
+                          EntityHandle& next_surf, double& next_surf_dist,
+                          int ray_orientation) {
+  if (flat_bvh) {
+    int next_surf_idx;
+    ErrorCode rval =
+        ray_fire_idx(context, index_by_handle(volume), point, dir,
+                     next_surf_idx, next_surf_dist, ray_orientation);
+    if (MB_SUCCESS != rval) return rval;
+    next_surf = next_surf_idx ? surf_handles()[next_surf_idx] : 0;
+    return MB_SUCCESS;
+  }
+  return ray_fire(volume, point, dir, next_surf, next_surf_dist,
+                  &context.history, context.dist_limit, ray_orientation);
+}
+
+ErrorCode DagMC::ray_fire_idx(QueryContext& context, int vol_idx,
+                              const double point[3], const double dir[3],
+                              int& next_surf_idx, double& next_surf_dist,
+                              int ray_orientation) {
+  if (!flat_bvh)
+    return ray_fire_idx(vol_idx, point, dir, next_surf_idx, next_surf_dist,
+                        &context.history, context.dist_limit,
+                        ray_orientation);
+
+  QueryTimer timer(queryStats.get(), vol_idx, QueryStats::RAY_FIRE);
+  double neg_ray_len = overlap_thickness() > 0 ? overlap_thickness()
+                                               : numerical_precision();
+  ErrorCode rval = flat_bvh->ray_fire(
+      vol_idx, point, dir, next_surf_idx, next_surf_dist, &context.history,
+      context.dist_limit, ray_orientation, neg_ray_len, numerical_precision(),
+      &context.frontier, timer.traversal());
+  MB_CHK_SET_ERR(rval, "Flat BVH ray fire failed");
+  return MB_SUCCESS;
+}
+
+ErrorCode DagMC::point_in_volume(QueryContext& context,
+                                 const EntityHandle volume, const double xyz[3],
+                                 int& result, const double* uvw) {
+  return point_in_volume(volume, xyz, result, uvw, &context.history);
+}
+
 // detemine distance to nearest surface
 ErrorCode DagMC::closest_to_location(EntityHandle volume,
                                      const double coords[3], double& result,
                                      EntityHandle* surface) {
-  ErrorCode rval =
-      ray_tracer->closest_to_location(volume, coords, result, surface);
+  ErrorCode rval = build_deferred_obbs();
+  MB_CHK_SET_ERR(rval, "Failed to build the OBB trees");
+  QueryTimer timer(queryStats.get(), queryStats ? index_by_handle(volume) : 0,
+                   QueryStats::CLOSEST_TO_LOCATION);
+  rval = ray_tracer->closest_to_location(volume, coords, result, surface);
   return rval;
 }
 
+ErrorCode DagMC::safety_distance(EntityHandle volume, const double point[3],
+                                 double& result, double min_distance) {
+  int vol_idx = index_by_handle(volume);
+  if ((size_t)vol_idx < distanceCaches.size() && distanceCaches[vol_idx]) {
+    result = distanceCaches[vol_idx]->lower_bound(point);
+    if (result > min_distance) return MB_SUCCESS;
+  }
+  return closest_to_location(volume, point, result);
+}
+
+ErrorCode DagMC::build_distance_cache(EntityHandle volume, int max_depth) {
+  double lower[3], upper[3];
+  ErrorCode rval = getobb(volume, lower, upper);
+  MB_CHK_SET_ERR(rval, "Failed to get the bounding box of the volume");
+  // leave room around the volume for the safety queries from outside it
+  double margin = 0.0;
+  for (int d = 0; d < 3; d++) margin = std::max(margin, upper[d] - lower[d]);
+  for (int d = 0; d < 3; d++) {
+    lower[d] -= 0.5 * margin;
+    upper[d] += 0.5 * margin;
+  }
+
+  std::unique_ptr<DistanceCache> cache(new DistanceCache());
+  rval = cache->build(lower, upper, max_depth,
+                      [&](const double xyz[3], double& dist) {
+                        return closest_to_location(volume, xyz, dist);
+                      });
+  MB_CHK_SET_ERR(rval, "Failed to build the distance cache");
+
+  int vol_idx = index_by_handle(volume);
+  if ((size_t)vol_idx >= distanceCaches.size())
+    distanceCaches.resize(vol_idx + 1);
+  distanceCaches[vol_idx] = std::move(cache);
+  return MB_SUCCESS;
+}
+
+ErrorCode DagMC::add_instance(EntityHandle prototype, const double rotation[9],
+                              const double translation[3], int& instance) {
+  if (!table_index(3, prototype)) {
+    MB_SET_ERR(MB_ENTITY_NOT_FOUND, "The prototype is not a volume");
+  }
+  // distances are only preserved by rigid transforms
+  for (int r = 0; r < 3; r++) {
+    for (int c = 0; c < 3; c++) {
+      double dot = 0.0;
+      for (int k = 0; k < 3; k++)
+        dot += rotation[3 * r + k] * rotation[3 * c + k];
+      if (std::fabs(dot - (r == c ? 1.0 : 0.0)) > 1e-9) {
+        MB_SET_ERR(MB_FAILURE, "The rotation of an instance is not "
+                               "orthonormal");
+      }
+    }
+  }
+
+  Instance placed;
+  placed.prototype = prototype;
+  std::copy(rotation, rotation + 9, placed.rotation);
+  std::copy(translation, translation + 3, placed.translation);
+  instance = instances.size();
+  instances.push_back(placed);
+  instance_tree.reset();
+  return MB_SUCCESS;
+}
+
+ErrorCode DagMC::add_lattice(EntityHandle prototype, const double origin[3],
+                             const double pitch[3], const int counts[3],
+                             int& lattice) {
+  for (int d = 0; d < 3; d++) {
+    if (counts[d] < 1 || !(pitch[d] > 0.0)) {
+      MB_SET_ERR(MB_FAILURE, "Invalid lattice counts or pitch");
+    }
+  }
+
+  Lattice placed;
+  std::copy(origin, origin + 3, placed.origin);
+  std::copy(pitch, pitch + 3, placed.pitch);
+  std::copy(counts, counts + 3, placed.counts);
+  placed.first = instances.size();
+
+  const double identity[9] = {1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0};
+  for (int k = 0; k < counts[2]; k++) {
+    for (int j = 0; j < counts[1]; j++) {
+      for (int i = 0; i < counts[0]; i++) {
+        double translation[3] = {origin[0] + i * pitch[0],
+                                 origin[1] + j * pitch[1],
+                                 origin[2] + k * pitch[2]};
+        int instance;
+        ErrorCode rval =
+            add_instance(prototype, identity, translation, instance);
+        MB_CHK_SET_ERR(rval, "Failed to place a lattice instance");
+      }
+    }
+  }
+
+  lattice = lattices.size();
+  lattices.push_back(placed);
+  return MB_SUCCESS;
+}
+
+int DagMC::find_lattice_instance(int lattice, const double xyz[3]) const {
+  const Lattice& grid = lattices[lattice];
+  int ijk[3];
+  for (int d = 0; d < 3; d++) {
+    double cell = std::floor((xyz[d] - grid.origin[d]) / grid.pitch[d] + 0.5);
+    // also rejects NaN
+    if (!(cell >= 0.0 && cell < grid.counts[d])) return -1;
+    ijk[d] = cell;
+  }
+  return grid.first +
+         (ijk[2] * grid.counts[1] + ijk[1]) * grid.counts[0] + ijk[0];
+}
+
+ErrorCode DagMC::ray_fire_instance(int instance, const double ray_start[3],
+                                   const double ray_dir[3],
+                                   EntityHandle& next_surf,
+                                   double& next_surf_dist, RayHistory* history,
+                                   double dist_limit, int ray_orientation) {
+  const Instance& placed = instances[instance];
+  double start[3], dir[3];
+  placed.to_local(ray_start, start);
+  placed.rotate_back(ray_dir, dir);
+  return ray_fire(placed.prototype, start, dir, next_surf, next_surf_dist,
+                  history, dist_limit, ray_orientation);
+}
+
+ErrorCode DagMC::point_in_instance(int instance, const double xyz[3],
+                                   int& result, const double* uvw,
+                                   const RayHistory* history) {
+  const Instance& placed = instances[instance];
+  double point[3], dir[3];
+  placed.to_local(xyz, point);
+  if (uvw) placed.rotate_back(uvw, dir);
+  return point_in_volume(placed.prototype, point, result, uvw ? dir : NULL,
+                         history);
+}
+
+ErrorCode DagMC::closest_to_location_instance(int instance,
+                                              const double point[3],
+                                              double& result,
+                                              EntityHandle* surface) {
+  const Instance& placed = instances[instance];
+  double local[3];
+  placed.to_local(point, local);
+  return closest_to_location(placed.prototype, local, result, surface);
+}
+
+ErrorCode DagMC::get_angle_instance(int instance, EntityHandle surf,
+                                    const double xyz[3], double angle[3],
+                                    const RayHistory* history) {
+  const Instance& placed = instances[instance];
+  double point[3], normal[3];
+  placed.to_local(xyz, point);
+  ErrorCode rval = get_angle(surf, point, normal, history);
+  if (MB_SUCCESS != rval) return rval;
+  placed.rotate(normal, angle);
+  return MB_SUCCESS;
+}
+
+ErrorCode DagMC::find_instance(const double xyz[3], int& instance,
+                               const double* uvw) {
+  std::vector<int> candidates;
+  if (instance_tree) {
+    instance_tree->find_point(xyz, numerical_precision(), candidates);
+    std::sort(candidates.begin(), candidates.end());
+  } else {
+    for (size_t i = 0; i < instances.size(); i++) candidates.push_back(i);
+  }
+
+  instance = -1;
+  for (int candidate : candidates) {
+    int result;
+    ErrorCode rval = point_in_instance(candidate, xyz, result, uvw);
+    MB_CHK_SET_ERR(rval, "Failed to test instance " << candidate);
+    if (result) {
+      instance = candidate;
+      break;
+    }
+  }
+  return MB_SUCCESS;
+}
+
+ErrorCode DagMC::ray_fire_instances(const double ray_start[3],
+                                    const double ray_dir[3], int& instance,
+                                    EntityHandle& next_surf,
+                                    double& next_surf_dist,
+                                    double dist_limit) {
+  instance = -1;
+  next_surf = 0;
+  next_surf_dist = std::numeric_limits<double>::max();
+  double limit = dist_limit > 0 ? dist_limit : next_surf_dist;
+  ErrorCode rval = MB_SUCCESS;
+
+  // the nearest entrance so far bounds the search
+  auto visit = [&](int candidate, double) {
+    EntityHandle surf;
+    double dist;
+    rval = ray_fire_instance(candidate, ray_start, ray_dir, surf, dist, NULL,
+                             limit, -1);
+    if (MB_SUCCESS == rval && surf && dist < limit) {
+      instance = candidate;
+      next_surf = surf;
+      next_surf_dist = limit = dist;
+    }
+    return MB_SUCCESS == rval ? limit : -1.0;
+  };
+
+  if (instance_tree) {
+    instance_tree->find_ray(ray_start, ray_dir, limit, visit);
+  } else {
+    for (size_t i = 0; i < instances.size() && MB_SUCCESS == rval; i++)
+      visit(i, 0.0);
+  }
+  MB_CHK_SET_ERR(rval, "Failed to fire a ray in an instance");
+  return MB_SUCCESS;
+}
+
+ErrorCode DagMC::get_instance_box(int instance, double lower[3],
+                                  double upper[3]) {
+  const Instance& placed = instances[instance];
+  double box[2][3];
+  ErrorCode rval = getobb(placed.prototype, box[0], box[1]);
+  MB_CHK_SET_ERR(rval, "Failed to get the box of the prototype");
+
+  // bound the eight transformed corners
+  std::fill(lower, lower + 3, std::numeric_limits<double>::max());
+  std::fill(upper, upper + 3, -std::numeric_limits<double>::max());
+  for (int corner = 0; corner < 8; corner++) {
+    double local[3], world[3];
+    for (int d = 0; d < 3; d++) local[d] = box[(corner >> d) & 1][d];
+    placed.rotate(local, world);
+    for (int d = 0; d < 3; d++) {
+      world[d] += placed.translation[d];
+      lower[d] = std::min(lower[d], world[d]);
+      upper[d] = std::max(upper[d], world[d]);
+    }
+  }
+  return MB_SUCCESS;
+}
+
 // calculate volume of polyhedron
 ErrorCode DagMC::measure_volume(EntityHandle volume, double& result) {
   ErrorCode rval = ray_tracer->measure_volume(volume, result);
@@ -841,35 +1988,186 @@ ErrorCode DagMC::measure_area(EntityHandle surface, double& result) {
   return rval;
 }
 
+// Neumaier's compensated sum, which keeps the rounding error of the sum of
+// the many small terms of a large model
+struct CompensatedSum {
+  double sum = 0.0;
+  double error = 0.0;
+  void add(double x) {
+    double t = sum + x;
+    if (std::fabs(sum) >= std::fabs(x))
+      error += (sum - t) + x;
+    else
+      error += (x - t) + sum;
+    sum = t;
+  }
+  double value() const { return sum + error; }
+};
+
+ErrorCode DagMC::measure_all(std::vector<double>& volumes,
+                             std::vector<double>& areas, bool use_cache) {
+  const std::vector<EntityHandle>& surfs = surf_handles();
+  const size_t num_surfs = surfs.size();
+  if (2 * num_surfs != surfVols.size())
+    MB_SET_ERR(MB_FAILURE, "The DAGMC indices have not been set up");
+
+  // the area, six times the signed volume of the cones from the origin to
+  // the triangles and the hash of the triangle coordinates of each surface
+  Tag measure_tag;
+  ErrorCode rval = MBI->tag_get_handle(MEASURE_TAG_NAME, 3, MB_TYPE_DOUBLE,
+                                       measure_tag,
+                                       MB_TAG_SPARSE | MB_TAG_CREAT);
+  MB_CHK_SET_ERR(rval, "Failed to get the measure tag");
+  std::vector<double> measures(3 * num_surfs, 0.0);
+  std::vector<bool> tagged(num_surfs, false);
+
+  // read the triangles of every surface, whose coordinates tell whether the
+  // tagged measures still hold
+  std::vector<double> coords;
+  std::vector<size_t> surf_begin(num_surfs + 1, 0);
+  for (size_t i = 1; i < num_surfs; i++) {
+    surf_begin[i] = coords.size();
+    if (use_cache) {
+      rval = MBI->tag_get_data(measure_tag, &surfs[i], 1, &measures[3 * i]);
+      if (MB_SUCCESS != rval && MB_TAG_NOT_FOUND != rval)
+        MB_SET_ERR(rval, "Failed to get the measures of surface " << i);
+      tagged[i] = MB_SUCCESS == rval;
+    }
+    std::vector<EntityHandle> tris, conn;
+    rval = MBI->get_entities_by_type(surfs[i], MBTRI, tris);
+    MB_CHK_SET_ERR(rval, "Failed to get the triangles of surface " << i);
+    if (tris.empty()) continue;
+    rval = MBI->get_connectivity(&tris[0], tris.size(), conn, true);
+    MB_CHK_SET_ERR(rval, "Failed to get triangle connectivity");
+    coords.resize(surf_begin[i] + 3 * conn.size());
+    rval = MBI->get_coords(&conn[0], conn.size(), &coords[surf_begin[i]]);
+    MB_CHK_SET_ERR(rval, "Failed to get triangle coordinates");
+  }
+  surf_begin[num_surfs] = coords.size();
+
+  // hash the surfaces in parallel, summing those whose hash has changed
+  std::vector<char> measured(num_surfs, 0);
+  dagmc_util::parallel_for(num_surfs - 1, buildThreads, [&](int k) {
+    const int i = k + 1;
+    const size_t num_coords = surf_begin[i + 1] - surf_begin[i];
+    uint64_t hash = dagmc_util::FNV_OFFSET, tagged_hash;
+    dagmc_util::hash_bytes(hash, coords.data() + surf_begin[i],
+                           num_coords * sizeof(double));
+    memcpy(&tagged_hash, &measures[3 * i + 2], sizeof(tagged_hash));
+    if (tagged[i] && hash == tagged_hash) return;
+
+    CompensatedSum area, volume;
+    for (size_t t = surf_begin[i]; t < surf_begin[i + 1]; t += 9) {
+      CartVect v0(&coords[t]);
+      CartVect normal =
+          (CartVect(&coords[t + 3]) - v0) * (CartVect(&coords[t + 6]) - v0);
+      area.add(0.5 * normal.length());
+      volume.add(v0 % normal);
+    }
+    measures[3 * i] = area.value();
+    measures[3 * i + 1] = volume.value();
+    memcpy(&measures[3 * i + 2], &hash, sizeof(hash));
+    measured[i] = 1;
+  });
+
+  std::vector<EntityHandle> handles;
+  std::vector<double> data;
+  for (size_t i = 1; i < num_surfs; i++) {
+    if (!measured[i]) continue;
+    handles.push_back(surfs[i]);
+    data.insert(data.end(), &measures[3 * i], &measures[3 * i + 3]);
+  }
+  if (!handles.empty()) {
+    rval = MBI->tag_set_data(measure_tag, handles.data(), handles.size(),
+                             data.data());
+    MB_CHK_SET_ERR(rval, "Failed to set the measures of the surfaces");
+  }
+
+  // each volume is bounded by the surfaces with it on one side only
+  areas.assign(num_surfs, 0.0);
+  std::vector<CompensatedSum> sums(vol_handles().size());
+  for (size_t i = 1; i < num_surfs; i++) {
+    areas[i] = measures[3 * i];
+    int forward = surfVols[2 * i], reverse = surfVols[2 * i + 1];
+    if (forward == reverse) continue;
+    if (forward) sums[forward].add(measures[3 * i + 1]);
+    if (reverse) sums[reverse].add(-measures[3 * i + 1]);
+  }
+  volumes.assign(sums.size(), 0.0);
+  for (size_t i = 1; i < sums.size(); i++) volumes[i] = sums[i].value() / 6.0;
+  return MB_SUCCESS;
+}
+
 // get sense of surface(s) wrt volume
 ErrorCode DagMC::surface_sense(EntityHandle volume, int num_surfaces,
                                const EntityHandle* surfaces, int* senses_out) {
-  ErrorCode rval =
-      GTT->get_surface_senses(volume, num_surfaces, surfaces, senses_out);
-  return rval;
+  int vol_idx = table_index(3, volume);
+  if (!vol_idx)
+    return GTT->get_surface_senses(volume, num_surfaces, surfaces, senses_out);
+
+  for (int i = 0; i < num_surfaces; i++) {
+    ErrorCode rval = surface_sense(volume, vol_idx, surfaces[i], senses_out[i]);
+    if (MB_SUCCESS != rval) return rval;
+  }
+  return MB_SUCCESS;
 }
 
 // get sense of surface(s) wrt volume
 ErrorCode DagMC::surface_sense(EntityHandle volume, EntityHandle surface,
                                int& sense_out) {
+  return surface_sense(volume, table_index(3, volume), surface, sense_out);
+}
+
+ErrorCode DagMC::surface_sense(EntityHandle volume, int vol_idx,
+                               EntityHandle surface, int& sense_out) {
+  int surf_idx = vol_idx ? table_index(2, surface) : 0;
+  if (surf_idx) return surface_sense_idx(vol_idx, surf_idx, sense_out);
+
   ErrorCode rval = GTT->get_sense(surface, volume, sense_out);
   return rval;
 }
 
 ErrorCode DagMC::get_angle(EntityHandle surf, const double in_pt[3],
                            double angle[3], const RayHistory* history) {
-  ErrorCode rval = ray_tracer->get_normal(surf, in_pt, angle, history);
+  // without a history the facet is located using the OBB trees
+  ErrorCode rval = MB_SUCCESS;
+  if (!history || 0 == history->size()) {
+    rval = build_deferred_obbs();
+    MB_CHK_SET_ERR(rval, "Failed to build the OBB trees");
+  }
+  rval = ray_tracer->get_normal(surf, in_pt, angle, history);
   return rval;
 }
 
 ErrorCode DagMC::next_vol(EntityHandle surface, EntityHandle old_volume,
                           EntityHandle& new_volume) {
+  int surf_idx = table_index(2, surface);
+  int vol_idx = table_index(3, old_volume);
+  if (surf_idx && vol_idx) {
+    int new_idx = next_vol_idx(surf_idx, vol_idx);
+    if (new_idx) {
+      new_volume = vol_handles()[new_idx];
+      return MB_SUCCESS;
+    }
+  }
+  // not in the table, let GeomTopoTool resolve or report it
   ErrorCode rval = GTT->next_vol(surface, old_volume, new_volume);
   return rval;
 }
 
 /* SECTION III: Indexing & Cross-referencing */
 
+int DagMC::table_index(int dimension, EntityHandle handle) const {
+  auto it = entIndices.find(handle);
+  if (it == entIndices.end()) return 0;
+  const std::vector<EntityHandle>& handles = entHandles[dimension];
+  if ((size_t)it->second >= handles.size() || handles[it->second] != handle)
+    return 0;
+  // the surface table is built along with the indices
+  if (2 == dimension && 2 * (size_t)it->second >= surfVols.size()) return 0;
+  return it->second;
+}
+
 EntityHandle DagMC::entity_by_id(int dimension, int id) const {
   return GTT->entity_by_id(dimension, id);
 }
@@ -945,6 +2243,21 @@ ErrorCode DagMC::build_indices(Range& surfs, Range& vols) {
     entIndices[vol_handle] = idx++;
   }
 
+  // tabulate the volumes on either side of each surface so that surface
+  // crossings and senses do not need to query the topology
+  surfVols.assign(2 * surf_handles().size(), 0);
+  for (size_t i = 1; i < surf_handles().size(); i++) {
+    EntityHandle senses[2] = {0, 0};
+    rval = GTT->get_surface_senses(surf_handles()[i], senses[0], senses[1]);
+    // surfaces without senses are left to next_vol() to resolve
+    if (MB_SUCCESS != rval) continue;
+    for (int side = 0; side < 2; side++) {
+      auto it = entIndices.find(senses[side]);
+      if (senses[side] && it != entIndices.end())
+        surfVols[2 * i + side] = it->second;
+    }
+  }
+
   // get group handles
   Range groups;
   rval = get_groups(groups);
@@ -1151,7 +2464,10 @@ ErrorCode DagMC::parse_properties(
   }
 
   // now that the keywords and tags are ready, iterate over all the actual
-  // geometry groups
+  // geometry groups once, gathering the packed value strings of every tag
+  // for every entity in memory; the values of an entity are kept in the order
+  // of its groups, as append_packed_string() would have stored them
+  std::map<Tag, std::map<EntityHandle, std::string>> packed;
   for (std::vector<EntityHandle>::iterator grp = group_handles().begin();
        grp != group_handles().end(); ++grp) {
     prop_map properties;
@@ -1168,19 +2484,47 @@ ErrorCode DagMC::parse_properties(
 
     for (prop_map::iterator i = properties.begin(); i != properties.end();
          ++i) {
-      std::string groupkey = (*i).first;
-      std::string groupval = (*i).second;
-
-      if (property_tagmap.find(groupkey) != property_tagmap.end()) {
-        Tag proptag = property_tagmap[groupkey];
-        const unsigned int groupsize = grp_sets.size();
-        for (unsigned int j = 0; j < groupsize; ++j) {
-          rval = append_packed_string(proptag, grp_sets[j], groupval);
-          if (MB_SUCCESS != rval) return rval;
-        }
+      std::map<std::string, Tag>::iterator tag_it =
+          property_tagmap.find((*i).first);
+      if (tag_it == property_tagmap.end()) continue;
+
+      std::map<EntityHandle, std::string>& values = packed[tag_it->second];
+      const std::string& groupval = (*i).second;
+      for (Range::iterator j = grp_sets.begin(); j != grp_sets.end(); ++j) {
+        std::string& str = values[*j];
+        str.append(groupval);
+        str.push_back('\0');
       }
     }
   }
+
+  // write each tag with a single call, after any values already set on the
+  // entities by an earlier parse
+  for (auto& tag_values : packed) {
+    const Tag tag = tag_values.first;
+    std::vector<EntityHandle> ents;
+    std::vector<const void*> ptrs;
+    std::vector<int> lens;
+    ents.reserve(tag_values.second.size());
+    ptrs.reserve(tag_values.second.size());
+    lens.reserve(tag_values.second.size());
+    for (auto& ent_value : tag_values.second) {
+      const void* p;
+      int len;
+      rval = MBI->tag_get_by_ptr(tag, &ent_value.first, 1, &p, &len);
+      if (MB_SUCCESS == rval)
+        ent_value.second.insert(0, static_cast<const char*>(p), len);
+      else if (MB_TAG_NOT_FOUND != rval)
+        return rval;
+
+      ents.push_back(ent_value.first);
+      ptrs.push_back(ent_value.second.data());
+      lens.push_back(ent_value.second.size());
+    }
+    rval = MBI->tag_set_by_ptr(tag, ents.data(), ents.size(), ptrs.data(),
+                               lens.data());
+    if (MB_SUCCESS != rval) return rval;
+  }
   return MB_SUCCESS;
 }
 
@@ -1339,7 +2683,9 @@ ErrorCode DagMC::getobb(EntityHandle volume, double minPt[3], double maxPt[3]) {
 #ifdef DOUBLE_DOWN
   ErrorCode rval = ray_tracer->get_bbox(volume, minPt, maxPt);
 #else
-  ErrorCode rval = GTT->get_bounding_coords(volume, minPt, maxPt);
+  ErrorCode rval = build_deferred_obbs();
+  MB_CHK_SET_ERR(rval, "Failed to build the OBB trees");
+  rval = GTT->get_bounding_coords(volume, minPt, maxPt);
 #endif
   MB_CHK_SET_ERR(rval, "Failed to get obb for volume");
   return MB_SUCCESS;
@@ -1350,7 +2696,9 @@ ErrorCode DagMC::getobb(EntityHandle volume, double center[3], double axis1[3],
 #ifdef DOUBLE_DOWN
   ErrorCode rval = ray_tracer->get_obb(volume, center, axis1, axis2, axis3);
 #else
-  ErrorCode rval = GTT->get_obb(volume, center, axis1, axis2, axis3);
+  ErrorCode rval = build_deferred_obbs();
+  MB_CHK_SET_ERR(rval, "Failed to build the OBB trees");
+  rval = GTT->get_obb(volume, center, axis1, axis2, axis3);
 #endif
   MB_CHK_SET_ERR(rval, "Failed to get obb for volume");
   return MB_SUCCESS;
@@ -3,15 +3,23 @@
 
 #include <assert.h>
 
+#include <atomic>
 #include <limits>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
 #include "DagMCVersion.hpp"
+#include "DistanceCache.hpp"
+#include "FlatBVH.hpp"
+#include "LostParticles.hpp"
+#include "PointLocator.hpp"
+#include "QueryStats.hpp"
+#include "VolumeTree.hpp"
 #include "MBTagConventions.hpp"
 #include "logger.hpp"
 #include "moab/CartVect.hpp"
@@ -116,6 +124,25 @@ class DagMC {
    */
   ErrorCode load_file(const char* cfile);
 
+  /**\brief Set how load_file() reads the file
+   *
+   *\param options MOAB reader options separated by ';', e.g.
+   *       "PARALLEL=BCAST" for the root process of a parallel job to read
+   *       the file and broadcast it to the others (this needs MOAB built
+   *       with MPI, and load_file() to be called by every process together)
+   *\param geometry_only for .h5m files, read only the surfaces, volumes and
+   *       groups with their children and contents, skipping the other sets,
+   *       e.g. stored tally meshes, and the elements only they contain
+   */
+  void set_load_options(const std::string& options,
+                        bool geometry_only = false) {
+    loadOptions = options;
+    loadGeometryOnly = geometry_only;
+  }
+
+  /** The reader options set by set_load_options() */
+  const std::string& load_options() const { return loadOptions; }
+
   /*\brief Use pre-loaded geometry set
    *
    * Works like load_file, but using data that has been externally
@@ -178,6 +205,29 @@ class DagMC {
    */
   ErrorCode create_graveyard(bool overwrite = false);
 
+  /**\brief Move a volume and update the acceleration structures in place
+   *
+   * Applies x' = matrix x + translation (matrix in row major order) to every
+   * vertex of the surfaces of the volume, then calls update_surfaces() for
+   * those surfaces and any other surface sharing their vertices. The caller
+   * is responsible for the volume not overlapping others at its new place;
+   * a volume moved within the implicit complement is always valid.
+   */
+  ErrorCode transform_volume(EntityHandle volume, const double matrix[9],
+                             const double translation[3]);
+
+  /**\brief Update the acceleration structures after surfaces have moved
+   *
+   * For use after the vertices of the surfaces have been moved without
+   * changing their triangles. The flat BVH is refit rather than rebuilt
+   * (see FlatBVH::refit()), only the OBB trees of the surfaces and of the
+   * volumes they bound (including the implicit complement) are rebuilt, and
+   * the point location grid and the distance caches of those volumes are
+   * rebuilt. The measures of the surfaces cached by measure_all() are
+   * removed. Adding or removing surfaces still requires setup_indices().
+   */
+  ErrorCode update_surfaces(const std::vector<EntityHandle>& surfaces);
+
   /** Returns true if the model has a graveyard volume, false if not */
   bool has_graveyard();
 
@@ -187,7 +237,277 @@ class DagMC {
   /** Retrieve the graveyard group on the model if it exists */
   ErrorCode get_graveyard_group(EntityHandle& graveyard_group);
 
+  /**\brief Build a flattened BVH used by ray_fire() and point_in_volume()
+   *
+   * Stores the acceleration structure in contiguous arrays (see FlatBVH)
+   * which are traversed instead of the MOAB entity sets. If the OBB trees
+   * exist they are compiled into the flat BVH, otherwise it is constructed
+   * directly from the triangles using build_threads() threads. Must be called
+   * after the indices have been set up (e.g. by init_OBBTree()). Once built,
+   * the flat BVH is kept up to date when the indices are rebuilt (e.g. when a
+   * graveyard is created or removed). Not available with double-down.
+   */
+  ErrorCode build_flat_bvh();
+
+  /** Returns true if ray_fire() and point_in_volume() use the flattened BVH */
+  bool has_flat_bvh() const { return flat_bvh != nullptr; }
+
+  /** Discard the flattened BVH, queries revert to the OBB trees */
+  void clear_flat_bvh() { flat_bvh.reset(); }
+
+  /**\brief Build the top-level trees over the boxes of volumes and instances
+   *
+   * One VolumeTree over the boxes of the volumes other than the implicit
+   * complement and, if instances have been placed, one over the boxes of
+   * the instances. find_volume(), find_volumes(), find_instance() and
+   * ray_fire_instances() then only test the entries whose boxes contain the
+   * point or are crossed by the ray. Can be rebuilt at any time, e.g. after
+   * moving volumes; it is rebuilt with the indices, while placing instances
+   * discards the instance tree until the next call.
+   */
+  ErrorCode build_volume_tree();
+
+  /** Returns true if the top-level tree over the volumes has been built */
+  bool has_volume_tree() const { return volume_tree != nullptr; }
+
+  /** Discard the top-level trees */
+  void clear_volume_tree() {
+    volume_tree.reset();
+    instance_tree.reset();
+  }
+
+#if MOAB_VERSION_MAJOR == 5 && MOAB_VERSION_MINOR > 2
+  /**\brief Build a grid used by find_volume() to locate points
+   *
+   * The cells of the grid free of triangles are located when the grid is
+   * built, so find_volume() resolves points in them without firing any
+   * rays; in the other cells only the volumes bounded by the surfaces
+   * passing through the cell are tested (see PointLocator). Must be called
+   * after the indices have been set up and is kept up to date when they are
+   * rebuilt, like the flat BVH.
+   *
+   *\param max_cells upper bound on the number of cells in the grid
+   */
+  ErrorCode build_point_locator(int max_cells = 1 << 18);
+
+  /** Returns true if find_volume() uses the point location grid */
+  bool has_point_locator() const { return point_locator != nullptr; }
+
+  /** Discard the point location grid */
+  void clear_point_locator() { point_locator.reset(); }
+#endif
+
+  /**\brief Set the number of threads used to build the acceleration structure
+   *
+   * With the default of one thread, setup_obbs() constructs the MOAB OBB
+   * trees serially. Any other value selects the parallel path: setup_obbs()
+   * defers the OBB trees and setup_indices() constructs the flat BVH instead,
+   * building the surface trees concurrently and then joining them into the
+   * volume trees. ray_fire() and point_in_volume() only use the flat BVH;
+   * init_OBBTree() then constructs the deferred OBB trees, needed by queries
+   * such as closest_to_location(), with build_deferred_obbs() so that no
+   * query modifies the model. Has no effect with double-down.
+   *
+   *\param num_threads number of threads, 0 to use all available cores
+   */
+  void set_build_threads(int num_threads) { buildThreads = num_threads; }
+
+  /** Number of threads used to build the acceleration structure */
+  int build_threads() const { return buildThreads; }
+
+  /**\brief Construct the OBB trees if their construction was deferred
+   *
+   * Called by init_OBBTree() on the parallel path. With a flat BVH cache or
+   * shared memory segment the OBB trees are left to be constructed by the
+   * first query that needs them; call this after setup to construct them
+   * before querying from several threads. Does nothing if the trees exist.
+   */
+  ErrorCode build_deferred_obbs();
+
+  /**\brief Store the flat BVH in single precision
+   *
+   * Halves the memory used by the nodes and triangles of the flat BVH and
+   * the bandwidth needed to traverse it. Boxes are rounded outwards and the
+   * triangles found in single precision are re-intersected in double
+   * precision, so ray_fire() and point_in_volume() return the same results.
+   * Takes effect the next time the flat BVH is built or loaded.
+   */
+  void set_single_precision(bool single) { singlePrecision = single; }
+
+  /** Returns true if the flat BVH is stored in single precision */
+  bool single_precision() const { return singlePrecision; }
+
+  /**\brief Decide point_in_volume() with generalized winding numbers
+   *
+   * The flat BVH stores the moments of the triangles beneath each node of
+   * the surface trees, and point_in_volume() sums the solid angles of the
+   * boundary of the volume (see FlatBVH::winding_number()), approximating
+   * distant nodes. The result does not depend on a ray direction, so points
+   * near the boundary need neither a second ray nor point_in_volume_slow().
+   * Only points within numerical noise of the boundary, where the winding
+   * number is not close to a whole number, are decided by a ray as before.
+   * The implicit complement always falls back to the ray for points with a
+   * winding number near 0, as it also holds the space outside the model
+   * (graveyard or not), so only points inside other volumes are decided by
+   * the winding number alone. Takes effect the next time the flat BVH is
+   * built or loaded.
+   */
+  void set_winding_numbers(bool winding) { windingNumbers = winding; }
+
+  /** Returns true if point_in_volume() uses winding numbers */
+  bool winding_numbers() const {
+    return flat_bvh && flat_bvh->has_winding_data();
+  }
+
+  /**\brief Counters of the rays fired in the implicit complement
+   *
+   * With the flat BVH, rays in the implicit complement are fired through a
+   * top-level tree over the boxes of the volumes bounding it rather than the
+   * tree joining all of its surfaces (see FlatBVH::build_complement()). The
+   * counters show how many of those boxes and surfaces the rays searched.
+   * They are only updated while query statistics are collected (see
+   * set_query_stats()) and are zero without the flat BVH.
+   */
+  FlatBVH::ComplementStats complement_stats() const {
+    return flat_bvh ? flat_bvh->complement_stats()
+                    : FlatBVH::ComplementStats();
+  }
+
+  /** Reset the counters of complement_stats() */
+  void reset_complement_stats() {
+    if (flat_bvh) flat_bvh->reset_complement_stats();
+  }
+
+  /**\brief Collect per-volume query statistics
+   *
+   * When enabled, ray_fire(), point_in_volume(), point_in_volume_slow() and
+   * closest_to_location() record, for the volume queried, their number of
+   * calls, a histogram of their durations and the nodes, leaves and
+   * triangles their traversals visited (see QueryStats), from which volumes
+   * that are slow to query can be found in production runs. Traversal
+   * counts are only available from the flat BVH and, for ray_fire(), the
+   * OBB trees. When disabled the cost is one branch per query. Enabling
+   * discards any counters collected so far.
+   */
+  void set_query_stats(bool enable);
+
+  /** The query statistics, NULL unless enabled */
+  const QueryStats* query_stats() const { return queryStats.get(); }
+
+  /** Zero the query statistics */
+  void reset_query_stats() {
+    if (queryStats) queryStats->reset();
+  }
+
+  /** Write the query statistics as JSON, volumes identified by index and
+   *  global id */
+  ErrorCode write_query_stats(std::ostream& os);
+
+  /**\brief Write the query statistics to a file when this DagMC is destroyed
+   *
+   * Enables the query statistics.
+   *
+   *\param filename path of the JSON file, empty to write none
+   */
+  void set_query_stats_file(const std::string& filename);
+
+  /**\brief Record a lost particle and try to find the volume it is in
+   *
+   * Called by the physics codes when a query fails for a particle, e.g. a
+   * ray fired from inside a volume hits none of its surfaces. Finds the
+   * facet of the volume nearest the particle, then looks for the volume
+   * containing the particle with find_volume(), first at its location and
+   * then moved along its direction by 1, 10 and 100 times the numerical
+   * precision, accepting any volume other than the one it was lost in. The
+   * outcome is added to lost_particles().
+   *
+   *\param vol_idx index of the volume the particle was lost in
+   *\param xyz, uvw location and direction of the particle
+   *\param query name of the failed query, for the report
+   *\param record set to the record added, record.recovered being the index
+   *       of the volume found or 0
+   */
+  ErrorCode recover_lost_particle(int vol_idx, const double xyz[3],
+                                  const double uvw[3], const std::string& query,
+                                  LostParticles::Record& record);
+
+  /** The lost particles recorded by recover_lost_particle() */
+  const LostParticles& lost_particles() const { return lostParticles; }
+
+  /** Write a report of the lost particles, recorded within cluster_radius of
+   *  each other being grouped together */
+  ErrorCode write_lost_particle_report(std::ostream& os,
+                                       double cluster_radius = 1.0);
+
+  /**\brief Write the lost particle report to a file when this DagMC is
+   * destroyed, if any particles were lost
+   *
+   *\param filename path of the report, empty to write none
+   */
+  void set_lost_particle_report(const std::string& filename,
+                                double cluster_radius = 1.0);
+
+  /**\brief Use a cache file for the flat BVH
+   *
+   * When set, setup_obbs() defers the OBB trees (see build_deferred_obbs())
+   * and setup_indices() maps the flat BVH from the cache file if it was
+   * written for this model. Otherwise the flat BVH is built and written to
+   * the file for the next run. The file is mapped read-only, so processes on
+   * the same node share one copy of the acceleration structure. Not
+   * available with double-down; returns MB_NOT_IMPLEMENTED on Windows.
+   *
+   *\param filename path of the cache file, empty to disable the cache
+   */
+  ErrorCode set_bvh_cache(const std::string& filename);
+
+  /** Path of the flat BVH cache file, empty if disabled */
+  const std::string& bvh_cache() const { return bvhCacheFile; }
+
+  /**\brief Write the flat BVH to a cache file
+   *
+   * The file is tied to the model by a hash of the geometry and by the
+   * surface and volume indices; requires the flat BVH to exist.
+   */
+  ErrorCode write_bvh_cache(const std::string& filename);
+
+  /**\brief Load the flat BVH from a cache file
+   *
+   * Must be called after the indices have been set up. Returns
+   * MB_FILE_DOES_NOT_EXIST if there is no such file and MB_FAILURE if the
+   * file was written for a different model; the current flat BVH (if any) is
+   * kept in both cases.
+   */
+  ErrorCode load_bvh_cache(const std::string& filename);
+
+  /**\brief Share the flat BVH between the processes on a node
+   *
+   * When set, setup_obbs() defers the OBB trees and setup_indices() maps the
+   * flat BVH read-only from the POSIX shared memory segment of this name.
+   * The first process to get there builds the flat BVH and writes it to the
+   * segment; the others wait up to timeout seconds for it to be written
+   * instead of building their own. A segment whose writer died before
+   * completing it, or that was written for another model, is replaced
+   * rather than waited for or rejected. The queries are unchanged. Each process
+   * still holds its own MOAB mesh and builds its OBB trees only if a query
+   * needs them (see build_deferred_obbs()). The segment is removed when the
+   * DagMC that wrote it is destroyed (or with FlatBVH::unlink_shared() after
+   * a crash). Takes precedence over the cache file, which is used if the
+   * segment cannot be. Not available with double-down; returns
+   * MB_NOT_IMPLEMENTED on Windows.
+   *
+   *\param name name of the segment, empty to disable sharing
+   */
+  ErrorCode set_bvh_shared_memory(const std::string& name,
+                                  double timeout = 300.0);
+
+  /** Name of the shared memory segment of the flat BVH, empty if disabled */
+  const std::string& bvh_shared_memory() const { return bvhSharedName; }
+
  private:
+  /** map the flat BVH from its shared memory segment, writing the segment
+   *  first if no other process has */
+  ErrorCode share_flat_bvh();
+
   /** convenience function for converting a bounding box into a box of triangles
    *  with outward facing normals and setting up set structure necessary for
    *  representation as a geometric entity
@@ -212,12 +532,78 @@ class DagMC {
 
   typedef GeomQueryTool::RayHistory RayHistory;
 
+  /**\brief Per-thread query state
+   *
+   * A QueryContext owns all of the mutable state needed by a sequence of
+   * queries made on behalf of one particle: the ray history, the distance
+   * limit and, with a flat BVH, the traversal frontier from which rays
+   * continuing along the same line resume (see FlatBVH::Frontier).
+   *
+   * With a flat BVH (see build_flat_bvh()), ray_fire(), ray_fire_idx() and
+   * point_in_volume() taking a QueryContext only read the model and the flat
+   * BVH, so any number of threads may call them on one shared DagMC instance
+   * concurrently provided each thread uses its own QueryContext. Without a
+   * flat BVH they go through the GeomQueryTool, whose call counters are
+   * updated without synchronization. The queries that need the OBB trees
+   * (closest_to_location(), get_angle(), point_in_volume_slow(),
+   * find_volume() without a point location grid and recover_lost_particle())
+   * build them on first use if their construction is still deferred (see
+   * build_deferred_obbs()), which must not happen while other threads query.
+   * Geometry setup and modification (loading, init_OBBTree(), graveyard
+   * creation/removal, etc.) must not run concurrently with queries.
+   */
+  class QueryContext {
+   public:
+    /** facets crossed by the current particle track */
+    RayHistory history;
+    /** distance limit applied to ray fires, no limit if <= 0 */
+    double dist_limit = 0;
+    /** nodes left unexplored by the last rays fired in a few volumes */
+    FlatBVH::Frontier frontier;
+
+    /** forget all state related to the current particle */
+    void reset() {
+      history.reset();
+      dist_limit = 0;
+      frontier.reset();
+    }
+  };
+
   ErrorCode ray_fire(const EntityHandle volume, const double ray_start[3],
                      const double ray_dir[3], EntityHandle& next_surf,
                      double& next_surf_dist, RayHistory* history = NULL,
                      double dist_limit = 0, int ray_orientation = 1,
                      OrientedBoxTreeTool::TrvStats* stats = NULL);
 
+  /**\brief Fire a batch of rays stored in structure-of-arrays form
+   *
+   * Equivalent to calling ray_fire() once per ray. The rays are grouped by
+   * volume and, within a volume, by the octant of their direction. With a
+   * flat BVH the volume index and traversal settings are looked up once per
+   * volume and its rays are traversed in packets of up to
+   * FlatBVH::MAX_PACKET (see FlatBVH::ray_fire_packet()), each node being
+   * visited once for the packet rather than once per ray; with query
+   * statistics enabled a packet is recorded as one call per ray. Without a
+   * flat BVH the rays are fired one at a time in that order.
+   *
+   *\param num_rays number of rays in the batch
+   *\param volumes volume handle for each ray
+   *\param ray_starts x, y and z arrays of ray origins
+   *\param ray_dirs x, y and z arrays of (unit) ray directions
+   *\param next_surfs output, the surface hit by each ray (0 if none)
+   *\param next_surf_dists output, the distance to next_surfs for each ray
+   *\param histories optional array of num_rays ray histories
+   *\param dist_limits optional array of num_rays distance limits
+   *\param ray_orientation as in ray_fire(), applied to every ray
+   */
+  ErrorCode ray_fire_batch(size_t num_rays, const EntityHandle* volumes,
+                           const double* const ray_starts[3],
+                           const double* const ray_dirs[3],
+                           EntityHandle* next_surfs, double* next_surf_dists,
+                           RayHistory* histories = NULL,
+                           const double* dist_limits = NULL,
+                           int ray_orientation = 1);
+
   ErrorCode point_in_volume(const EntityHandle volume, const double xyz[3],
                             int& result, const double* uvw = NULL,
                             const RayHistory* history = NULL);
@@ -229,6 +615,53 @@ class DagMC {
                         const double* uvw = NULL);
 #endif
 
+  /**\brief Find every volume containing a point
+   *
+   * Tests all the volumes other than the implicit complement whose boxes
+   * contain the point, using the top-level tree if it has been built; more
+   * than one volume is found where volumes overlap.
+   */
+  ErrorCode find_volumes(const double xyz[3],
+                         std::vector<EntityHandle>& volumes,
+                         const double* uvw = NULL);
+
+  /** Thread-safe variants of the queries above using per-thread state */
+  ErrorCode ray_fire(QueryContext& context, const EntityHandle volume,
+                     const double ray_start[3], const double ray_dir[3],
+                     EntityHandle& next_surf, double& next_surf_dist,
+                     int ray_orientation = 1);
+
+  ErrorCode point_in_volume(QueryContext& context, const EntityHandle volume,
+                            const double xyz[3], int& result,
+                            const double* uvw = NULL);
+
+  /**\brief Index based variants of the queries
+   *
+   * Volumes and surfaces are given and returned by their base-1 index
+   * instead of their handle. With a flat BVH the queries work on the indices
+   * directly, without translating to and from handles.
+   */
+  ErrorCode ray_fire_idx(int vol_idx, const double ray_start[3],
+                         const double ray_dir[3], int& next_surf_idx,
+                         double& next_surf_dist, RayHistory* history = NULL,
+                         double dist_limit = 0, int ray_orientation = 1,
+                         OrientedBoxTreeTool::TrvStats* stats = NULL);
+
+  /** ray_fire_idx() with the state of a QueryContext */
+  ErrorCode ray_fire_idx(QueryContext& context, int vol_idx,
+                         const double ray_start[3], const double ray_dir[3],
+                         int& next_surf_idx, double& next_surf_dist,
+                         int ray_orientation = 1);
+
+  ErrorCode point_in_volume_idx(int vol_idx, const double xyz[3], int& result,
+                                const double* uvw = NULL,
+                                const RayHistory* history = NULL);
+
+  ErrorCode surface_sense_idx(int vol_idx, int surf_idx, int& sense_out);
+
+  ErrorCode get_angle_idx(int surf_idx, const double xyz[3], double angle[3],
+                          const RayHistory* history = NULL);
+
   ErrorCode test_volume_boundary(const EntityHandle volume,
                                  const EntityHandle surface,
                                  const double xyz[3], const double uvw[3],
@@ -237,22 +670,223 @@ class DagMC {
   ErrorCode closest_to_location(EntityHandle volume, const double point[3],
                                 double& result, EntityHandle* surface = 0);
 
+  /**\brief Conservative distance from a point to the boundary of a volume
+   *
+   * Safety distance for particle steps. If the volume has a distance cache
+   * and it bounds the distance by more than min_distance, the bound is
+   * returned without searching the facets; otherwise the exact distance
+   * from closest_to_location() is returned.
+   *
+   *\param min_distance smallest bound that is useful to the caller
+   */
+  ErrorCode safety_distance(EntityHandle volume, const double point[3],
+                            double& result, double min_distance = 0);
+
+  /**\brief Build the distance cache of a volume used by safety_distance()
+   *
+   * Covers the bounding box of the volume, with a margin of half its size
+   * for points outside the volume, by an octree refined towards the surfaces
+   * (see DistanceCache); every node costs one closest_to_location() call.
+   * The caches are rebuilt when the indices are.
+   *
+   *\param max_depth number of times the box is halved near the surfaces
+   */
+  ErrorCode build_distance_cache(EntityHandle volume, int max_depth = 5);
+
+  /** Discard the distance caches of all volumes */
+  void clear_distance_caches() { distanceCaches.clear(); }
+
+  /**\brief Placement of a prototype volume by a rigid transform
+   *
+   * A world point x lies at rotation^T (x - translation) in the prototype's
+   * own coordinates. Instances share the triangles and acceleration
+   * structures of their prototype; only the transform is stored.
+   */
+  struct Instance {
+    EntityHandle prototype;
+    /** row major rotation matrix */
+    double rotation[9];
+    double translation[3];
+
+    /** transform a world point into the prototype's coordinates */
+    void to_local(const double world[3], double local[3]) const {
+      double offset[3] = {world[0] - translation[0], world[1] - translation[1],
+                          world[2] - translation[2]};
+      rotate_back(offset, local);
+    }
+
+    /** rotate a world direction into the prototype's coordinates */
+    void rotate_back(const double world[3], double local[3]) const {
+      for (int c = 0; c < 3; c++)
+        local[c] = rotation[c] * world[0] + rotation[3 + c] * world[1] +
+                   rotation[6 + c] * world[2];
+    }
+
+    /** rotate a direction of the prototype into world coordinates */
+    void rotate(const double local[3], double world[3]) const {
+      for (int r = 0; r < 3; r++)
+        world[r] = rotation[3 * r] * local[0] +
+                   rotation[3 * r + 1] * local[1] +
+                   rotation[3 * r + 2] * local[2];
+    }
+  };
+
+  /**\brief Place a copy of a volume
+   *
+   * The prototype is an ordinary volume of the model; the instance is
+   * queried with the *_instance() functions below, which transform points
+   * and directions into the prototype's coordinates. Distances are
+   * unchanged by a rigid transform and surfaces and facets are reported as
+   * those of the prototype, so a particle tracked through an instance must
+   * keep track of the instance it is in.
+   *
+   *\param rotation row major rotation matrix, must be orthonormal
+   *\param instance output, index of the new instance
+   */
+  ErrorCode add_instance(EntityHandle prototype, const double rotation[9],
+                         const double translation[3], int& instance);
+
+  /**\brief Place copies of a volume on a regular lattice
+   *
+   * Adds counts[0] * counts[1] * counts[2] unrotated instances, the one in
+   * lattice cell (i, j, k) translated by origin + (i, j, k) * pitch, x
+   * fastest. Points are assigned to the instances of a lattice without any
+   * search with find_lattice_instance().
+   *
+   *\param lattice output, index of the new lattice
+   */
+  ErrorCode add_lattice(EntityHandle prototype, const double origin[3],
+                        const double pitch[3], const int counts[3],
+                        int& lattice);
+
+  /**\brief Instance of a lattice whose cell contains a point
+   *
+   * Cell (i, j, k) spans origin + (i - 1/2, j - 1/2, k - 1/2) * pitch to
+   * origin + (i + 1/2, j + 1/2, k + 1/2) * pitch, the cells being centered
+   * on the translations of their instances.
+   *
+   *\return index of the instance, -1 if the point is outside the lattice
+   */
+  int find_lattice_instance(int lattice, const double xyz[3]) const;
+
+  /** Number of instances placed */
+  int num_instances() const { return instances.size(); }
+
+  /** The placement of an instance */
+  const Instance& instance(int instance) const { return instances[instance]; }
+
+  /** Discard all instances and lattices */
+  void clear_instances() {
+    instances.clear();
+    lattices.clear();
+    instance_tree.reset();
+  }
+
+  /** ray_fire() in an instance, next_surf is a surface of the prototype */
+  ErrorCode ray_fire_instance(int instance, const double ray_start[3],
+                              const double ray_dir[3], EntityHandle& next_surf,
+                              double& next_surf_dist,
+                              RayHistory* history = NULL,
+                              double dist_limit = 0, int ray_orientation = 1);
+
+  /** point_in_volume() for an instance */
+  ErrorCode point_in_instance(int instance, const double xyz[3], int& result,
+                              const double* uvw = NULL,
+                              const RayHistory* history = NULL);
+
+  /** closest_to_location() for an instance */
+  ErrorCode closest_to_location_instance(int instance, const double point[3],
+                                         double& result,
+                                         EntityHandle* surface = 0);
+
+  /** get_angle() at a point of a prototype surface in an instance, the
+   *  normal is returned in world coordinates */
+  ErrorCode get_angle_instance(int instance, EntityHandle surf,
+                               const double xyz[3], double angle[3],
+                               const RayHistory* history = NULL);
+
+  /** Bounding box of an instance in world coordinates */
+  ErrorCode get_instance_box(int instance, double lower[3], double upper[3]);
+
+  /**\brief Find the instance containing a point
+   *
+   *\param instance output, index of the instance, -1 if none
+   */
+  ErrorCode find_instance(const double xyz[3], int& instance,
+                          const double* uvw = NULL);
+
+  /**\brief Find the nearest instance a ray enters
+   *
+   * For rays starting outside every instance, e.g. in the implicit
+   * complement around them; the result is compared with that of ray_fire()
+   * in the enclosing volume.
+   *
+   *\param instance output, index of the instance entered, -1 if none
+   *\param next_surf output, the prototype surface through which it enters
+   *\param dist_limit only look for entrances up to this distance if > 0
+   */
+  ErrorCode ray_fire_instances(const double ray_start[3],
+                               const double ray_dir[3], int& instance,
+                               EntityHandle& next_surf, double& next_surf_dist,
+                               double dist_limit = 0);
+
   ErrorCode measure_volume(EntityHandle volume, double& result);
 
   ErrorCode measure_area(EntityHandle surface, double& result);
 
+  /**\brief Measure every volume and surface
+   *
+   * The triangles of the surfaces are summed on build_threads() threads with
+   * compensated sums, and each volume from the surfaces on either side of
+   * it. The measures of a surface are kept in the DAGMC_MEASURE tag with a
+   * hash of its triangle coordinates, so they are saved with the model and
+   * reused when it is loaded again unless the surface was refaceted or moved.
+   *
+   *\param volumes, areas output, measures by DAGMC index, entry 0 unused
+   *\param use_cache reuse the tagged measures of surfaces
+   */
+  ErrorCode measure_all(std::vector<double>& volumes,
+                        std::vector<double>& areas, bool use_cache = true);
+
+  /**\brief Sense of surfaces with respect to a volume
+   *
+   * 1 for forward, -1 for reverse and 0 if the volume is on both sides.
+   * Indexed entities are looked up in the table built with the indices,
+   * others are queried from GeomTopoTool.
+   */
   ErrorCode surface_sense(EntityHandle volume, int num_surfaces,
                           const EntityHandle* surfaces, int* senses_out);
 
   ErrorCode surface_sense(EntityHandle volume, EntityHandle surface,
                           int& sense_out);
 
+ private:
+  /** surface_sense() for a volume whose table index has been looked up */
+  ErrorCode surface_sense(EntityHandle volume, int vol_idx,
+                          EntityHandle surface, int& sense_out);
+
+ public:
+
   ErrorCode get_angle(EntityHandle surf, const double xyz[3], double angle[3],
                       const RayHistory* history = NULL);
 
+  /**\brief Find the volume on the other side of a surface
+   *
+   * Looks the volume up in the table built with the indices, falling back to
+   * the topology of the model for entities without an index.
+   */
   ErrorCode next_vol(EntityHandle surface, EntityHandle old_volume,
                      EntityHandle& new_volume);
 
+  /**\brief Index based next_vol()
+   *
+   *\param surf_idx base-1 index of the surface crossed
+   *\param old_vol_idx base-1 index of the volume left
+   *\return index of the volume entered, 0 if old_vol_idx is not on either
+   *        side of the surface
+   */
+  int next_vol_idx(int surf_idx, int old_vol_idx) const;
+
   /* SECTION III: Indexing & Cross-referencing */
  public:
   /** Most calling apps refer to geometric entities with a combination of
@@ -290,6 +924,21 @@ class DagMC {
   /** build internal index vectors that speed up handle-by-id, etc. */
   ErrorCode build_indices(Range& surfs, Range& vols);
 
+  /** index of a surface or volume in the surface side table, 0 if the
+   *  entity is not indexed */
+  int table_index(int dimension, EntityHandle handle) const;
+
+  /** find_volumes(), stopping at the first volume found if first_only */
+  ErrorCode find_volumes(const double xyz[3],
+                         std::vector<EntityHandle>& volumes, const double* uvw,
+                         bool first_only);
+
+  /** bounding box of a volume, from the flat BVH if there is one */
+  ErrorCode volume_box(int vol_idx, double lower[3], double upper[3]);
+
+  /** build the implicit complement tree of a newly built flat BVH */
+  ErrorCode setup_complement(FlatBVH& bvh);
+
   /* SECTION IV: Handling DagMC settings */
  public:
   /** retrieve overlap thickness */
@@ -491,6 +1140,53 @@ class DagMC {
 #endif
 
   std::unique_ptr<RayTracer> ray_tracer;
+  // optional flattened BVH used for ray_fire and point_in_volume
+  std::unique_ptr<FlatBVH> flat_bvh;
+  // optional grid used by find_volume
+  std::unique_ptr<PointLocator> point_locator;
+  // optional top-level trees over the volumes and instances
+  std::unique_ptr<VolumeTree> volume_tree;
+  std::unique_ptr<VolumeTree> instance_tree;
+  // optional distance caches by volume index, used by safety_distance
+  std::vector<std::unique_ptr<DistanceCache>> distanceCaches;
+  // placed copies of prototype volumes
+  std::vector<Instance> instances;
+  // lattices of instances, see add_lattice
+  struct Lattice {
+    double origin[3];
+    double pitch[3];
+    int counts[3];
+    int first;
+  };
+  std::vector<Lattice> lattices;
+  // number of threads used to build the acceleration structure
+  int buildThreads = 1;
+  // store the flat BVH in single precision
+  bool singlePrecision = false;
+  // decide point_in_volume with winding numbers
+  bool windingNumbers = false;
+  // flat BVH cache file, empty if disabled
+  std::string bvhCacheFile;
+  // shared memory segment of the flat BVH, empty if disabled, how long to
+  // wait for another process to write it and whether this one did
+  std::string bvhSharedName;
+  double bvhSharedTimeout = 300.0;
+  bool bvhSharedOwner = false;
+  // reader options of load_file and whether it reads only the geometry
+  std::string loadOptions;
+  bool loadGeometryOnly = false;
+  // per-volume query statistics, NULL unless enabled
+  std::unique_ptr<QueryStats> queryStats;
+  // file the query statistics are written to on destruction
+  std::string queryStatsFile;
+  // particles lost by the queries, see recover_lost_particle()
+  LostParticles lostParticles;
+  // file and cluster radius of the lost particle report
+  std::string lostParticleFile;
+  double lostClusterRadius = 1.0;
+  // true while the OBB trees are left to be built on first use
+  std::atomic<bool> obbsDeferred{false};
+  std::mutex obbMutex;
 
  public:
   Tag nameTag, facetingTolTag;
@@ -500,6 +1196,9 @@ class DagMC {
   std::vector<EntityHandle> entHandles[5];
   /** surface and volume mapping from EntitiyHandle to DAGMC index */
   std::unordered_map<EntityHandle, int> entIndices;
+  /** volume index on the forward (2 * i) and reverse (2 * i + 1) side of
+   *  the surface with index i */
+  std::vector<int> surfVols;
   /** corresponding geometric entities; also indexed like rootSets */
   std::vector<RefEntity*> geomEntities;
 
@@ -514,11 +1213,6 @@ class DagMC {
 
   double facetingTolerance;
 
-  /** vectors for point_in_volume: */
-  std::vector<double> disList;
-  std::vector<int> dirList;
-  std::vector<EntityHandle> surList, facList;
-
   /** logger **/
   DagMC_Logger logger;
 
@@ -572,13 +1266,24 @@ inline int DagMC::index_by_handle(EntityHandle handle) const {
   return entIndices.at(handle);
 }
 
+inline int DagMC::next_vol_idx(int surf_idx, int old_vol_idx) const {
+  assert(0 < surf_idx && 2 * (size_t)surf_idx < surfVols.size() &&
+         0 < old_vol_idx);
+  const int* sides = &surfVols[2 * surf_idx];
+  if (sides[0] == old_vol_idx) return sides[1];
+  if (sides[1] == old_vol_idx) return sides[0];
+  return 0;
+}
+
 inline unsigned int DagMC::num_entities(int dimension) const {
   assert(vertex_handle_idx <= dimension && groups_handle_idx >= dimension);
   return entHandles[dimension].size() - 1;
 }
 
 inline ErrorCode DagMC::get_root(EntityHandle vol_or_surf, EntityHandle& root) {
-  ErrorCode rval = GTT->get_root(vol_or_surf, root);
+  ErrorCode rval = build_deferred_obbs();
+  MB_CHK_SET_ERR(rval, "Failed to build the OBB trees");
+  rval = GTT->get_root(vol_or_surf, root);
   MB_CHK_SET_ERR(rval, "Failed to get obb root set of volume or surface");
   return MB_SUCCESS;
 }
@@ -0,0 +1,77 @@
+#include "DistanceCache.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace moab {
+
+ErrorCode DistanceCache::build(const double lower[3], const double upper[3],
+                               int max_depth, const DistanceFunc& distance) {
+  nodes.clear();
+  maxDepth = max_depth;
+
+  Node root;
+  rootHalf = 0.0;
+  for (int d = 0; d < 3; d++) {
+    root.center[d] = 0.5 * (lower[d] + upper[d]);
+    rootHalf = std::max(rootHalf, 0.5 * (upper[d] - lower[d]));
+  }
+  root.children = 0;
+  ErrorCode rval = distance(root.center, root.dist);
+  if (MB_SUCCESS != rval) return rval;
+  nodes.push_back(root);
+
+  return subdivide(0, rootHalf, 0, distance);
+}
+
+ErrorCode DistanceCache::subdivide(int node_idx, double half, int depth,
+                                   const DistanceFunc& distance) {
+  // stop where every point of the node has a bound of at least the
+  // half diagonal
+  double half_diagonal = std::sqrt(3.0) * half;
+  if (depth >= maxDepth || nodes[node_idx].dist >= 2.0 * half_diagonal)
+    return MB_SUCCESS;
+
+  int first = nodes.size();
+  nodes[node_idx].children = first;
+  double quarter = 0.5 * half;
+  for (int octant = 0; octant < 8; octant++) {
+    Node child;
+    for (int d = 0; d < 3; d++)
+      child.center[d] = nodes[node_idx].center[d] +
+                        ((octant >> d) & 1 ? quarter : -quarter);
+    child.children = 0;
+    ErrorCode rval = distance(child.center, child.dist);
+    if (MB_SUCCESS != rval) return rval;
+    nodes.push_back(child);
+  }
+
+  for (int octant = 0; octant < 8; octant++) {
+    ErrorCode rval = subdivide(first + octant, quarter, depth + 1, distance);
+    if (MB_SUCCESS != rval) return rval;
+  }
+  return MB_SUCCESS;
+}
+
+double DistanceCache::lower_bound(const double point[3]) const {
+  if (nodes.empty()) return 0.0;
+
+  // the bound of every node on the path holds, keep the best
+  double best = 0.0;
+  int node_idx = 0;
+  while (true) {
+    const Node& node = nodes[node_idx];
+    double offset[3] = {point[0] - node.center[0], point[1] - node.center[1],
+                        point[2] - node.center[2]};
+    double dist = std::sqrt(offset[0] * offset[0] + offset[1] * offset[1] +
+                            offset[2] * offset[2]);
+    best = std::max(best, node.dist - dist);
+    if (!node.children) break;
+    int octant = (offset[0] >= 0.0 ? 1 : 0) | (offset[1] >= 0.0 ? 2 : 0) |
+                 (offset[2] >= 0.0 ? 4 : 0);
+    node_idx = node.children + octant;
+  }
+  return best;
+}
+
+}  // namespace moab
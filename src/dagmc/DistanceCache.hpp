@@ -0,0 +1,68 @@
+#ifndef DAGMC_DISTANCECACHE_HPP
+#define DAGMC_DISTANCECACHE_HPP
+
+#include <functional>
+#include <vector>
+
+#include "moab/Types.hpp"
+
+namespace moab {
+
+/**\brief Octree of lower bounds on the distance to the boundary of a volume
+ *
+ * Each node stores the distance from its center to the boundary, found with
+ * an exact nearest facet search when the tree is built. The distance to the
+ * boundary changes no faster than the position, so for any point p and node
+ * center c with distance d, d - |p - c| is a lower bound on the distance from
+ * p. Nodes are only subdivided where the boundary is close compared to their
+ * size, so the tree is refined in a narrow band around the surfaces and the
+ * bound from the deepest node containing a point is tight away from them.
+ *
+ * Queries only read the tree and are safe to call concurrently.
+ */
+class DistanceCache {
+ public:
+  /** exact distance from a point to the boundary */
+  typedef std::function<ErrorCode(const double[3], double&)> DistanceFunc;
+
+  /**\brief Build the tree over a box
+   *
+   *\param lower, upper the box covered by the root node; it is made cubic
+   *\param max_depth depth of the smallest nodes
+   *\param distance the exact distance to the boundary, called once per node
+   */
+  ErrorCode build(const double lower[3], const double upper[3], int max_depth,
+                  const DistanceFunc& distance);
+
+  /** lower bound on the distance from a point to the boundary, 0 if no
+   *  useful bound is known; points outside the root box are bounded by it */
+  double lower_bound(const double point[3]) const;
+
+  /** the max_depth the tree was built with */
+  int max_depth() const { return maxDepth; }
+
+  /** number of nodes in the tree */
+  size_t num_nodes() const { return nodes.size(); }
+
+ private:
+  struct Node {
+    double center[3];
+    /** distance from the center to the boundary */
+    double dist;
+    /** first of eight adjacent children, 0 for a leaf */
+    int children;
+  };
+
+  /** subdivide node node_idx of half width half and those below it */
+  ErrorCode subdivide(int node_idx, double half, int depth,
+                      const DistanceFunc& distance);
+
+  int maxDepth = 0;
+  /** half width of the root node */
+  double rootHalf = 0;
+  std::vector<Node> nodes;
+};
+
+}  // namespace moab
+
+#endif
@@ -0,0 +1,2078 @@
+#include "FlatBVH.hpp"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <thread>
+#include <utility>
+
+#include "moab/CartVect.hpp"
+#include "util.hpp"
+
+#ifndef M_PI /* windows */
+#define M_PI 3.14159265358979323846
+#endif
+
+namespace moab {
+
+const int32_t FlatBVH::LINK;
+const int FlatBVH::MAX_DEPTH;
+const int FlatBVH::MAX_LEAF;
+const int FlatBVH::MAX_FRONTIER;
+const int FlatBVH::MAX_PACKET;
+const int FlatBVH::Frontier::NUM_SLOTS;
+
+static const double INFTY = std::numeric_limits<double>::max();
+
+using RayTriKernel::BLOCK;
+using RayTriKernel::BLOCK_SIZE;
+using dagmc_util::hash_bytes;
+using dagmc_util::parallel_for;
+
+// a new value of FlatBVH::buildId
+static uint64_t next_build_id() {
+  static std::atomic<uint64_t> counter(0);
+  return ++counter;
+}
+
+// box that no ray enters and that does not grow a union
+static void empty_box(FlatBVH::Node& node) {
+  std::fill(node.lower, node.lower + 3, INFTY);
+  std::fill(node.upper, node.upper + 3, -INFTY);
+}
+
+static void grow_box(FlatBVH::Node& node, const FlatBVH::Node& other) {
+  for (int d = 0; d < 3; d++) {
+    node.lower[d] = std::min(node.lower[d], other.lower[d]);
+    node.upper[d] = std::max(node.upper[d], other.upper[d]);
+  }
+}
+
+// Build a median split tree over items [begin, end) into nodes[node_idx].
+// bound(item, box) grows box by an item, centroid(item, d) returns the
+// (scaled) centroid of an item along axis d and make_leaf(node, begin, end)
+// fills in a leaf. The first child of a split holds a multiple of align items.
+template <typename Bound, typename Centroid, typename MakeLeaf>
+static void build_subtree(std::vector<int32_t>& items, int begin, int end,
+                          std::vector<FlatBVH::Node>& nodes, int node_idx,
+                          int depth, int leaf_size, int align, Bound bound,
+                          Centroid centroid, MakeLeaf make_leaf) {
+  FlatBVH::Node& node = nodes[node_idx];
+  empty_box(node);
+  for (int i = begin; i < end; i++) bound(items[i], node);
+
+  if (end - begin <= leaf_size || depth >= FlatBVH::MAX_DEPTH) {
+    make_leaf(node, begin, end);
+    return;
+  }
+
+  // split along the longest axis of the centroid bounds
+  double lower[3] = {INFTY, INFTY, INFTY};
+  double upper[3] = {-INFTY, -INFTY, -INFTY};
+  for (int i = begin; i < end; i++) {
+    for (int d = 0; d < 3; d++) {
+      lower[d] = std::min(lower[d], centroid(items[i], d));
+      upper[d] = std::max(upper[d], centroid(items[i], d));
+    }
+  }
+  int axis = 0;
+  for (int d = 1; d < 3; d++)
+    if (upper[d] - lower[d] > upper[axis] - lower[axis]) axis = d;
+
+  int mid = begin + ((end - begin) / 2 + align - 1) / align * align;
+  std::nth_element(items.begin() + begin, items.begin() + mid,
+                   items.begin() + end, [&](int32_t a, int32_t b) {
+                     return centroid(a, axis) < centroid(b, axis);
+                   });
+
+  int first = nodes.size();
+  nodes[node_idx].first = first;
+  nodes[node_idx].count = 0;
+  nodes.resize(first + 2);
+  build_subtree(items, begin, mid, nodes, first, depth + 1, leaf_size, align,
+                bound, centroid, make_leaf);
+  build_subtree(items, mid, end, nodes, first + 1, depth + 1, leaf_size, align,
+                bound, centroid, make_leaf);
+}
+
+// append a tree to nodes, offsetting the references to its own interior nodes
+static int32_t append_tree(std::vector<FlatBVH::Node>& nodes,
+                           std::vector<FlatBVH::Node>& tree) {
+  int32_t base = nodes.size();
+  for (auto& node : tree) {
+    if (0 == node.count) node.first += base;
+    nodes.push_back(node);
+  }
+  tree.clear();
+  tree.shrink_to_fit();
+  return base;
+}
+
+// round to a float no larger than x
+static float round_down(double x) {
+  if (x > FLT_MAX) return FLT_MAX;
+  if (x < -FLT_MAX) return -std::numeric_limits<float>::infinity();
+  float f = x;
+  return f > x ? std::nextafter(f, -FLT_MAX) : f;
+}
+
+// round to a float no smaller than x
+static float round_up(double x) {
+  if (x > FLT_MAX) return std::numeric_limits<float>::infinity();
+  if (x < -FLT_MAX) return -FLT_MAX;
+  float f = x;
+  return f < x ? std::nextafter(f, FLT_MAX) : f;
+}
+
+void FlatBVH::clear() {
+  nodes.clear();
+  floatNodes.clear();
+  triCoords.clear();
+  floatCoords.clear();
+  blockAnchors.clear();
+  triEdges.clear();
+  triHandles.clear();
+  triSurfs.clear();
+  surfRoots.clear();
+  volRoots.clear();
+  surfForward.clear();
+  surfReverse.clear();
+  surfRootIdx.clear();
+  windingNodes.clear();
+  complementIdx = 0;
+  complementBegin.clear();
+  complementSurfs.clear();
+  complementTree.clear();
+  data = View();
+  mapping.reset();
+}
+
+void FlatBVH::bind() {
+  buildId = next_build_id();
+  data.single = !floatNodes.empty();
+  data.nodes = nodes.data();
+  data.floatNodes = floatNodes.data();
+  data.triCoords = triCoords.data();
+  data.floatCoords = floatCoords.data();
+  data.blockAnchors = blockAnchors.data();
+  data.triEdges = triEdges.data();
+  data.triHandles = triHandles.data();
+  data.triSurfs = triSurfs.data();
+  data.surfRoots = surfRoots.data();
+  data.volRoots = volRoots.data();
+  data.surfForward = surfForward.data();
+  data.surfReverse = surfReverse.data();
+  data.numNodes = data.single ? floatNodes.size() : nodes.size();
+  data.numTris = triHandles.size();
+  data.numSurfs = surfRoots.size();
+  data.numVols = volRoots.size();
+}
+
+ErrorCode FlatBVH::init_topology(GeomTopoTool* gtt,
+                                 const std::vector<EntityHandle>& surfs,
+                                 const std::vector<EntityHandle>& vols) {
+  clear();
+  mbi = gtt->get_moab_instance();
+
+  std::unordered_map<EntityHandle, int> vol_indices;
+  for (size_t i = 1; i < vols.size(); i++) vol_indices[vols[i]] = i;
+
+  surfRoots.assign(surfs.size(), -1);
+  volRoots.assign(vols.size(), -1);
+  surfForward.assign(surfs.size(), 0);
+  surfReverse.assign(surfs.size(), 0);
+
+  for (size_t i = 1; i < surfs.size(); i++) {
+    EntityHandle forward = 0, reverse = 0;
+    ErrorCode rval = gtt->get_surface_senses(surfs[i], forward, reverse);
+    MB_CHK_SET_ERR(rval, "Failed to get the senses of surface " << i);
+    auto it = vol_indices.find(forward);
+    if (it != vol_indices.end()) surfForward[i] = it->second;
+    it = vol_indices.find(reverse);
+    if (it != vol_indices.end()) surfReverse[i] = it->second;
+  }
+  return MB_SUCCESS;
+}
+
+ErrorCode FlatBVH::build(GeomTopoTool* gtt,
+                         const std::vector<EntityHandle>& surfs,
+                         const std::vector<EntityHandle>& vols) {
+  ErrorCode rval = init_topology(gtt, surfs, vols);
+  MB_CHK_SET_ERR(rval, "Failed to get the model topology");
+
+  // locate the surface tree roots
+  std::vector<EntityHandle> surf_tree_roots(surfs.size(), 0);
+  for (size_t i = 1; i < surfs.size(); i++) {
+    rval = gtt->get_root(surfs[i], surf_tree_roots[i]);
+    MB_CHK_SET_ERR(rval, "Failed to get the OBB tree root of surface " << i);
+    surfRootIdx[surf_tree_roots[i]] = i;
+  }
+
+  // flatten each surface tree once
+  for (size_t i = 1; i < surfs.size(); i++) {
+    surfRoots[i] = nodes.size();
+    nodes.emplace_back();
+    rval = flatten(surf_tree_roots[i], surfRoots[i], i, 0);
+    MB_CHK_SET_ERR(rval, "Failed to flatten the tree of surface " << i);
+  }
+
+  // volume trees end in links to the surface trees
+  for (size_t i = 1; i < vols.size(); i++) {
+    EntityHandle root;
+    rval = gtt->get_root(vols[i], root);
+    MB_CHK_SET_ERR(rval, "Failed to get the OBB tree root of volume " << i);
+    volRoots[i] = nodes.size();
+    nodes.emplace_back();
+    rval = flatten(root, volRoots[i], 0, 0);
+    MB_CHK_SET_ERR(rval, "Failed to flatten the tree of volume " << i);
+  }
+  pad_triangles();
+
+  surfRootIdx.clear();
+  if (singlePrecision) to_single();
+  bind();
+  return windingNumbers ? build_winding_data() : MB_SUCCESS;
+}
+
+ErrorCode FlatBVH::construct(GeomTopoTool* gtt,
+                             const std::vector<EntityHandle>& surfs,
+                             const std::vector<EntityHandle>& vols,
+                             int num_threads) {
+  ErrorCode rval = init_topology(gtt, surfs, vols);
+  MB_CHK_SET_ERR(rval, "Failed to get the model topology");
+
+  // read the triangles of every surface, in surface order
+  std::vector<double> coords;
+  std::vector<EntityHandle> handles;
+  std::vector<int32_t> surf_begin(surfs.size() + 1, 0);
+  for (size_t i = 1; i < surfs.size(); i++) {
+    surf_begin[i] = handles.size();
+    std::vector<EntityHandle> tris;
+    rval = mbi->get_entities_by_type(surfs[i], MBTRI, tris);
+    MB_CHK_SET_ERR(rval, "Failed to get the triangles of surface " << i);
+    rval = read_triangles(tris, coords);
+    MB_CHK_SET_ERR(rval, "Failed to read the triangles of surface " << i);
+    handles.insert(handles.end(), tris.begin(), tris.end());
+  }
+  surf_begin[surfs.size()] = handles.size();
+
+  // the surfaces of each volume
+  std::unordered_map<EntityHandle, int> surf_indices;
+  for (size_t i = 1; i < surfs.size(); i++) surf_indices[surfs[i]] = i;
+  std::vector<std::vector<int32_t>> vol_surfs(vols.size());
+  for (size_t i = 1; i < vols.size(); i++) {
+    std::vector<EntityHandle> children;
+    rval = mbi->get_child_meshsets(vols[i], children);
+    MB_CHK_SET_ERR(rval, "Failed to get the surfaces of volume " << i);
+    for (auto child : children) {
+      auto it = surf_indices.find(child);
+      if (it != surf_indices.end()) vol_surfs[i].push_back(it->second);
+    }
+  }
+
+  build_surface_trees(coords, handles, surf_begin, num_threads);
+
+  // build the volume trees over the boxes of their surfaces
+  std::vector<std::vector<Node>> subtrees(vols.size());
+  parallel_for(vols.size() - 1, num_threads, [&](int task) {
+    int i = task + 1;
+    auto surf_bound = [&](int32_t s, Node& box) {
+      grow_box(box, nodes[surfRoots[s]]);
+    };
+    auto surf_centroid = [&](int32_t s, int d) {
+      return nodes[surfRoots[s]].lower[d] + nodes[surfRoots[s]].upper[d];
+    };
+    auto surf_leaf = [&](Node& node, int begin, int end) {
+      // a single surface per leaf, linked to its tree
+      if (end > begin) {
+        node.first = surfRoots[vol_surfs[i][begin]];
+        node.count = LINK;
+      } else {
+        node.first = 0;
+        node.count = EMPTY;
+      }
+    };
+    std::vector<Node>& tree = subtrees[i];
+    tree.resize(1);
+    build_subtree(vol_surfs[i], 0, vol_surfs[i].size(), tree, 0, 0, 1, 1,
+                  surf_bound, surf_centroid, surf_leaf);
+  });
+  for (size_t i = 1; i < vols.size(); i++)
+    volRoots[i] = append_tree(nodes, subtrees[i]);
+
+  if (singlePrecision) to_single();
+  bind();
+  return windingNumbers ? build_winding_data() : MB_SUCCESS;
+}
+
+ErrorCode FlatBVH::construct(Interface* moab, const Range& triangles) {
+  clear();
+  mbi = moab;
+  surfRoots.assign(2, -1);
+  volRoots.assign(1, -1);
+  surfForward.assign(2, 0);
+  surfReverse.assign(2, 0);
+
+  std::vector<EntityHandle> handles(triangles.begin(), triangles.end());
+  std::vector<double> coords;
+  ErrorCode rval = read_triangles(handles, coords);
+  MB_CHK_SET_ERR(rval, "Failed to read the triangles");
+
+  std::vector<int32_t> surf_begin = {0, 0, (int32_t)handles.size()};
+  build_surface_trees(coords, handles, surf_begin, 1);
+
+  if (singlePrecision) to_single();
+  bind();
+  return MB_SUCCESS;
+}
+
+ErrorCode FlatBVH::read_triangles(const std::vector<EntityHandle>& tris,
+                                  std::vector<double>& coords) {
+  for (auto tri : tris) {
+    const EntityHandle* conn;
+    int len;
+    ErrorCode rval = mbi->get_connectivity(tri, conn, len, true);
+    MB_CHK_SET_ERR(rval, "Failed to get triangle connectivity");
+    double tri_coords[9];
+    rval = mbi->get_coords(conn, 3, tri_coords);
+    MB_CHK_SET_ERR(rval, "Failed to get triangle coordinates");
+    coords.insert(coords.end(), tri_coords, tri_coords + 9);
+  }
+  return MB_SUCCESS;
+}
+
+void FlatBVH::build_surface_trees(const std::vector<double>& coords,
+                                  const std::vector<EntityHandle>& handles,
+                                  const std::vector<int32_t>& surf_begin,
+                                  int num_threads) {
+  const int num_surfs = surf_begin.size() - 1;
+
+  // each surface starts on a new block and the first child of each split
+  // holds whole blocks, so every leaf starts on a block boundary
+  std::vector<int32_t> slot_begin(num_surfs + 1, 0);
+  for (int i = 1; i < num_surfs; i++) {
+    int num_tris = surf_begin[i + 1] - surf_begin[i];
+    slot_begin[i + 1] = slot_begin[i] + (num_tris + BLOCK - 1) / BLOCK * BLOCK;
+  }
+
+  // build the surface trees independently, each over its own triangle range
+  std::vector<std::vector<Node>> subtrees(num_surfs);
+  std::vector<int32_t> order(handles.size());
+  for (size_t t = 0; t < order.size(); t++) order[t] = t;
+
+  parallel_for(num_surfs - 1, num_threads, [&](int task) {
+    int i = task + 1;
+    auto tri_bound = [&](int32_t t, Node& box) {
+      const double* c = &coords[9 * t];
+      for (int v = 0; v < 9; v++) {
+        box.lower[v % 3] = std::min(box.lower[v % 3], c[v]);
+        box.upper[v % 3] = std::max(box.upper[v % 3], c[v]);
+      }
+    };
+    auto tri_centroid = [&](int32_t t, int d) {
+      const double* c = &coords[9 * t];
+      return c[d] + c[d + 3] + c[d + 6];
+    };
+    auto tri_leaf = [&](Node& node, int begin, int end) {
+      node.first = slot_begin[i] + begin - surf_begin[i];
+      node.count = end > begin ? end - begin : EMPTY;
+    };
+    std::vector<Node>& tree = subtrees[i];
+    tree.resize(1);
+    build_subtree(order, surf_begin[i], surf_begin[i + 1], tree, 0, 0,
+                  MAX_LEAF, BLOCK, tri_bound, tri_centroid, tri_leaf);
+  });
+
+  // place the triangles in leaf order
+  for (int i = 1; i < num_surfs; i++) {
+    for (int t = surf_begin[i]; t < surf_begin[i + 1]; t++)
+      add_triangle(&coords[9 * order[t]], handles[order[t]], i);
+    pad_triangles();
+  }
+
+  for (int i = 1; i < num_surfs; i++)
+    surfRoots[i] = append_tree(nodes, subtrees[i]);
+}
+
+void FlatBVH::add_triangle(const double coords[9], EntityHandle handle,
+                           int32_t surf_idx) {
+  size_t slot = triHandles.size();
+  if (0 == slot % BLOCK) {
+    triCoords.resize(triCoords.size() + BLOCK_SIZE, 0.0);
+    triEdges.resize(slot + BLOCK, 0);
+  }
+  RayTriKernel::pack(&triCoords[slot / BLOCK * BLOCK_SIZE],
+                     &triEdges[slot - slot % BLOCK], slot % BLOCK, coords);
+  triHandles.push_back(handle);
+  triSurfs.push_back(surf_idx);
+}
+
+void FlatBVH::pad_triangles() {
+  while (0 != triHandles.size() % BLOCK) {
+    triHandles.push_back(0);
+    triSurfs.push_back(0);
+  }
+}
+
+void FlatBVH::to_single() {
+  // boxes are rounded outwards so they still contain their triangles
+  floatNodes.resize(nodes.size());
+  for (size_t i = 0; i < nodes.size(); i++) {
+    for (int d = 0; d < 3; d++) {
+      floatNodes[i].lower[d] = round_down(nodes[i].lower[d]);
+      floatNodes[i].upper[d] = round_up(nodes[i].upper[d]);
+    }
+    floatNodes[i].first = nodes[i].first;
+    floatNodes[i].count = nodes[i].count;
+  }
+
+  // each block is stored relative to the center of its box
+  size_t num_blocks = triHandles.size() / BLOCK;
+  floatCoords.assign(num_blocks * BLOCK_SIZE, 0.0f);
+  blockAnchors.assign(3 * num_blocks, 0.0);
+  for (size_t b = 0; b < num_blocks; b++) {
+    const double* block = &triCoords[b * BLOCK_SIZE];
+    double lower[3] = {INFTY, INFTY, INFTY};
+    double upper[3] = {-INFTY, -INFTY, -INFTY};
+    for (int lane = 0; lane < BLOCK; lane++) {
+      if (0 == triHandles[b * BLOCK + lane]) continue;
+      double coords[9];
+      RayTriKernel::unpack(block, lane, coords);
+      for (int i = 0; i < 9; i++) {
+        lower[i % 3] = std::min(lower[i % 3], coords[i]);
+        upper[i % 3] = std::max(upper[i % 3], coords[i]);
+      }
+    }
+    double* anchor = &blockAnchors[3 * b];
+    for (int d = 0; d < 3; d++)
+      if (lower[d] <= upper[d]) anchor[d] = 0.5 * (lower[d] + upper[d]);
+
+    for (int lane = 0; lane < BLOCK; lane++) {
+      if (0 == triHandles[b * BLOCK + lane]) continue;
+      double coords[9];
+      RayTriKernel::unpack(block, lane, coords);
+      RayTriKernel::pack(&floatCoords[b * BLOCK_SIZE], anchor,
+                         &triEdges[b * BLOCK], lane, coords);
+    }
+  }
+
+  std::vector<Node>().swap(nodes);
+  std::vector<double>().swap(triCoords);
+}
+
+ErrorCode FlatBVH::flatten(EntityHandle set, int node_idx, int surf_idx,
+                           int depth) {
+  ErrorCode rval;
+
+  if (depth > MAX_DEPTH) {
+    MB_SET_ERR(MB_FAILURE, "OBB tree exceeds the maximum depth of "
+                               << MAX_DEPTH << " supported by the flat BVH");
+  }
+
+  // within a volume tree, a surface root becomes a link to the surface tree
+  if (0 == surf_idx) {
+    auto it = surfRootIdx.find(set);
+    if (it != surfRootIdx.end()) {
+      int target = surfRoots[it->second];
+      nodes[node_idx] = nodes[target];
+      nodes[node_idx].first = target;
+      nodes[node_idx].count = LINK;
+      return MB_SUCCESS;
+    }
+  }
+
+  std::vector<EntityHandle> children;
+  rval = mbi->get_child_meshsets(set, children);
+  MB_CHK_SET_ERR(rval, "Failed to get the children of an OBB tree node");
+
+  if (children.empty()) {
+    if (0 == surf_idx) {
+      MB_SET_ERR(MB_FAILURE, "Volume tree leaf is not a surface tree root");
+    }
+
+    std::vector<EntityHandle> tris;
+    rval = mbi->get_entities_by_type(set, MBTRI, tris);
+    MB_CHK_SET_ERR(rval, "Failed to get the triangles of an OBB tree leaf");
+
+    std::vector<double> coords;
+    rval = read_triangles(tris, coords);
+    MB_CHK_SET_ERR(rval, "Failed to read the triangles of an OBB tree leaf");
+
+    // each leaf starts a new block
+    pad_triangles();
+    Node leaf;
+    empty_box(leaf);
+    leaf.first = triHandles.size();
+    leaf.count = tris.empty() ? EMPTY : (int32_t)tris.size();
+    for (size_t t = 0; t < tris.size(); t++) {
+      const double* c = &coords[9 * t];
+      for (int i = 0; i < 9; i++) {
+        leaf.lower[i % 3] = std::min(leaf.lower[i % 3], c[i]);
+        leaf.upper[i % 3] = std::max(leaf.upper[i % 3], c[i]);
+      }
+      add_triangle(c, tris[t], surf_idx);
+    }
+    nodes[node_idx] = leaf;
+    return MB_SUCCESS;
+  }
+
+  if (2 != children.size()) {
+    MB_SET_ERR(MB_FAILURE, "OBB tree node has " << children.size()
+                                                << " children, expected 2");
+  }
+
+  // children are stored next to each other
+  int first = nodes.size();
+  nodes.resize(first + 2);
+  for (int i = 0; i < 2; i++) {
+    rval = flatten(children[i], first + i, surf_idx, depth + 1);
+    if (MB_SUCCESS != rval) return rval;
+  }
+
+  Node& node = nodes[node_idx];
+  empty_box(node);
+  grow_box(node, nodes[first]);
+  grow_box(node, nodes[first + 1]);
+  node.first = first;
+  node.count = 0;
+  return MB_SUCCESS;
+}
+
+template <typename NodeT>
+bool FlatBVH::ray_box(const NodeT& node, const double point[3],
+                      const double inv[3], double t_min, double t_max,
+                      double tol, double& t_enter) const {
+  for (int d = 0; d < 3; d++) {
+    double lower = node.lower[d] - tol;
+    double upper = node.upper[d] + tol;
+    // ray parallel to this slab
+    if (std::isinf(inv[d])) {
+      if (point[d] < lower || point[d] > upper) return false;
+      continue;
+    }
+    // an empty box (lower > upper) yields t_near > t_far
+    double t_near = ((inv[d] < 0 ? upper : lower) - point[d]) * inv[d];
+    double t_far = ((inv[d] < 0 ? lower : upper) - point[d]) * inv[d];
+    t_min = std::max(t_min, t_near);
+    t_max = std::min(t_max, t_far);
+    if (t_min > t_max) return false;
+  }
+  t_enter = t_min;
+  return true;
+}
+
+template <typename Visitor>
+void FlatBVH::traverse(const int32_t* roots, int num_roots,
+                       const double point[3], const double dir[3],
+                       double t_min, const double& t_max, double tol,
+                       Visitor visit, std::vector<int32_t>* frontier,
+                       QueryStats::Counts* counts) const {
+  if (data.single)
+    traverse_nodes(data.floatNodes, roots, num_roots, point, dir, t_min, t_max,
+                   tol, visit, frontier, counts);
+  else
+    traverse_nodes(data.nodes, roots, num_roots, point, dir, t_min, t_max,
+                   tol, visit, frontier, counts);
+}
+
+template <typename NodeT, typename Visitor>
+void FlatBVH::traverse_nodes(const NodeT* tree, const int32_t* roots,
+                             int num_roots, const double point[3],
+                             const double dir[3], double t_min,
+                             const double& t_max, double tol, Visitor visit,
+                             std::vector<int32_t>* frontier,
+                             QueryStats::Counts* counts) const {
+  double inv[3] = {1.0 / dir[0], 1.0 / dir[1], 1.0 / dir[2]};
+  int stack[MAX_FRONTIER + 2 * MAX_DEPTH + 4];
+  int sp = 0;
+  for (int i = num_roots - 1; i >= 0; i--) stack[sp++] = roots[i];
+
+  while (sp > 0) {
+    int node_idx = stack[--sp];
+    const NodeT* node = &tree[node_idx];
+    if (counts) counts->nodes++;
+    double t_enter;
+    if (!ray_box(*node, point, inv, t_min, t_max, tol, t_enter)) {
+      // a later ray along the line may reach the nodes beyond the window
+      if (frontier && ray_box(*node, point, inv, t_min, INFTY, tol, t_enter))
+        frontier->push_back(node_idx);
+      continue;
+    }
+
+    // the box of a link is that of its target
+    if (LINK == node->count) node = &tree[node->first];
+    if (EMPTY == node->count) continue;
+
+    if (0 == node->count) {
+      // visit the child nearest along the ray first
+      const NodeT& a = tree[node->first];
+      const NodeT& b = tree[node->first + 1];
+      double da = 0, db = 0;
+      for (int d = 0; d < 3; d++) {
+        da += (a.lower[d] + a.upper[d]) * dir[d];
+        db += (b.lower[d] + b.upper[d]) * dir[d];
+      }
+      stack[sp++] = da < db ? node->first + 1 : node->first;
+      stack[sp++] = da < db ? node->first : node->first + 1;
+      continue;
+    }
+
+    // the leaf may also hold hits beyond the window
+    if (frontier) frontier->push_back(node_idx);
+    if (counts) {
+      counts->leaves++;
+      counts->triangles += node->count;
+    }
+    visit(node->first, node->first + node->count);
+  }
+}
+
+FlatBVH::Frontier::Slot& FlatBVH::frontier_slot(Frontier& frontier,
+                                                int vol_idx,
+                                                const double point[3],
+                                                const double dir[3],
+                                                double t_min, double tol,
+                                                bool& resume) const {
+  resume = false;
+  Frontier::Slot* slot = nullptr;
+  for (auto& candidate : frontier.slots) {
+    if (candidate.volIdx == vol_idx) {
+      slot = &candidate;
+      break;
+    }
+    if (!slot || candidate.used < slot->used) slot = &candidate;
+  }
+  slot->used = ++frontier.clock;
+  if (slot->volIdx != vol_idx || slot->build != buildId ||
+      slot->tol != tol || !std::equal(dir, dir + 3, slot->dir))
+    return *slot;
+
+  // the nodes cover the line from the start of the old window on, with
+  // their boxes expanded by tol; the origin must have moved forwards along
+  // the line by no more than tol off it
+  double offset[3], along = 0.0, length = 0.0;
+  for (int d = 0; d < 3; d++) {
+    offset[d] = point[d] - slot->point[d];
+    along += offset[d] * dir[d];
+    length += dir[d] * dir[d];
+  }
+  along /= length;
+  double off_line = 0.0;
+  for (int d = 0; d < 3; d++) {
+    double dev = offset[d] - along * dir[d];
+    off_line += dev * dev;
+  }
+  resume = along + t_min >= slot->tMin && off_line <= 0.25 * tol * tol;
+  return *slot;
+}
+
+int FlatBVH::sense(int surf_idx, int vol_idx) const {
+  bool forward = data.surfForward[surf_idx] == vol_idx;
+  bool reverse = data.surfReverse[surf_idx] == vol_idx;
+  if (forward == reverse) return 0;
+  return forward ? 1 : -1;
+}
+
+bool FlatBVH::tri_coords(int t, double coords[9]) const {
+  if (!data.single) {
+    RayTriKernel::unpack(&data.triCoords[t / BLOCK * BLOCK_SIZE], t % BLOCK,
+                         coords);
+    return true;
+  }
+  const EntityHandle* conn;
+  int len;
+  return MB_SUCCESS ==
+             mbi->get_connectivity(data.triHandles[t], conn, len, true) &&
+         MB_SUCCESS == mbi->get_coords(conn, 3, coords);
+}
+
+double FlatBVH::tri_normal_dot(int t, const double dir[3]) const {
+  double c[9];
+  if (!tri_coords(t, c)) return 0.0;
+  CartVect normal = (CartVect(c + 3) - CartVect(c)) *
+                    (CartVect(c + 6) - CartVect(c));
+  return normal % CartVect(dir);
+}
+
+template <typename Visitor>
+void FlatBVH::intersect_leaf(int begin, int end, const RayTriKernel::Ray& ray,
+                             double t_min, double t_max, Visitor visit) const {
+  // leaves start on a block boundary, lanes past the end are empty
+  for (int b = begin; b < end; b += BLOCK) {
+    double dists[BLOCK];
+    unsigned hits;
+    if (data.single) {
+      hits = RayTriKernel::candidates(
+          &data.floatCoords[b / BLOCK * BLOCK_SIZE],
+          &data.blockAnchors[3 * (b / BLOCK)], &data.triEdges[b], ray, t_min,
+          t_max);
+    } else {
+      hits =
+          RayTriKernel::intersect(&data.triCoords[b / BLOCK * BLOCK_SIZE],
+                                  &data.triEdges[b], ray, t_min, t_max, dists);
+    }
+    if (end - b < BLOCK) hits &= (1u << (end - b)) - 1;
+
+    for (int lane = 0; hits; lane++, hits >>= 1) {
+      if (!(hits & 1)) continue;
+      // confirm single precision candidates in double precision
+      if (data.single) {
+        double coords[9];
+        if (!tri_coords(b + lane, coords) ||
+            !RayTriKernel::intersect_triangle(coords, ray, t_min, t_max,
+                                              dists[lane]))
+          continue;
+      }
+      visit(b + lane, dists[lane]);
+    }
+  }
+}
+
+struct FlatBVH::FireWindow {
+  FireWindow() = default;
+  FireWindow(double neg_ray_len, double dist_limit)
+      : negLimit(-std::fabs(neg_ray_len)),
+        posLimit(dist_limit > 0 ? dist_limit : INFTY),
+        bestNeg(negLimit),
+        windowMax(posLimit) {}
+
+  /** start of the window still searched */
+  double window_min() const { return hitNeg >= 0 ? bestNeg : negLimit; }
+
+  /** record an accepted hit, shrinking the window */
+  void add(int t, double dist) {
+    if (dist < 0) {
+      if (hitNeg < 0 || dist > bestNeg) {
+        bestNeg = dist;
+        hitNeg = t;
+        windowMax = 0.0;
+      }
+    } else if (hitPos < 0 || dist < posLimit) {
+      posLimit = dist;
+      hitPos = t;
+      if (hitNeg < 0) windowMax = dist;
+    }
+  }
+
+  // search window [negLimit, posLimit]
+  double negLimit = 0.0;
+  double posLimit = INFTY;
+  // closest intersection behind and ahead of the origin
+  double bestNeg = 0.0;
+  int hitNeg = -1;
+  int hitPos = -1;
+  // once an intersection behind the origin is found it will be returned,
+  // only closer ones behind the origin are of interest
+  double windowMax = INFTY;
+};
+
+bool FlatBVH::accept_hit(int t, int vol_idx, const double dir[3],
+                         int orientation, const RayHistory* history) const {
+  // only accept exits (orientation 1) or entrances (-1)
+  if (0 != orientation) {
+    int tri_sense = sense(data.triSurfs[t], vol_idx);
+    if (0 != tri_sense && tri_normal_dot(t, dir) * tri_sense * orientation <= 0)
+      return false;
+  }
+  return !history || !history->in_history(data.triHandles[t]);
+}
+
+void FlatBVH::fire_result(const FireWindow& window, RayHistory* history,
+                          int& next_surf_idx, double& next_surf_dist) const {
+  int hit = window.hitNeg >= 0 ? window.hitNeg : window.hitPos;
+  if (hit < 0) {
+    next_surf_idx = 0;
+    next_surf_dist = INFTY;
+    return;
+  }
+
+  next_surf_idx = data.triSurfs[hit];
+  next_surf_dist = hit == window.hitNeg ? 0.0 : window.posLimit;
+  if (history) history->add_entity(data.triHandles[hit]);
+}
+
+ErrorCode FlatBVH::ray_fire(int vol_idx, const double point[3],
+                            const double dir[3], int& next_surf_idx,
+                            double& next_surf_dist, RayHistory* history,
+                            double dist_limit, int orientation,
+                            double neg_ray_len, double tol,
+                            Frontier* frontier,
+                            QueryStats::Counts* counts) const {
+  if (vol_idx <= 0 || vol_idx >= (int)data.numVols ||
+      data.volRoots[vol_idx] < 0) {
+    MB_SET_ERR(MB_ENTITY_NOT_FOUND, "No flat BVH for volume " << vol_idx);
+  }
+
+  const RayTriKernel::Ray ray(point, dir);
+  FireWindow window(neg_ray_len, dist_limit);
+  const double neg_limit = window.negLimit;
+  const double& window_max = window.windowMax;
+
+  auto visit_hit = [&](int t, double dist) {
+    // the window may have shrunk since the block was tested
+    if (dist > window.windowMax || dist < window.window_min()) return;
+    if (accept_hit(t, vol_idx, dir, orientation, history)) window.add(t, dist);
+  };
+
+  auto visit_leaf = [&](int begin, int end) {
+    intersect_leaf(begin, end, ray, window.window_min(), window.windowMax,
+                   visit_hit);
+  };
+
+  if (vol_idx == complementIdx && !complementTree.empty()) {
+    // search the surfaces next to each neighbouring volume in the order the
+    // ray enters their boxes, until the boxes are beyond the nearest hit
+    ComplementStats complement;
+    complement.rays = 1;
+    complementTree.find_ray(
+        point, dir, neg_limit, window_max, tol, [&](int group, double) {
+          complement.volumes++;
+          for (int i = complementBegin[group]; i < complementBegin[group + 1];
+               i++) {
+            complement.surfaces++;
+            traverse(&data.surfRoots[complementSurfs[i]], 1, point, dir,
+                     neg_limit, window_max, tol,
+                     [&](int begin, int end) {
+                       complement.leaves++;
+                       visit_leaf(begin, end);
+                     },
+                     nullptr, counts);
+          }
+          return window_max;
+        });
+    // counted only along with the traversal work, the shared counters
+    // would otherwise be contended by every thread firing complement rays
+    if (counts) count_complement(complement);
+  } else if (frontier) {
+    // resume from the nodes the last ray along this line left unexplored
+    bool resume;
+    Frontier::Slot& slot = frontier_slot(*frontier, vol_idx, point, dir,
+                                         neg_limit, tol, resume);
+    const int32_t* roots = &data.volRoots[vol_idx];
+    int num_roots = 1;
+    if (resume) {
+      roots = slot.nodes.data();
+      num_roots = slot.nodes.size();
+    }
+    frontier->recorded.clear();
+    traverse(roots, num_roots, point, dir, neg_limit, window_max, tol,
+             visit_leaf, &frontier->recorded, counts);
+
+    slot.volIdx = 0;
+    if (frontier->recorded.size() <= (size_t)MAX_FRONTIER) {
+      slot.volIdx = vol_idx;
+      slot.build = buildId;
+      std::copy(point, point + 3, slot.point);
+      std::copy(dir, dir + 3, slot.dir);
+      slot.tMin = neg_limit;
+      slot.tol = tol;
+      slot.nodes.swap(frontier->recorded);
+    }
+  } else {
+    traverse(&data.volRoots[vol_idx], 1, point, dir, neg_limit, window_max,
+             tol, visit_leaf, nullptr, counts);
+  }
+
+  fire_result(window, history, next_surf_idx, next_surf_dist);
+  return MB_SUCCESS;
+}
+
+template <typename NodeT, typename Visitor>
+void FlatBVH::traverse_packet(const NodeT* tree, int root, int num_rays,
+                              const double (*points)[3],
+                              const double (*dirs)[3],
+                              const FireWindow* windows, double tol,
+                              Visitor visit,
+                              QueryStats::Counts* counts) const {
+  double inv[MAX_PACKET][3];
+  for (int r = 0; r < num_rays; r++)
+    for (int d = 0; d < 3; d++) inv[r][d] = 1.0 / dirs[r][d];
+
+  // each node on the stack with the rays that entered its parent
+  struct Entry {
+    int node;
+    uint32_t rays;
+  };
+  Entry stack[2 * MAX_DEPTH + 4];
+  int sp = 0;
+  stack[sp++] = {root, (1u << num_rays) - 1};
+
+  while (sp > 0) {
+    Entry entry = stack[--sp];
+    const NodeT* node = &tree[entry.node];
+    if (counts) counts->nodes++;
+    uint32_t active = 0;
+    for (int r = 0; r < num_rays; r++) {
+      double t_enter;
+      if ((entry.rays >> r & 1) &&
+          ray_box(*node, points[r], inv[r], windows[r].negLimit,
+                  windows[r].windowMax, tol, t_enter))
+        active |= 1u << r;
+    }
+    if (!active) continue;
+
+    // the box of a link is that of its target
+    if (LINK == node->count) node = &tree[node->first];
+    if (EMPTY == node->count) continue;
+
+    if (0 == node->count) {
+      // visit the child nearest along the first active ray first
+      int first = 0;
+      while (!(active >> first & 1)) first++;
+      const double* dir = dirs[first];
+      const NodeT& a = tree[node->first];
+      const NodeT& b = tree[node->first + 1];
+      double da = 0, db = 0;
+      for (int d = 0; d < 3; d++) {
+        da += (a.lower[d] + a.upper[d]) * dir[d];
+        db += (b.lower[d] + b.upper[d]) * dir[d];
+      }
+      stack[sp++] = {da < db ? node->first + 1 : node->first, active};
+      stack[sp++] = {da < db ? node->first : node->first + 1, active};
+      continue;
+    }
+
+    for (int r = 0; r < num_rays; r++) {
+      if (!(active >> r & 1)) continue;
+      if (counts) {
+        counts->leaves++;
+        counts->triangles += node->count;
+      }
+      visit(r, node->first, node->first + node->count);
+    }
+  }
+}
+
+ErrorCode FlatBVH::ray_fire_packet(int vol_idx, int num_rays,
+                                   const double (*points)[3],
+                                   const double (*dirs)[3],
+                                   int* next_surf_idxs,
+                                   double* next_surf_dists,
+                                   RayHistory* const* histories,
+                                   const double* dist_limits, int orientation,
+                                   double neg_ray_len, double tol,
+                                   QueryStats::Counts* counts) const {
+  if (vol_idx <= 0 || vol_idx >= (int)data.numVols ||
+      data.volRoots[vol_idx] < 0) {
+    MB_SET_ERR(MB_ENTITY_NOT_FOUND, "No flat BVH for volume " << vol_idx);
+  }
+  if (num_rays < 0 || num_rays > MAX_PACKET) {
+    MB_SET_ERR(MB_INDEX_OUT_OF_RANGE,
+               "A packet holds at most " << MAX_PACKET << " rays");
+  }
+
+  if (vol_idx == complementIdx && !complementTree.empty()) {
+    for (int r = 0; r < num_rays; r++) {
+      ErrorCode rval = ray_fire(
+          vol_idx, points[r], dirs[r], next_surf_idxs[r], next_surf_dists[r],
+          histories ? histories[r] : nullptr,
+          dist_limits ? dist_limits[r] : 0.0, orientation, neg_ray_len, tol,
+          nullptr, counts);
+      MB_CHK_ERR(rval);
+    }
+    return MB_SUCCESS;
+  }
+
+  std::vector<RayTriKernel::Ray> rays;
+  rays.reserve(num_rays);
+  FireWindow windows[MAX_PACKET];
+  for (int r = 0; r < num_rays; r++) {
+    rays.emplace_back(points[r], dirs[r]);
+    windows[r] = FireWindow(neg_ray_len, dist_limits ? dist_limits[r] : 0.0);
+  }
+
+  auto visit_leaf = [&](int r, int begin, int end) {
+    FireWindow& window = windows[r];
+    RayHistory* history = histories ? histories[r] : nullptr;
+    intersect_leaf(begin, end, rays[r], window.window_min(), window.windowMax,
+                   [&](int t, double dist) {
+                     // the window may have shrunk since the block was tested
+                     if (dist > window.windowMax ||
+                         dist < window.window_min())
+                       return;
+                     if (accept_hit(t, vol_idx, dirs[r], orientation,
+                                    history))
+                       window.add(t, dist);
+                   });
+  };
+  if (data.single)
+    traverse_packet(data.floatNodes, data.volRoots[vol_idx], num_rays, points,
+                    dirs, windows, tol, visit_leaf, counts);
+  else
+    traverse_packet(data.nodes, data.volRoots[vol_idx], num_rays, points,
+                    dirs, windows, tol, visit_leaf, counts);
+
+  for (int r = 0; r < num_rays; r++)
+    fire_result(windows[r], histories ? histories[r] : nullptr,
+                next_surf_idxs[r], next_surf_dists[r]);
+  return MB_SUCCESS;
+}
+
+ErrorCode FlatBVH::point_in_volume(int vol_idx, const double xyz[3],
+                                   int& result, const double* uvw,
+                                   const RayHistory* history, bool count_all,
+                                   bool implicit_complement, double tol,
+                                   QueryStats::Counts* counts) const {
+  if (vol_idx <= 0 || vol_idx >= (int)data.numVols ||
+      data.volRoots[vol_idx] < 0) {
+    MB_SET_ERR(MB_ENTITY_NOT_FOUND, "No flat BVH for volume " << vol_idx);
+  }
+
+  // points outside the box of the volume are outside the volume
+  result = 0;
+  double lower[3], upper[3];
+  node_box(data.volRoots[vol_idx], lower, upper);
+  for (int d = 0; d < 3; d++) {
+    if (xyz[d] < lower[d] - tol || xyz[d] > upper[d] + tol) return MB_SUCCESS;
+  }
+
+  // if uvw is not given or is full of zeros, use a random direction
+  double dir[3] = {0.0, 0.0, 0.0};
+  if (uvw) std::copy(uvw, uvw + 3, dir);
+  if (0 == dir[0] && 0 == dir[1] && 0 == dir[2]) {
+    thread_local std::minstd_rand generator;
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    while (0 == dir[0] && 0 == dir[1] && 0 == dir[2])
+      for (int d = 0; d < 3; d++) dir[d] = uniform(generator);
+    double magnitude = std::sqrt(dir[0] * dir[0] + dir[1] * dir[1] +
+                                 dir[2] * dir[2]);
+    for (int d = 0; d < 3; d++) dir[d] /= magnitude;
+  }
+  const RayTriKernel::Ray ray(xyz, dir);
+
+  // crossings as (distance, surface, 1 entering/0 leaving/-1 tangent)
+  struct Crossing {
+    double dist;
+    int surf;
+    int dir;
+  };
+  std::vector<Crossing> crossings;
+  const double large = 1e15;
+  double window_max = large;
+
+  auto visit_hit = [&](int t, double dist) {
+    if (dist > window_max) return;
+    if (history && history->in_history(data.triHandles[t])) return;
+
+    double ddot = tri_normal_dot(t, dir) * sense(data.triSurfs[t], vol_idx);
+    int crossing = ddot > 0 ? 0 : (ddot < 0 ? 1 : -1);
+    crossings.push_back({dist, data.triSurfs[t], crossing});
+    // only the first crossing is needed without overlaps
+    if (!count_all) window_max = dist;
+  };
+
+  traverse(&data.volRoots[vol_idx], 1, xyz, dir, 0.0, window_max, tol,
+           [&](int begin, int end) {
+             intersect_leaf(begin, end, ray, 0.0, window_max, visit_hit);
+           },
+           nullptr, counts);
+
+  if (crossings.empty()) return MB_SUCCESS;
+
+  std::sort(crossings.begin(), crossings.end(),
+            [](const Crossing& a, const Crossing& b) {
+              return a.dist < b.dist;
+            });
+
+  if (!count_all) {
+    if (-1 == crossings[0].dir) {
+      MB_SET_ERR(MB_FAILURE, "direction==tangent");
+    }
+    // leaving the volume means the point is inside
+    result = 0 == crossings[0].dir ? 1 : 0;
+    return MB_SUCCESS;
+  }
+
+  // +1 for entering, -1 for leaving; a ray through an edge or vertex crosses
+  // several facets of the same surface at the same distance, count it once
+  int sum = 0;
+  for (size_t i = 0; i < crossings.size(); i++) {
+    if (i > 0 && crossings[i].surf == crossings[i - 1].surf &&
+        crossings[i].dir == crossings[i - 1].dir &&
+        crossings[i].dist - crossings[i - 1].dist <= tol)
+      continue;
+    if (1 == crossings[i].dir)
+      sum += 1;
+    else if (0 == crossings[i].dir)
+      sum -= 1;
+  }
+
+  if (0 < sum)
+    result = 0;
+  else if (0 > sum)
+    result = 1;
+  else
+    result = implicit_complement ? 1 : 0;
+  return MB_SUCCESS;
+}
+
+ErrorCode FlatBVH::refit(const std::vector<int>& surf_indices) {
+  if (mapping) {
+    MB_SET_ERR(MB_NOT_IMPLEMENTED,
+               "A flat BVH mapped from a cache file cannot be refit");
+  }
+  // the nodes kept by Frontiers may no longer cover their rays
+  buildId = next_build_id();
+
+  std::vector<bool> vol_moved(data.numVols, false);
+  for (int surf_idx : surf_indices) {
+    if (surf_idx <= 0 || surf_idx >= (int)data.numSurfs) {
+      MB_SET_ERR(MB_INDEX_OUT_OF_RANGE, "No surface with index " << surf_idx);
+    }
+    if (data.surfRoots[surf_idx] < 0) continue;
+    double lower[3], upper[3];
+    ErrorCode rval = refit_node(data.surfRoots[surf_idx], lower, upper);
+    MB_CHK_SET_ERR(rval, "Failed to refit the tree of surface " << surf_idx);
+    vol_moved[data.surfForward[surf_idx]] = true;
+    vol_moved[data.surfReverse[surf_idx]] = true;
+  }
+
+  for (size_t i = 1; i < data.numVols; i++) {
+    if (!vol_moved[i] || data.volRoots[i] < 0) continue;
+    double lower[3], upper[3];
+    ErrorCode rval = refit_node(data.volRoots[i], lower, upper);
+    MB_CHK_SET_ERR(rval, "Failed to refit the tree of volume " << i);
+  }
+
+  if (!windingNodes.empty()) {
+    for (int surf_idx : surf_indices) {
+      if (data.surfRoots[surf_idx] < 0) continue;
+      double area;
+      ErrorCode rval =
+          winding_moments(data.surfRoots[surf_idx], surf_idx, area);
+      MB_CHK_SET_ERR(rval, "Failed to update the winding data of surface "
+                               << surf_idx);
+    }
+  }
+
+  // the boxes of the complement's boundary may have moved
+  if (complementIdx && vol_moved[complementIdx])
+    return build_complement(complementIdx);
+  return MB_SUCCESS;
+}
+
+ErrorCode FlatBVH::build_complement(int vol_idx) {
+  if (vol_idx <= 0 || vol_idx >= (int)data.numVols) {
+    MB_SET_ERR(MB_INDEX_OUT_OF_RANGE, "No volume with index " << vol_idx);
+  }
+
+  // the surfaces of the complement by the volume on their other side
+  std::vector<std::pair<int, int>> neighbours;
+  for (size_t i = 1; i < data.numSurfs; i++) {
+    if (data.surfRoots[i] < 0) continue;
+    if (data.surfForward[i] == vol_idx)
+      neighbours.emplace_back(data.surfReverse[i], i);
+    else if (data.surfReverse[i] == vol_idx)
+      neighbours.emplace_back(data.surfForward[i], i);
+  }
+  std::sort(neighbours.begin(), neighbours.end());
+
+  complementIdx = vol_idx;
+  complementBegin.clear();
+  complementSurfs.clear();
+  std::vector<int> ids;
+  std::vector<double> boxes;
+  for (size_t i = 0; i < neighbours.size(); i++) {
+    if (0 == i || neighbours[i].first != neighbours[i - 1].first) {
+      ids.push_back(complementBegin.size());
+      complementBegin.push_back(complementSurfs.size());
+      boxes.insert(boxes.end(), {INFTY, INFTY, INFTY, -INFTY, -INFTY, -INFTY});
+    }
+    complementSurfs.push_back(neighbours[i].second);
+
+    double lower[3], upper[3];
+    node_box(data.surfRoots[neighbours[i].second], lower, upper);
+    double* box = &boxes[boxes.size() - 6];
+    for (int d = 0; d < 3; d++) {
+      box[d] = std::min(box[d], lower[d]);
+      box[3 + d] = std::max(box[3 + d], upper[d]);
+    }
+  }
+  complementBegin.push_back(complementSurfs.size());
+  complementTree.build(ids, boxes);
+  return MB_SUCCESS;
+}
+
+FlatBVH::ComplementStats FlatBVH::complement_stats() const {
+  ComplementStats stats;
+  stats.rays = complementCounts[0].load(std::memory_order_relaxed);
+  stats.volumes = complementCounts[1].load(std::memory_order_relaxed);
+  stats.surfaces = complementCounts[2].load(std::memory_order_relaxed);
+  stats.leaves = complementCounts[3].load(std::memory_order_relaxed);
+  return stats;
+}
+
+void FlatBVH::reset_complement_stats() {
+  for (auto& count : complementCounts) count.store(0);
+}
+
+void FlatBVH::count_complement(const ComplementStats& counts) const {
+  complementCounts[0].fetch_add(counts.rays, std::memory_order_relaxed);
+  complementCounts[1].fetch_add(counts.volumes, std::memory_order_relaxed);
+  complementCounts[2].fetch_add(counts.surfaces, std::memory_order_relaxed);
+  complementCounts[3].fetch_add(counts.leaves, std::memory_order_relaxed);
+}
+
+ErrorCode FlatBVH::refit_node(int node_idx, double lower[3],
+                              double upper[3]) {
+  int32_t first, count;
+  node_links(node_idx, first, count);
+  if (LINK == count) {
+    node_box(first, lower, upper);
+  } else if (EMPTY == count) {
+    // no triangles to re-read, the box stays empty
+    std::fill(lower, lower + 3, INFTY);
+    std::fill(upper, upper + 3, -INFTY);
+  } else if (0 == count) {
+    std::fill(lower, lower + 3, INFTY);
+    std::fill(upper, upper + 3, -INFTY);
+    for (int child = first; child < first + 2; child++) {
+      double child_lower[3], child_upper[3];
+      ErrorCode rval = refit_node(child, child_lower, child_upper);
+      if (MB_SUCCESS != rval) return rval;
+      for (int d = 0; d < 3; d++) {
+        lower[d] = std::min(lower[d], child_lower[d]);
+        upper[d] = std::max(upper[d], child_upper[d]);
+      }
+    }
+  } else {
+    ErrorCode rval = refit_leaf(first, count, lower, upper);
+    if (MB_SUCCESS != rval) return rval;
+  }
+  set_node_box(node_idx, lower, upper);
+  return MB_SUCCESS;
+}
+
+ErrorCode FlatBVH::refit_leaf(int first, int count, double lower[3],
+                              double upper[3]) {
+  std::fill(lower, lower + 3, INFTY);
+  std::fill(upper, upper + 3, -INFTY);
+  // leaves start on a block boundary, lanes past the end are empty
+  for (int b = first; b < first + count; b += BLOCK) {
+    int end = std::min(first + count, b + BLOCK);
+    std::vector<EntityHandle> tris(data.triHandles + b,
+                                   data.triHandles + end);
+    std::vector<double> coords;
+    ErrorCode rval = read_triangles(tris, coords);
+    MB_CHK_SET_ERR(rval, "Failed to read the triangles of a leaf");
+
+    double block_lower[3] = {INFTY, INFTY, INFTY};
+    double block_upper[3] = {-INFTY, -INFTY, -INFTY};
+    for (size_t i = 0; i < coords.size(); i++) {
+      block_lower[i % 3] = std::min(block_lower[i % 3], coords[i]);
+      block_upper[i % 3] = std::max(block_upper[i % 3], coords[i]);
+    }
+    for (int d = 0; d < 3; d++) {
+      lower[d] = std::min(lower[d], block_lower[d]);
+      upper[d] = std::max(upper[d], block_upper[d]);
+    }
+
+    double* anchor = nullptr;
+    if (data.single) {
+      anchor = &blockAnchors[3 * (b / BLOCK)];
+      for (int d = 0; d < 3; d++)
+        anchor[d] = 0.5 * (block_lower[d] + block_upper[d]);
+    }
+    for (int t = b; t < end; t++) {
+      const double* tri = &coords[9 * (t - b)];
+      if (data.single)
+        RayTriKernel::pack(&floatCoords[b / BLOCK * BLOCK_SIZE], anchor,
+                           &triEdges[b], t - b, tri);
+      else
+        RayTriKernel::pack(&triCoords[b / BLOCK * BLOCK_SIZE], &triEdges[b],
+                           t - b, tri);
+    }
+  }
+  return MB_SUCCESS;
+}
+
+void FlatBVH::set_node_box(int node_idx, const double lower[3],
+                           const double upper[3]) {
+  if (data.single) {
+    FloatNode& node = floatNodes[node_idx];
+    for (int d = 0; d < 3; d++) {
+      node.lower[d] = round_down(lower[d]);
+      node.upper[d] = round_up(upper[d]);
+    }
+  } else {
+    Node& node = nodes[node_idx];
+    std::copy(lower, lower + 3, node.lower);
+    std::copy(upper, upper + 3, node.upper);
+  }
+}
+
+ErrorCode FlatBVH::build_winding_data() {
+  windingNodes.assign(data.numNodes, WindingNode());
+  for (size_t i = 1; i < data.numSurfs; i++) {
+    if (data.surfRoots[i] < 0) continue;
+    double area;
+    ErrorCode rval = winding_moments(data.surfRoots[i], i, area);
+    MB_CHK_SET_ERR(rval, "Failed to compute the winding data of surface " << i);
+  }
+  return MB_SUCCESS;
+}
+
+ErrorCode FlatBVH::winding_moments(int node_idx, int32_t surf_idx,
+                                   double& area) {
+  WindingNode& node = windingNodes[node_idx];
+  node.surf = surf_idx;
+  std::fill(node.normal, node.normal + 3, 0.0);
+  double weighted[3] = {0.0, 0.0, 0.0};
+  area = 0.0;
+
+  int32_t first, count;
+  node_links(node_idx, first, count);
+  if (EMPTY == count) {
+    std::fill(node.center, node.center + 3, 0.0);
+    node.radius = 0.0;
+    return MB_SUCCESS;
+  } else if (0 == count) {
+    for (int child = first; child < first + 2; child++) {
+      double child_area;
+      ErrorCode rval = winding_moments(child, surf_idx, child_area);
+      if (MB_SUCCESS != rval) return rval;
+      const WindingNode& moments = windingNodes[child];
+      for (int d = 0; d < 3; d++) {
+        node.normal[d] += moments.normal[d];
+        weighted[d] += child_area * moments.center[d];
+      }
+      area += child_area;
+    }
+  } else {
+    for (int t = first; t < first + count; t++) {
+      if (!data.triHandles[t]) continue;
+      double c[9];
+      if (!tri_coords(t, c)) {
+        MB_SET_ERR(MB_FAILURE, "Failed to get the coordinates of a triangle");
+      }
+      CartVect normal = (CartVect(c + 3) - CartVect(c)) *
+                        (CartVect(c + 6) - CartVect(c));
+      double tri_area = 0.5 * normal.length();
+      for (int d = 0; d < 3; d++) {
+        node.normal[d] += 0.5 * normal[d];
+        weighted[d] += tri_area * (c[d] + c[3 + d] + c[6 + d]) / 3.0;
+      }
+      area += tri_area;
+    }
+  }
+
+  double lower[3], upper[3];
+  node_box(node_idx, lower, upper);
+  double radius_sq = 0.0;
+  for (int d = 0; d < 3; d++) {
+    node.center[d] =
+        area > 0.0 ? weighted[d] / area : 0.5 * (lower[d] + upper[d]);
+    double extent =
+        std::max(node.center[d] - lower[d], upper[d] - node.center[d]);
+    radius_sq += extent * extent;
+  }
+  node.radius = std::sqrt(radius_sq);
+  return MB_SUCCESS;
+}
+
+void FlatBVH::node_links(int node_idx, int32_t& first, int32_t& count) const {
+  if (data.single) {
+    first = data.floatNodes[node_idx].first;
+    count = data.floatNodes[node_idx].count;
+  } else {
+    first = data.nodes[node_idx].first;
+    count = data.nodes[node_idx].count;
+  }
+}
+
+// solid angle subtended by a triangle at a point (Van Oosterom and
+// Strackee), positive if the triangle faces away from the point; zero for
+// points in the plane of the triangle, so points on a surface get half the
+// winding number of either side
+static double solid_angle(const double coords[9], const double point[3]) {
+  CartVect a = CartVect(coords) - CartVect(point);
+  CartVect b = CartVect(coords + 3) - CartVect(point);
+  CartVect c = CartVect(coords + 6) - CartVect(point);
+  double numerator = a % (b * c);
+  if (0.0 == numerator) return 0.0;
+  double la = a.length(), lb = b.length(), lc = c.length();
+  double denominator =
+      la * lb * lc + (a % b) * lc + (b % c) * la + (c % a) * lb;
+  return 2.0 * std::atan2(numerator, denominator);
+}
+
+ErrorCode FlatBVH::winding_number(int vol_idx, const double xyz[3],
+                                  double& winding, double accuracy) const {
+  if (vol_idx <= 0 || vol_idx >= (int)data.numVols ||
+      data.volRoots[vol_idx] < 0) {
+    MB_SET_ERR(MB_ENTITY_NOT_FOUND, "No flat BVH for volume " << vol_idx);
+  }
+  if (windingNodes.empty()) {
+    MB_SET_ERR(MB_FAILURE, "The winding number data has not been computed");
+  }
+
+  const double accuracy_sq = accuracy * accuracy;
+  double angle = 0.0;
+  // nodes to visit with the sense of their surface, 0 above the links
+  std::pair<int, int> stack[2 * MAX_DEPTH + 4];
+  int sp = 0;
+  stack[sp++] = std::make_pair((int)data.volRoots[vol_idx], 0);
+
+  while (sp > 0) {
+    int node_idx = stack[--sp].first;
+    int surf_sense = stack[sp].second;
+    int32_t first, count;
+    node_links(node_idx, first, count);
+
+    if (LINK == count) {
+      node_idx = first;
+      // a surface with the volume on both sides does not bound it
+      surf_sense = sense(windingNodes[node_idx].surf, vol_idx);
+      if (0 == surf_sense) continue;
+      node_links(node_idx, first, count);
+    }
+    if (EMPTY == count) continue;
+
+    // far away nodes are approximated by a dipole at their centroid
+    if (surf_sense) {
+      const WindingNode& node = windingNodes[node_idx];
+      double offset[3], dist_sq = 0.0, dot = 0.0;
+      for (int d = 0; d < 3; d++) {
+        offset[d] = node.center[d] - xyz[d];
+        dist_sq += offset[d] * offset[d];
+        dot += node.normal[d] * offset[d];
+      }
+      if (dist_sq > accuracy_sq * node.radius * node.radius) {
+        angle += surf_sense * dot / (dist_sq * std::sqrt(dist_sq));
+        continue;
+      }
+    }
+
+    if (0 == count) {
+      stack[sp++] = std::make_pair((int)first, surf_sense);
+      stack[sp++] = std::make_pair((int)first + 1, surf_sense);
+      continue;
+    }
+
+    for (int t = first; t < first + count; t++) {
+      if (!data.triHandles[t]) continue;
+      int tri_sense =
+          surf_sense ? surf_sense : sense(data.triSurfs[t], vol_idx);
+      double coords[9];
+      if (0 == tri_sense || !tri_coords(t, coords)) continue;
+      angle += tri_sense * solid_angle(coords, xyz);
+    }
+  }
+
+  winding = angle / (4.0 * M_PI);
+  return MB_SUCCESS;
+}
+
+ErrorCode FlatBVH::ray_intersect_triangles(
+    int surf_idx, const double point[3], const double dir[3], double t_max,
+    double tol, std::vector<EntityHandle>& tris,
+    std::vector<double>& dists) const {
+  if (surf_idx <= 0 || surf_idx >= (int)data.numSurfs ||
+      data.surfRoots[surf_idx] < 0) {
+    MB_SET_ERR(MB_ENTITY_NOT_FOUND, "No flat BVH for surface " << surf_idx);
+  }
+
+  const RayTriKernel::Ray ray(point, dir);
+  traverse(data.surfRoots[surf_idx], point, dir, 0.0, t_max, tol,
+           [&](int begin, int end) {
+             intersect_leaf(begin, end, ray, 0.0, t_max,
+                            [&](int t, double dist) {
+                              tris.push_back(data.triHandles[t]);
+                              dists.push_back(dist);
+                            });
+           });
+  return MB_SUCCESS;
+}
+
+ErrorCode FlatBVH::get_bounding_box(int idx, int dim, double lower[3],
+                                    double upper[3]) const {
+  const int32_t* roots = (2 == dim) ? data.surfRoots : data.volRoots;
+  size_t num_roots = (2 == dim) ? data.numSurfs : data.numVols;
+  if (idx <= 0 || idx >= (int)num_roots || roots[idx] < 0) {
+    MB_SET_ERR(MB_ENTITY_NOT_FOUND, "No flat BVH for entity " << idx);
+  }
+  node_box(roots[idx], lower, upper);
+  return MB_SUCCESS;
+}
+
+void FlatBVH::node_box(int node_idx, double lower[3], double upper[3]) const {
+  if (data.single) {
+    const FloatNode& node = data.floatNodes[node_idx];
+    std::copy(node.lower, node.lower + 3, lower);
+    std::copy(node.upper, node.upper + 3, upper);
+  } else {
+    const Node& node = data.nodes[node_idx];
+    std::copy(node.lower, node.lower + 3, lower);
+    std::copy(node.upper, node.upper + 3, upper);
+  }
+}
+
+size_t FlatBVH::memory_use() const {
+  size_t node_size = data.single ? sizeof(FloatNode) : sizeof(Node);
+  size_t coord_size = data.single ? sizeof(float) : sizeof(double);
+  size_t anchors = data.single ? data.numTris / BLOCK * 3 * sizeof(double) : 0;
+  return data.numNodes * node_size +
+         data.numTris * (9 * coord_size + sizeof(uint8_t) +
+                         sizeof(EntityHandle) + sizeof(int32_t)) +
+         anchors + (3 * data.numSurfs + data.numVols) * sizeof(int32_t) +
+         windingNodes.size() * sizeof(WindingNode) +
+         (complementBegin.size() + complementSurfs.size()) * sizeof(int32_t);
+}
+
+ErrorCode FlatBVH::model_hash(GeomTopoTool* gtt,
+                              const std::vector<EntityHandle>& surfs,
+                              const std::vector<EntityHandle>& vols,
+                              uint64_t& hash) {
+  ErrorCode rval;
+  Interface* mbi = gtt->get_moab_instance();
+
+  hash = dagmc_util::FNV_OFFSET;
+  hash_bytes(hash, surfs.data(), surfs.size() * sizeof(EntityHandle));
+  hash_bytes(hash, vols.data(), vols.size() * sizeof(EntityHandle));
+
+  for (size_t i = 1; i < surfs.size(); i++) {
+    EntityHandle senses[2] = {0, 0};
+    rval = gtt->get_surface_senses(surfs[i], senses[0], senses[1]);
+    MB_CHK_SET_ERR(rval, "Failed to get the senses of surface " << i);
+    hash_bytes(hash, senses, sizeof(senses));
+
+    std::vector<EntityHandle> tris;
+    rval = mbi->get_entities_by_type(surfs[i], MBTRI, tris);
+    MB_CHK_SET_ERR(rval, "Failed to get the triangles of surface " << i);
+    hash_bytes(hash, tris.data(), tris.size() * sizeof(EntityHandle));
+    for (auto tri : tris) {
+      const EntityHandle* conn;
+      int len;
+      rval = mbi->get_connectivity(tri, conn, len, true);
+      MB_CHK_SET_ERR(rval, "Failed to get triangle connectivity");
+      double coords[9];
+      rval = mbi->get_coords(conn, 3, coords);
+      MB_CHK_SET_ERR(rval, "Failed to get triangle coordinates");
+      hash_bytes(hash, coords, sizeof(coords));
+    }
+  }
+  return MB_SUCCESS;
+}
+
+// the cache file and shared memory segments are mapped with POSIX calls
+#ifndef _WIN32
+
+namespace {
+
+const char CACHE_MAGIC[8] = {'D', 'A', 'G', 'M', 'C', 'B', 'V', 'H'};
+const uint32_t CACHE_VERSION = 4;
+const uint32_t CACHE_BYTE_ORDER = 0x01020304;
+const size_t CACHE_ALIGN = 64;
+// seconds a shared memory segment may remain smaller than its header
+const double SHARED_CREATE_GRACE = 10.0;
+
+struct CacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrder;
+  uint32_t singlePrecision;
+  // process that created a shared memory segment, 0 in cache files
+  uint32_t writerPid;
+  uint64_t modelHash;
+  uint64_t fileSize;
+  uint64_t numNodes;
+  uint64_t numTris;
+  uint64_t numSurfs;
+  uint64_t numVols;
+};
+
+// sections of a cache file, each starting on a CACHE_ALIGN boundary
+enum CacheSection {
+  NODES,
+  TRI_COORDS,
+  TRI_EDGES,
+  BLOCK_ANCHORS,
+  TRI_HANDLES,
+  TRI_SURFS,
+  SURF_ROOTS,
+  SURF_FORWARD,
+  SURF_REVERSE,
+  VOL_ROOTS,
+  SURF_HANDLES,
+  VOL_HANDLES,
+  NUM_SECTIONS
+};
+
+// compute the offset of each section, returns the size of the file
+size_t cache_layout(const CacheHeader& header, size_t offsets[NUM_SECTIONS],
+                    size_t sizes[NUM_SECTIONS]) {
+  bool single = header.singlePrecision;
+  sizes[NODES] = header.numNodes * (single ? sizeof(FlatBVH::FloatNode)
+                                           : sizeof(FlatBVH::Node));
+  sizes[TRI_COORDS] =
+      header.numTris * 9 * (single ? sizeof(float) : sizeof(double));
+  sizes[TRI_EDGES] = header.numTris * sizeof(uint8_t);
+  sizes[BLOCK_ANCHORS] =
+      single ? header.numTris / RayTriKernel::BLOCK * 3 * sizeof(double) : 0;
+  sizes[TRI_HANDLES] = header.numTris * sizeof(EntityHandle);
+  sizes[TRI_SURFS] = header.numTris * sizeof(int32_t);
+  sizes[SURF_ROOTS] = sizes[SURF_FORWARD] = sizes[SURF_REVERSE] =
+      header.numSurfs * sizeof(int32_t);
+  sizes[VOL_ROOTS] = header.numVols * sizeof(int32_t);
+  sizes[SURF_HANDLES] = header.numSurfs * sizeof(EntityHandle);
+  sizes[VOL_HANDLES] = header.numVols * sizeof(EntityHandle);
+
+  size_t offset = sizeof(CacheHeader);
+  for (int i = 0; i < NUM_SECTIONS; i++) {
+    offset = (offset + CACHE_ALIGN - 1) / CACHE_ALIGN * CACHE_ALIGN;
+    offsets[i] = offset;
+    offset += sizes[i];
+  }
+  return offset;
+}
+
+// check that the tree below root only refers to nodes and triangles that
+// exist and fits the traversal stack; links may only lead from a volume tree
+// to the root of a surface tree
+template <typename NodeT>
+bool valid_tree(const NodeT* nodes, int64_t num_nodes, int64_t num_tris,
+                int32_t root, const std::vector<bool>& surf_roots,
+                bool volume) {
+  if (root < 0 || root >= num_nodes) return false;
+  std::vector<std::pair<int32_t, int>> stack(1, {root, 0});
+  while (!stack.empty()) {
+    int32_t node_idx = stack.back().first;
+    int depth = stack.back().second;
+    stack.pop_back();
+    if (depth > FlatBVH::MAX_DEPTH) return false;
+    const NodeT& node = nodes[node_idx];
+    if (FlatBVH::LINK == node.count) {
+      if (!volume || node.first < 0 || node.first >= num_nodes ||
+          !surf_roots[node.first])
+        return false;
+    } else if (FlatBVH::EMPTY == node.count) {
+      continue;
+    } else if (0 == node.count) {
+      // children follow their parent, so the tree has no cycles
+      if (node.first <= node_idx || node.first + 1 >= num_nodes) return false;
+      stack.push_back({node.first, depth + 1});
+      stack.push_back({node.first + 1, depth + 1});
+    } else if (volume || node.count < 0 || node.first < 0 ||
+               node.first + (int64_t)node.count > num_tris) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// check every index stored in the arrays of a mapped cache image
+template <typename NodeT>
+bool valid_image(const NodeT* nodes, const CacheHeader& header,
+                 const int32_t* tri_surfs, const int32_t* surf_roots,
+                 const int32_t* surf_forward, const int32_t* surf_reverse,
+                 const int32_t* vol_roots) {
+  int64_t num_nodes = header.numNodes;
+  int64_t num_tris = header.numTris;
+  int64_t num_surfs = header.numSurfs;
+  int64_t num_vols = header.numVols;
+  if (0 != num_tris % RayTriKernel::BLOCK) return false;
+  for (int64_t t = 0; t < num_tris; t++)
+    if (tri_surfs[t] < 0 || tri_surfs[t] >= num_surfs) return false;
+
+  std::vector<bool> is_surf_root(num_nodes, false);
+  for (int64_t i = 0; i < num_surfs; i++) {
+    if (surf_forward[i] < 0 || surf_forward[i] >= num_vols ||
+        surf_reverse[i] < 0 || surf_reverse[i] >= num_vols)
+      return false;
+    if (surf_roots[i] < 0) continue;
+    if (!valid_tree(nodes, num_nodes, num_tris, surf_roots[i], is_surf_root,
+                    false))
+      return false;
+    is_surf_root[surf_roots[i]] = true;
+  }
+  for (int64_t i = 0; i < num_vols; i++)
+    if (vol_roots[i] >= 0 &&
+        !valid_tree(nodes, num_nodes, num_tris, vol_roots[i], is_surf_root,
+                    true))
+      return false;
+  return true;
+}
+
+// shared memory segment names start with a single '/'
+std::string shared_name(const std::string& name) {
+  return '/' == name[0] ? name : '/' + name;
+}
+
+// a process that exists but belongs to another user is alive too
+bool process_alive(uint32_t pid) {
+  return 0 == kill(pid, 0) || EPERM == errno;
+}
+
+// remove the segment shm_name if it still is the one open as fd, and not
+// one that another process has already put in its place
+void unlink_replaced(const std::string& shm_name, int fd) {
+  int named_fd = shm_open(shm_name.c_str(), O_RDONLY, 0);
+  if (named_fd < 0) return;
+  struct stat open_st, named_st;
+  bool same = 0 == fstat(fd, &open_st) && 0 == fstat(named_fd, &named_st) &&
+              open_st.st_dev == named_st.st_dev &&
+              open_st.st_ino == named_st.st_ino;
+  close(named_fd);
+  if (same) shm_unlink(shm_name.c_str());
+}
+
+}  // namespace
+
+struct FlatBVH::CacheImage {
+  CacheHeader header;
+  size_t offsets[NUM_SECTIONS];
+  size_t sizes[NUM_SECTIONS];
+  const void* sections[NUM_SECTIONS];
+};
+
+ErrorCode FlatBVH::cache_image(CacheImage& image,
+                               const std::vector<EntityHandle>& surfs,
+                               const std::vector<EntityHandle>& vols,
+                               uint64_t hash) const {
+  if (surfs.size() != data.numSurfs || vols.size() != data.numVols) {
+    MB_SET_ERR(MB_FAILURE, "The flat BVH does not match the model indices");
+  }
+
+  CacheHeader& header = image.header;
+  std::copy(CACHE_MAGIC, CACHE_MAGIC + 8, header.magic);
+  header.version = CACHE_VERSION;
+  header.byteOrder = CACHE_BYTE_ORDER;
+  header.singlePrecision = data.single;
+  header.writerPid = 0;
+  header.modelHash = hash;
+  header.numNodes = data.numNodes;
+  header.numTris = data.numTris;
+  header.numSurfs = data.numSurfs;
+  header.numVols = data.numVols;
+  header.fileSize = cache_layout(header, image.offsets, image.sizes);
+
+  const void* sections[NUM_SECTIONS] = {
+      data.single ? (const void*)data.floatNodes : data.nodes,
+      data.single ? (const void*)data.floatCoords : data.triCoords,
+      data.triEdges,
+      data.blockAnchors,
+      data.triHandles,
+      data.triSurfs,
+      data.surfRoots,
+      data.surfForward,
+      data.surfReverse,
+      data.volRoots,
+      surfs.data(),
+      vols.data()};
+  std::copy(sections, sections + NUM_SECTIONS, image.sections);
+  return MB_SUCCESS;
+}
+
+ErrorCode FlatBVH::write(const std::string& filename,
+                         const std::vector<EntityHandle>& surfs,
+                         const std::vector<EntityHandle>& vols,
+                         uint64_t hash) const {
+  CacheImage image;
+  ErrorCode rval = cache_image(image, surfs, vols, hash);
+  MB_CHK_ERR(rval);
+
+  // write to a temporary file and rename it into place
+  std::string tmp_name = filename + ".tmp." + std::to_string(getpid());
+  std::ofstream out(tmp_name, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    MB_SET_ERR(MB_FAILURE, "Failed to open " << tmp_name << " for writing");
+  }
+  out.write(reinterpret_cast<const char*>(&image.header),
+            sizeof(image.header));
+  size_t pos = sizeof(image.header);
+  const char padding[CACHE_ALIGN] = {0};
+  for (int i = 0; i < NUM_SECTIONS; i++) {
+    out.write(padding, image.offsets[i] - pos);
+    out.write(static_cast<const char*>(image.sections[i]), image.sizes[i]);
+    pos = image.offsets[i] + image.sizes[i];
+  }
+  out.close();
+  if (!out || 0 != std::rename(tmp_name.c_str(), filename.c_str())) {
+    std::remove(tmp_name.c_str());
+    MB_SET_ERR(MB_FAILURE, "Failed to write the flat BVH cache " << filename);
+  }
+  return MB_SUCCESS;
+}
+
+ErrorCode FlatBVH::load(const std::string& filename, GeomTopoTool* gtt,
+                        const std::vector<EntityHandle>& surfs,
+                        const std::vector<EntityHandle>& vols, uint64_t hash) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) return MB_FILE_DOES_NOT_EXIST;
+  ErrorCode rval = map_image(fd, filename, gtt, surfs, vols, hash);
+  close(fd);
+  return rval;
+}
+
+ErrorCode FlatBVH::map_image(int fd, const std::string& name,
+                             GeomTopoTool* gtt,
+                             const std::vector<EntityHandle>& surfs,
+                             const std::vector<EntityHandle>& vols,
+                             uint64_t hash) {
+  struct stat st;
+  if (0 != fstat(fd, &st) || st.st_size < (off_t)sizeof(CacheHeader))
+    return MB_FAILURE;
+  size_t size = st.st_size;
+  void* addr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (MAP_FAILED == addr) {
+    MB_SET_ERR(MB_FAILURE, "Failed to map the flat BVH cache " << name);
+  }
+  std::shared_ptr<const void> map(addr, [size](const void* p) {
+    munmap(const_cast<void*>(p), size);
+  });
+
+  // a stale or foreign cache is not an error, it is simply not used
+  const char* base = static_cast<const char*>(addr);
+  const CacheHeader& header = *reinterpret_cast<const CacheHeader*>(base);
+  if (!std::equal(CACHE_MAGIC, CACHE_MAGIC + 8, header.magic) ||
+      CACHE_VERSION != header.version ||
+      CACHE_BYTE_ORDER != header.byteOrder ||
+      (uint32_t)singlePrecision != header.singlePrecision ||
+      hash != header.modelHash || size < header.fileSize ||
+      surfs.size() != header.numSurfs || vols.size() != header.numVols ||
+      header.numNodes > size || header.numTris > size ||
+      header.numNodes > (uint64_t)std::numeric_limits<int32_t>::max() ||
+      header.numTris > (uint64_t)std::numeric_limits<int32_t>::max())
+    return MB_FAILURE;
+
+  // shared memory segments may be rounded up to whole pages
+  size_t offsets[NUM_SECTIONS], sizes[NUM_SECTIONS];
+  if (header.fileSize != cache_layout(header, offsets, sizes))
+    return MB_FAILURE;
+
+  // the model indices must match those the cache was written for
+  const EntityHandle* surf_handles =
+      reinterpret_cast<const EntityHandle*>(base + offsets[SURF_HANDLES]);
+  const EntityHandle* vol_handles =
+      reinterpret_cast<const EntityHandle*>(base + offsets[VOL_HANDLES]);
+  if (!std::equal(surfs.begin(), surfs.end(), surf_handles) ||
+      !std::equal(vols.begin(), vols.end(), vol_handles))
+    return MB_FAILURE;
+
+  // the queries index the arrays without checks, so a damaged image is
+  // treated like a stale one
+  auto section = [&](CacheSection i) {
+    return reinterpret_cast<const int32_t*>(base + offsets[i]);
+  };
+  bool valid =
+      singlePrecision
+          ? valid_image(
+                reinterpret_cast<const FloatNode*>(base + offsets[NODES]),
+                header, section(TRI_SURFS), section(SURF_ROOTS),
+                section(SURF_FORWARD), section(SURF_REVERSE),
+                section(VOL_ROOTS))
+          : valid_image(reinterpret_cast<const Node*>(base + offsets[NODES]),
+                        header, section(TRI_SURFS), section(SURF_ROOTS),
+                        section(SURF_FORWARD), section(SURF_REVERSE),
+                        section(VOL_ROOTS));
+  if (!valid) return MB_FAILURE;
+
+  clear();
+  mbi = gtt->get_moab_instance();
+  data.single = singlePrecision;
+  if (singlePrecision) {
+    data.floatNodes = reinterpret_cast<const FloatNode*>(base + offsets[NODES]);
+    data.floatCoords =
+        reinterpret_cast<const float*>(base + offsets[TRI_COORDS]);
+    data.blockAnchors =
+        reinterpret_cast<const double*>(base + offsets[BLOCK_ANCHORS]);
+  } else {
+    data.nodes = reinterpret_cast<const Node*>(base + offsets[NODES]);
+    data.triCoords =
+        reinterpret_cast<const double*>(base + offsets[TRI_COORDS]);
+  }
+  data.triEdges = reinterpret_cast<const uint8_t*>(base + offsets[TRI_EDGES]);
+  data.triHandles =
+      reinterpret_cast<const EntityHandle*>(base + offsets[TRI_HANDLES]);
+  data.triSurfs = reinterpret_cast<const int32_t*>(base + offsets[TRI_SURFS]);
+  data.surfRoots =
+      reinterpret_cast<const int32_t*>(base + offsets[SURF_ROOTS]);
+  data.surfForward =
+      reinterpret_cast<const int32_t*>(base + offsets[SURF_FORWARD]);
+  data.surfReverse =
+      reinterpret_cast<const int32_t*>(base + offsets[SURF_REVERSE]);
+  data.volRoots = reinterpret_cast<const int32_t*>(base + offsets[VOL_ROOTS]);
+  data.numNodes = header.numNodes;
+  data.numTris = header.numTris;
+  data.numSurfs = header.numSurfs;
+  data.numVols = header.numVols;
+  mapping = map;
+  buildId = next_build_id();
+  return windingNumbers ? build_winding_data() : MB_SUCCESS;
+}
+
+ErrorCode FlatBVH::create_shared(const std::string& name, int& fd) {
+  std::string shm_name = shared_name(name);
+  fd = shm_open(shm_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0 && EEXIST == errno) return MB_ALREADY_ALLOCATED;
+  if (fd < 0) {
+    MB_SET_ERR(MB_FAILURE, "Failed to create the shared memory segment "
+                               << shm_name);
+  }
+
+  // record the writer, so readers can tell if it dies before the image is
+  // complete
+  CacheHeader header = {};
+  header.writerPid = getpid();
+  void* addr = MAP_FAILED;
+  if (0 == ftruncate(fd, sizeof(header)))
+    addr = mmap(NULL, sizeof(header), PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                0);
+  if (MAP_FAILED == addr) {
+    unlink_shared(name, fd);
+    MB_SET_ERR(MB_FAILURE, "Failed to map the shared memory segment "
+                               << shm_name);
+  }
+  std::memcpy(addr, &header, sizeof(header));
+  munmap(addr, sizeof(header));
+  return MB_SUCCESS;
+}
+
+ErrorCode FlatBVH::write_shared(int fd, const std::vector<EntityHandle>& surfs,
+                                const std::vector<EntityHandle>& vols,
+                                uint64_t hash) const {
+  CacheImage image;
+  ErrorCode rval = cache_image(image, surfs, vols, hash);
+  if (MB_SUCCESS != rval) close(fd);
+  MB_CHK_ERR(rval);
+
+  // shared memory is sized and written through a mapping, the new segment
+  // reads as zeros so the magic is only seen once it is copied in last
+  size_t size = image.header.fileSize;
+  void* addr = MAP_FAILED;
+  if (0 == ftruncate(fd, size))
+    addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (MAP_FAILED == addr) {
+    MB_SET_ERR(MB_FAILURE, "Failed to map the shared memory segment");
+  }
+
+  char* base = static_cast<char*>(addr);
+  CacheHeader header = image.header;
+  std::fill(header.magic, header.magic + 8, 0);
+  header.writerPid = getpid();
+  std::memcpy(base, &header, sizeof(header));
+  for (int i = 0; i < NUM_SECTIONS; i++)
+    if (image.sizes[i])
+      std::memcpy(base + image.offsets[i], image.sections[i], image.sizes[i]);
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(base, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+  munmap(addr, size);
+  return MB_SUCCESS;
+}
+
+ErrorCode FlatBVH::load_shared(const std::string& name, GeomTopoTool* gtt,
+                               const std::vector<EntityHandle>& surfs,
+                               const std::vector<EntityHandle>& vols,
+                               uint64_t hash, double timeout) {
+  std::string shm_name = shared_name(name);
+  int fd = shm_open(shm_name.c_str(), O_RDONLY, 0);
+  if (fd < 0) return MB_FILE_DOES_NOT_EXIST;
+
+  // wait for the writer to size the segment and copy in the magic, unless
+  // it died first
+  auto start = std::chrono::steady_clock::now();
+  bool abandoned = false;
+  for (;;) {
+    std::chrono::duration<double> waited =
+        std::chrono::steady_clock::now() - start;
+    struct stat st;
+    if (0 == fstat(fd, &st) && st.st_size >= (off_t)sizeof(CacheHeader)) {
+      void* addr =
+          mmap(NULL, sizeof(CacheHeader), PROT_READ, MAP_SHARED, fd, 0);
+      if (MAP_FAILED != addr) {
+        CacheHeader header;
+        std::memcpy(&header, addr, sizeof(header));
+        munmap(addr, sizeof(CacheHeader));
+        if (std::equal(CACHE_MAGIC, CACHE_MAGIC + 8, header.magic)) break;
+        abandoned = !process_alive(header.writerPid);
+      }
+    } else {
+      abandoned = waited.count() > SHARED_CREATE_GRACE;
+    }
+    if (abandoned) break;
+    if (waited.count() > timeout) {
+      close(fd);
+      return MB_FAILURE;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  ErrorCode rval = MB_FAILURE;
+  if (!abandoned) {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    rval = map_image(fd, shm_name, gtt, surfs, vols, hash);
+  }
+  // a segment left incomplete by a dead writer, or written for another
+  // model, is removed so that it can be written again
+  if (MB_SUCCESS != rval) {
+    unlink_replaced(shm_name, fd);
+    rval = MB_FILE_DOES_NOT_EXIST;
+  }
+  close(fd);
+  return rval;
+}
+
+void FlatBVH::unlink_shared(const std::string& name, int fd) {
+  if (fd >= 0) close(fd);
+  shm_unlink(shared_name(name).c_str());
+}
+
+#else
+
+ErrorCode FlatBVH::write(const std::string& filename,
+                         const std::vector<EntityHandle>& surfs,
+                         const std::vector<EntityHandle>& vols,
+                         uint64_t hash) const {
+  MB_SET_ERR(MB_NOT_IMPLEMENTED,
+             "The flat BVH cache is not available on Windows");
+}
+
+ErrorCode FlatBVH::load(const std::string& filename, GeomTopoTool* gtt,
+                        const std::vector<EntityHandle>& surfs,
+                        const std::vector<EntityHandle>& vols, uint64_t hash) {
+  MB_SET_ERR(MB_NOT_IMPLEMENTED,
+             "The flat BVH cache is not available on Windows");
+}
+
+ErrorCode FlatBVH::create_shared(const std::string& name, int& fd) {
+  MB_SET_ERR(MB_NOT_IMPLEMENTED,
+             "Shared memory segments are not available on Windows");
+}
+
+ErrorCode FlatBVH::write_shared(int fd, const std::vector<EntityHandle>& surfs,
+                                const std::vector<EntityHandle>& vols,
+                                uint64_t hash) const {
+  MB_SET_ERR(MB_NOT_IMPLEMENTED,
+             "Shared memory segments are not available on Windows");
+}
+
+ErrorCode FlatBVH::load_shared(const std::string& name, GeomTopoTool* gtt,
+                               const std::vector<EntityHandle>& surfs,
+                               const std::vector<EntityHandle>& vols,
+                               uint64_t hash, double timeout) {
+  MB_SET_ERR(MB_NOT_IMPLEMENTED,
+             "Shared memory segments are not available on Windows");
+}
+
+void FlatBVH::unlink_shared(const std::string& name, int fd) {}
+
+#endif  // _WIN32
+
+}  // namespace moab
@@ -0,0 +1,668 @@
+#ifndef DAGMC_FLATBVH_HPP
+#define DAGMC_FLATBVH_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "moab/GeomQueryTool.hpp"
+#include "moab/GeomTopoTool.hpp"
+#include "moab/Interface.hpp"
+#include "moab/Range.hpp"
+#include "QueryStats.hpp"
+#include "RayTriKernel.hpp"
+#include "VolumeTree.hpp"
+
+namespace moab {
+
+/**\brief Flattened bounding volume hierarchy for the DAGMC model
+ *
+ * The OBB trees built by the GeomTopoTool are stored as MOAB entity sets, so
+ * every step of a traversal goes through tag and set lookups in MOAB. This
+ * class compiles those trees into contiguous arrays: 64 byte nodes holding an
+ * axis-aligned box refit to the triangles beneath it, and the vertex
+ * coordinates of every triangle copied in-line in leaf order. The triangles
+ * are packed in blocks of RayTriKernel::BLOCK, each leaf starting a new block,
+ * so that leaves are intersected a block at a time by the SIMD kernel.
+ *
+ * The hierarchy is either compiled from the OBB trees (build()) or constructed
+ * directly from the triangles (construct()). Each surface tree is stored once;
+ * the tree of a volume refers to the trees of its surfaces through link nodes,
+ * so the triangles of a surface are shared by the two volumes it bounds.
+ *
+ * In single precision mode (set_single_precision()) the nodes and triangles
+ * are stored as floats, halving the size of the hierarchy. Boxes are rounded
+ * outwards and candidate triangles are re-intersected in double precision
+ * using the MOAB vertex coordinates, so the results do not change.
+ *
+ * Optionally (set_winding_numbers()) every node of the surface trees also
+ * stores the moments used to approximate the generalized winding number of
+ * the triangles beneath it, so point containment can be decided without
+ * firing rays (winding_number()).
+ *
+ * The tree of the implicit complement joins the trees of every surface
+ * bounding it, often nearly all the triangles of the model, so after
+ * build_complement() rays in the complement are instead fired through a
+ * top-level tree over the boxes of its boundary, grouped by the volume on
+ * the other side. The groups are visited nearest first and those the ray
+ * enters beyond the nearest hit so far are skipped, so the volumes nearest
+ * the ray occlude the rest of the model.
+ *
+ * Surfaces and volumes are referred to by their DAGMC (1-based) index.
+ * Queries only read the arrays and are safe to call concurrently.
+ */
+class FlatBVH {
+ public:
+  /** Tree node, one cache line wide */
+  struct alignas(64) Node {
+    double lower[3];
+    double upper[3];
+    /** leaf: first triangle slot, interior: first of two adjacent children,
+     *  link: the node the link refers to */
+    int32_t first;
+    /** leaf: number of triangles, interior: 0, link: LINK, leaf without
+     *  triangles: EMPTY */
+    int32_t count;
+  };
+
+  /** Tree node in single precision mode, two per cache line */
+  struct alignas(32) FloatNode {
+    float lower[3];
+    float upper[3];
+    int32_t first;
+    int32_t count;
+  };
+
+  /** count value marking a link to another subtree */
+  static const int32_t LINK = -1;
+
+  /** count value marking a leaf without triangles, e.g. the root of a
+   *  surface without facets or of a volume without surfaces */
+  static const int32_t EMPTY = -2;
+
+  /** maximum supported tree depth, bounds the traversal stack */
+  static const int MAX_DEPTH = 120;
+
+  /** maximum number of triangles in a leaf built by construct() */
+  static const int MAX_LEAF = 8;
+
+  /** maximum number of nodes kept in a Frontier between rays */
+  static const int MAX_FRONTIER = 64;
+
+  /** maximum number of rays traversed together by ray_fire_packet() */
+  static const int MAX_PACKET = 16;
+
+  typedef GeomQueryTool::RayHistory RayHistory;
+
+  /**\brief Traversal state kept between the rays fired for one particle
+   *
+   * ray_fire() records the nodes left unexplored by a ray (those beyond the
+   * nearest hit or the distance limit) and the leaves it intersected. The
+   * next ray fired in the same volume from further along the same line, as
+   * when a particle streams on after crossing a surface or reaching the
+   * distance limit, starts its traversal from those nodes instead of the
+   * root of the volume. A few volumes are remembered, so a particle
+   * streaming through a void and the cells it crosses resumes in each. Rays
+   * along other lines or from another hierarchy start from the root as
+   * usual, so the frontier never changes the results.
+   */
+  class Frontier {
+   public:
+    /** forget the state of every volume */
+    void reset() {
+      for (auto& slot : slots) slot.volIdx = 0;
+    }
+
+   private:
+    friend class FlatBVH;
+
+    struct Slot {
+      /** volume the nodes belong to, 0 if the slot is unused */
+      int volIdx = 0;
+      /** FlatBVH::buildId of the hierarchy the nodes belong to */
+      uint64_t build = 0;
+      /** line of the ray and the start of its search window */
+      double point[3];
+      double dir[3];
+      double tMin;
+      double tol;
+      /** clock value of the last use */
+      uint64_t used = 0;
+      /** nodes to resume from, nearest first */
+      std::vector<int32_t> nodes;
+    };
+
+    static const int NUM_SLOTS = 4;
+    Slot slots[NUM_SLOTS];
+    uint64_t clock = 0;
+    /** nodes recorded by the ray being fired */
+    std::vector<int32_t> recorded;
+  };
+
+  /** Counters of the rays fired in the implicit complement */
+  struct ComplementStats {
+    /** rays fired */
+    uint64_t rays = 0;
+    /** boxes of neighbouring volumes entered and searched */
+    uint64_t volumes = 0;
+    /** surface trees traversed */
+    uint64_t surfaces = 0;
+    /** leaves intersected */
+    uint64_t leaves = 0;
+  };
+
+  /**\brief Compile the OBB trees of all surfaces and volumes
+   *
+   * Requires that the GeomTopoTool OBB trees exist.
+   *
+   *\param gtt the GeomTopoTool owning the OBB trees
+   *\param surfs surface handles by DAGMC index (entry 0 unused)
+   *\param vols volume handles by DAGMC index (entry 0 unused)
+   */
+  ErrorCode build(GeomTopoTool* gtt, const std::vector<EntityHandle>& surfs,
+                  const std::vector<EntityHandle>& vols);
+
+  /**\brief Build the hierarchy directly from the triangles of the model
+   *
+   * Does not require the OBB trees. The tree of each surface is built by
+   * splitting its triangles at the median centroid along the longest axis;
+   * the tree of each volume is then built over the boxes of its surfaces. The
+   * surface trees and then the volume trees are built on num_threads threads.
+   * MOAB is only accessed from the calling thread.
+   *
+   *\param num_threads number of threads to use, 0 for all available cores
+   */
+  ErrorCode construct(GeomTopoTool* gtt, const std::vector<EntityHandle>& surfs,
+                      const std::vector<EntityHandle>& vols, int num_threads);
+
+  /**\brief Build a hierarchy over an arbitrary set of triangles
+   *
+   * The triangles are stored as surface 1, with no volumes; they can be
+   * queried with ray_intersect_triangles().
+   */
+  ErrorCode construct(Interface* moab, const Range& triangles);
+
+  /** Store the hierarchy in single precision from the next build(),
+   *  construct() or load() on */
+  void set_single_precision(bool single) { singlePrecision = single; }
+
+  /** true if single precision storage is selected */
+  bool single_precision() const { return singlePrecision; }
+
+  /** Compute the data used by winding_number() from the next build(),
+   *  construct() or load() on */
+  void set_winding_numbers(bool winding) { windingNumbers = winding; }
+
+  /** true if the winding number data is selected */
+  bool winding_numbers() const { return windingNumbers; }
+
+  /** true if winding_number() can be called */
+  bool has_winding_data() const { return !windingNodes.empty(); }
+
+  /** release all storage */
+  void clear();
+
+  /**\brief Fire the rays of the implicit complement through its own tree
+   *
+   * Builds the top-level tree over the boundary of the implicit complement;
+   * it is kept up to date by refit() and released by clear().
+   *
+   *\param vol_idx DAGMC index of the implicit complement
+   */
+  ErrorCode build_complement(int vol_idx);
+
+  /** DAGMC index of the volume given to build_complement(), 0 if none */
+  int complement() const { return complementIdx; }
+
+  /** counters of the rays fired through the tree of build_complement(),
+   *  only those given traversal counts to ray_fire() are counted */
+  ComplementStats complement_stats() const;
+
+  /** reset the counters of complement_stats() */
+  void reset_complement_stats();
+
+  /** true if the hierarchy has been built */
+  bool empty() const { return 0 == data.numNodes; }
+
+  /** true if the hierarchy is mapped from a cache file, it cannot be refit */
+  bool mapped() const { return mapping != nullptr; }
+
+  /**\brief Update the hierarchy after the vertices of surfaces have moved
+   *
+   * The triangles of the surfaces are re-read from MOAB into their slots and
+   * the boxes of their trees recomputed bottom up, followed by the boxes of
+   * the trees of the volumes they bound. The structure of the trees is kept,
+   * so the triangles of each surface must be unchanged; if they moved far
+   * the trees are valid but may be slower to traverse than rebuilt ones.
+   * Not available for a hierarchy mapped from a cache file.
+   *
+   *\param surf_indices DAGMC indices of the surfaces that moved
+   */
+  ErrorCode refit(const std::vector<int>& surf_indices);
+
+  /**\brief Find the next surface crossed by a ray in a volume
+   *
+   * Follows the conventions of GeomQueryTool::ray_fire(): intersections up to
+   * neg_ray_len behind the origin are reported at distance zero, facets in
+   * the history are ignored and the facet hit is appended to the history.
+   *
+   *\param vol_idx DAGMC index of the volume
+   *\param neg_ray_len length of the search window behind the origin
+   *\param tol tolerance used for the bounding box tests
+   *\param next_surf_idx output, index of the surface hit (0 if none)
+   *\param frontier optional traversal state of the particle, see Frontier;
+   *       not used for rays in the volume given to build_complement()
+   *\param counts optional, the nodes, leaves and triangle slots visited are
+   *       added to it
+   */
+  ErrorCode ray_fire(int vol_idx, const double point[3], const double dir[3],
+                     int& next_surf_idx, double& next_surf_dist,
+                     RayHistory* history, double dist_limit, int orientation,
+                     double neg_ray_len, double tol,
+                     Frontier* frontier = nullptr,
+                     QueryStats::Counts* counts = nullptr) const;
+
+  /**\brief Find the next surface crossed by each of a packet of rays
+   *
+   * Gives the results of ray_fire() for each ray, but the rays are traversed
+   * together: each node is fetched once for the packet and its box tested
+   * against the rays still searching beneath it, so the nodes that all the
+   * rays visit, from the root down to where they part, are visited once per
+   * packet instead of once per ray. Packets of rays with nearby origins and
+   * similar directions share the most nodes. Rays in the volume given to
+   * build_complement() are fired one at a time through its own tree.
+   *
+   *\param num_rays number of rays, at most MAX_PACKET
+   *\param points, dirs origin and direction of each ray
+   *\param histories optional, the history of each ray, which may be NULL
+   *\param dist_limits optional, the distance limit of each ray
+   *\param counts optional, the nodes visited by the packet and the leaves and
+   *       triangle slots intersected by each ray are added to it
+   */
+  ErrorCode ray_fire_packet(int vol_idx, int num_rays,
+                            const double (*points)[3],
+                            const double (*dirs)[3], int* next_surf_idxs,
+                            double* next_surf_dists,
+                            RayHistory* const* histories,
+                            const double* dist_limits, int orientation,
+                            double neg_ray_len, double tol,
+                            QueryStats::Counts* counts = nullptr) const;
+
+  /**\brief Determine whether a point is inside a volume
+   *
+   * Follows GeomQueryTool::point_in_volume(): a ray is fired from the point
+   * (along uvw, or a random direction if uvw is NULL) and the first crossing,
+   * or the sum of all crossings if count_all is set, decides the result.
+   *
+   *\param result output, 1 if inside, 0 if outside
+   *\param count_all count every crossing, used when volumes overlap
+   *\param implicit_complement true if the volume is the implicit complement
+   *\param counts optional, the nodes, leaves and triangle slots visited are
+   *       added to it
+   */
+  ErrorCode point_in_volume(int vol_idx, const double xyz[3], int& result,
+                            const double* uvw, const RayHistory* history,
+                            bool count_all, bool implicit_complement,
+                            double tol,
+                            QueryStats::Counts* counts = nullptr) const;
+
+  /**\brief Generalized winding number of a volume at a point
+   *
+   * Sums the solid angles subtended by the boundary of the volume, each
+   * surface oriented by its sense with respect to the volume, over 4 pi. For
+   * a watertight volume the result is 1 inside and 0 outside, independent of
+   * any direction, and only half way between on the boundary itself. Nodes
+   * further from the point than accuracy times their radius are replaced by
+   * their dipole approximation, so the result is approximate; the default
+   * keeps the error well below 0.1 for meshes that are not degenerate.
+   *
+   *\param winding output, the winding number
+   *\param accuracy distance, in node radii, beyond which nodes are
+   *       approximated
+   */
+  ErrorCode winding_number(int vol_idx, const double xyz[3], double& winding,
+                           double accuracy = 2.0) const;
+
+  /**\brief Find all the triangles of a surface hit by a ray
+   *
+   * Intersections between the origin and t_max are appended to tris and
+   * dists, in no particular order.
+   *
+   *\param tol tolerance used for the bounding box tests
+   */
+  ErrorCode ray_intersect_triangles(int surf_idx, const double point[3],
+                                    const double dir[3], double t_max,
+                                    double tol, std::vector<EntityHandle>& tris,
+                                    std::vector<double>& dists) const;
+
+  /** Get the bounding box of a volume's or surface's tree */
+  ErrorCode get_bounding_box(int idx, int dim, double lower[3],
+                             double upper[3]) const;
+
+  /** number of triangle slots stored, including the padding of blocks */
+  size_t num_triangles() const { return data.numTris; }
+
+  /** number of nodes stored */
+  size_t num_nodes() const { return data.numNodes; }
+
+  /** approximate size of the hierarchy in bytes */
+  size_t memory_use() const;
+
+  /**\brief Hash of the model content the hierarchy is built from
+   *
+   * Covers the surface and volume handles, the surface senses and the handle
+   * and vertex coordinates of every triangle, so a cache file is only reused
+   * for the model (as loaded into MOAB) it was written for.
+   */
+  static ErrorCode model_hash(GeomTopoTool* gtt,
+                              const std::vector<EntityHandle>& surfs,
+                              const std::vector<EntityHandle>& vols,
+                              uint64_t& hash);
+
+  /**\brief Write the hierarchy to a cache file
+   *
+   * The file is written next to its destination and then renamed into place,
+   * so processes loading the cache never see a partial file. Returns
+   * MB_NOT_IMPLEMENTED on Windows, as does load().
+   */
+  ErrorCode write(const std::string& filename,
+                  const std::vector<EntityHandle>& surfs,
+                  const std::vector<EntityHandle>& vols, uint64_t hash) const;
+
+  /**\brief Map a cache file written by write()
+   *
+   * The file is mapped read-only and shared, the queries read from the
+   * mapping directly so all processes on a node share one physical copy.
+   * Returns MB_FILE_DOES_NOT_EXIST if there is no such file and MB_FAILURE
+   * without reporting an error if the file does not match the model or the
+   * selected precision.
+   */
+  ErrorCode load(const std::string& filename, GeomTopoTool* gtt,
+                 const std::vector<EntityHandle>& surfs,
+                 const std::vector<EntityHandle>& vols, uint64_t hash);
+
+  /**\brief Create a POSIX shared memory segment for write_shared()
+   *
+   * The segment is created exclusively, so of the processes racing to share
+   * a hierarchy under one name only the first gets to write it; the others
+   * get MB_ALREADY_ALLOCATED, without an error being reported, and should
+   * call load_shared(). The segment records the calling process as its
+   * writer.
+   *
+   *\param name name of the segment, a leading '/' is added if missing
+   *\param fd set to the open segment
+   */
+  static ErrorCode create_shared(const std::string& name, int& fd);
+
+  /**\brief Write the hierarchy to a segment from create_shared()
+   *
+   * The segment holds the same image as a cache file, its header completed
+   * last so readers never map a partial image. Closes fd.
+   */
+  ErrorCode write_shared(int fd, const std::vector<EntityHandle>& surfs,
+                         const std::vector<EntityHandle>& vols,
+                         uint64_t hash) const;
+
+  /**\brief Map a shared memory segment written by write_shared()
+   *
+   * Waits up to timeout seconds for the writer to complete the image, then
+   * maps it read-only like load(). A segment whose writer died before
+   * completing it, or whose image does not match the model or the selected
+   * precision, is unlinked so that it can be created again. Returns
+   * MB_FILE_DOES_NOT_EXIST if there is no such segment or it was unlinked,
+   * and MB_FAILURE without reporting an error if the image was not completed
+   * in time.
+   */
+  ErrorCode load_shared(const std::string& name, GeomTopoTool* gtt,
+                        const std::vector<EntityHandle>& surfs,
+                        const std::vector<EntityHandle>& vols, uint64_t hash,
+                        double timeout);
+
+  /** Remove a shared memory segment, processes that have it mapped keep
+   *  their mapping; fd, if not negative, is closed first */
+  static void unlink_shared(const std::string& name, int fd = -1);
+
+ private:
+  /** Header and sections of a cache image, defined in FlatBVH.cpp */
+  struct CacheImage;
+
+  /** Search window and closest hits of a ray fired by ray_fire(), defined
+   *  in FlatBVH.cpp */
+  struct FireWindow;
+
+  /** Lay out the cache image of the hierarchy */
+  ErrorCode cache_image(CacheImage& image,
+                        const std::vector<EntityHandle>& surfs,
+                        const std::vector<EntityHandle>& vols,
+                        uint64_t hash) const;
+
+  /** Map the cache image in the open file fd, see load() */
+  ErrorCode map_image(int fd, const std::string& name, GeomTopoTool* gtt,
+                      const std::vector<EntityHandle>& surfs,
+                      const std::vector<EntityHandle>& vols, uint64_t hash);
+
+  /** Per node data of the surface trees used by winding_number() */
+  struct WindingNode {
+    /** sum of the area weighted normals of the triangles beneath */
+    double normal[3];
+    /** area weighted centroid of the triangles beneath */
+    double center[3];
+    /** radius of a sphere around center enclosing the node box */
+    double radius;
+    /** surface the node belongs to, 0 for the nodes of volume trees */
+    int32_t surf;
+  };
+
+  /** point the query view at the arrays owned by this object */
+  void bind();
+
+  /** compute windingNodes from the bound hierarchy */
+  ErrorCode build_winding_data();
+
+  /** Compute the winding data of the node at node_idx of surface surf_idx
+   *  and of those beneath it, returning the area of its triangles */
+  ErrorCode winding_moments(int node_idx, int32_t surf_idx, double& area);
+
+  /** refit the box of the node at node_idx and those beneath it, links
+   *  take the box of their (already refit) target */
+  ErrorCode refit_node(int node_idx, double lower[3], double upper[3]);
+
+  /** re-read and re-pack the triangles of a leaf, returning their box */
+  ErrorCode refit_leaf(int first, int count, double lower[3],
+                       double upper[3]);
+
+  /** set the box of a node, rounding outwards in single precision */
+  void set_node_box(int node_idx, const double lower[3],
+                    const double upper[3]);
+
+  /** get the first and count fields of a node of either precision */
+  void node_links(int node_idx, int32_t& first, int32_t& count) const;
+
+  /** size the per-entity arrays and record the senses of each surface */
+  ErrorCode init_topology(GeomTopoTool* gtt,
+                          const std::vector<EntityHandle>& surfs,
+                          const std::vector<EntityHandle>& vols);
+
+  /** read the vertex coordinates of triangles, appending them to coords */
+  ErrorCode read_triangles(const std::vector<EntityHandle>& tris,
+                           std::vector<double>& coords);
+
+  /** Build the trees of the surfaces from triangles listed in surface order,
+   *  surf_begin[i] being the first triangle of surface i */
+  void build_surface_trees(const std::vector<double>& coords,
+                           const std::vector<EntityHandle>& handles,
+                           const std::vector<int32_t>& surf_begin,
+                           int num_threads);
+
+  /** store a triangle in the next free slot */
+  void add_triangle(const double coords[9], EntityHandle handle,
+                    int32_t surf_idx);
+
+  /** pad the triangle slots to a whole number of blocks */
+  void pad_triangles();
+
+  /** convert the nodes and triangles to single precision */
+  void to_single();
+
+  /** copy the OBB tree below set into the node at node_idx */
+  ErrorCode flatten(EntityHandle set, int node_idx, int surf_idx, int depth);
+
+  /** test a ray against the (tolerance expanded) box of a node */
+  template <typename NodeT>
+  bool ray_box(const NodeT& node, const double point[3], const double inv[3],
+               double t_min, double t_max, double tol, double& t_enter) const;
+
+  /** Visit the leaves of the tree below root whose boxes the ray enters
+   *  within [t_min, t_max]; visit may shrink t_max as hits are found */
+  template <typename Visitor>
+  void traverse(int root, const double point[3], const double dir[3],
+                double t_min, const double& t_max, double tol,
+                Visitor visit) const {
+    traverse(&root, 1, point, dir, t_min, t_max, tol, visit, nullptr,
+             nullptr);
+  }
+
+  /** Visit the leaves below num_roots (at most MAX_FRONTIER) roots, the
+   *  first visited first. If frontier is given, the nodes beyond t_max and
+   *  the leaves visited are appended to it; if counts is given, the nodes,
+   *  leaves and triangle slots visited are added to it. */
+  template <typename Visitor>
+  void traverse(const int32_t* roots, int num_roots, const double point[3],
+                const double dir[3], double t_min, const double& t_max,
+                double tol, Visitor visit, std::vector<int32_t>* frontier,
+                QueryStats::Counts* counts) const;
+
+  /** traverse() over the nodes of either precision */
+  template <typename NodeT, typename Visitor>
+  void traverse_nodes(const NodeT* tree, const int32_t* roots, int num_roots,
+                      const double point[3], const double dir[3],
+                      double t_min, const double& t_max, double tol,
+                      Visitor visit, std::vector<int32_t>* frontier,
+                      QueryStats::Counts* counts) const;
+
+  /** Visit the leaves below root whose boxes any of the rays of a packet
+   *  enters within the window of that ray, calling visit(ray, begin, end)
+   *  for each such ray; visit may shrink the windows as hits are found */
+  template <typename NodeT, typename Visitor>
+  void traverse_packet(const NodeT* tree, int root, int num_rays,
+                       const double (*points)[3], const double (*dirs)[3],
+                       const FireWindow* windows, double tol, Visitor visit,
+                       QueryStats::Counts* counts) const;
+
+  /** true if a hit of triangle slot t by a ray fired in a volume along dir
+   *  with the given orientation and history is to be reported */
+  bool accept_hit(int t, int vol_idx, const double dir[3], int orientation,
+                  const RayHistory* history) const;
+
+  /** the surface hit and its distance of a ray fired with window, adding
+   *  the triangle hit to history */
+  void fire_result(const FireWindow& window, RayHistory* history,
+                   int& next_surf_idx, double& next_surf_dist) const;
+
+  /** Find the slot of a Frontier to resume a ray in a volume from, or to
+   *  record it in; resume is set if the slot's nodes can be resumed from */
+  Frontier::Slot& frontier_slot(Frontier& frontier, int vol_idx,
+                                const double point[3], const double dir[3],
+                                double t_min, double tol, bool& resume) const;
+
+  /** get the box of a node */
+  void node_box(int node_idx, double lower[3], double upper[3]) const;
+
+  /** add the counters of one complement ray to complementCounts */
+  void count_complement(const ComplementStats& counts) const;
+
+  /** Intersect a ray with the triangles of a leaf, calling visit(t, dist)
+   *  for every triangle slot hit within [t_min, t_max] */
+  template <typename Visitor>
+  void intersect_leaf(int begin, int end, const RayTriKernel::Ray& ray,
+                      double t_min, double t_max, Visitor visit) const;
+
+  /** get the double precision vertex coordinates of a triangle slot */
+  bool tri_coords(int t, double coords[9]) const;
+
+  /** dot product of the (unnormalized) normal of a triangle with dir */
+  double tri_normal_dot(int t, const double dir[3]) const;
+
+  /** sense of a surface with respect to a volume (1, -1 or 0 for both) */
+  int sense(int surf_idx, int vol_idx) const;
+
+  // moab instance the hierarchy is built from, also used to refine the
+  // candidate hits in single precision mode
+  Interface* mbi = nullptr;
+  // store the hierarchy in single precision
+  bool singlePrecision = false;
+  // compute the winding number data
+  bool windingNumbers = false;
+  // identifies the hierarchy a Frontier was recorded in, changes whenever
+  // the hierarchy is built, loaded or refit
+  uint64_t buildId = 0;
+  // map from surface tree root set to surface index, used while building
+  std::unordered_map<EntityHandle, int> surfRootIdx;
+
+  /** Arrays read by the queries, owned or mapped from a cache file */
+  struct View {
+    bool single = false;
+    const Node* nodes = nullptr;
+    const FloatNode* floatNodes = nullptr;
+    const double* triCoords = nullptr;
+    const float* floatCoords = nullptr;
+    const double* blockAnchors = nullptr;
+    const uint8_t* triEdges = nullptr;
+    const EntityHandle* triHandles = nullptr;
+    const int32_t* triSurfs = nullptr;
+    const int32_t* surfRoots = nullptr;
+    const int32_t* volRoots = nullptr;
+    const int32_t* surfForward = nullptr;
+    const int32_t* surfReverse = nullptr;
+    size_t numNodes = 0;
+    size_t numTris = 0;
+    size_t numSurfs = 0;
+    size_t numVols = 0;
+  };
+  View data;
+  // keeps a mapped cache file or shared memory segment alive
+  std::shared_ptr<const void> mapping;
+
+  // storage of a hierarchy built by this object
+  std::vector<Node> nodes;
+  // vertex coordinates of the triangles in leaf order, packed in blocks by
+  // RayTriKernel::pack(); unused slots are zero
+  std::vector<double> triCoords;
+  // single precision nodes and triangle blocks, the latter relative to the
+  // anchor (3 values) of each block; these replace nodes and triCoords
+  std::vector<FloatNode> floatNodes;
+  std::vector<float> floatCoords;
+  std::vector<double> blockAnchors;
+  // edge flags of each triangle slot, see RayTriKernel::pack()
+  std::vector<uint8_t> triEdges;
+  // originating MOAB triangle of each slot (0 if unused), used for ray
+  // history compatibility
+  std::vector<EntityHandle> triHandles;
+  // DAGMC index of the surface each triangle slot belongs to
+  std::vector<int32_t> triSurfs;
+  // root node of each surface and volume tree, by DAGMC index
+  std::vector<int32_t> surfRoots;
+  std::vector<int32_t> volRoots;
+  // forward and reverse volume index of each surface
+  std::vector<int32_t> surfForward;
+  std::vector<int32_t> surfReverse;
+  // winding number data by node, computed when the hierarchy is built or
+  // loaded rather than stored in the cache file
+  std::vector<WindingNode> windingNodes;
+  // implicit complement index, its boundary surfaces grouped by the volume
+  // on the other side (group i is complementSurfs[complementBegin[i]] up to
+  // complementBegin[i + 1]) and the tree over the boxes of the groups
+  int complementIdx = 0;
+  std::vector<int32_t> complementBegin;
+  std::vector<int32_t> complementSurfs;
+  VolumeTree complementTree;
+  // rays, volumes, surfaces and leaves of ComplementStats
+  mutable std::atomic<uint64_t> complementCounts[4] = {};
+};
+
+}  // namespace moab
+
+#endif
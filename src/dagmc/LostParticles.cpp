@@ -0,0 +1,136 @@
+#include "LostParticles.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace moab {
+
+void LostParticles::add(const Record& record) {
+  std::lock_guard<std::mutex> lock(mutex);
+  numTotal++;
+  if (record.recovered) numRecovered++;
+  if (0 == capacity) return;
+  if (buffer.size() < capacity) {
+    buffer.push_back(record);
+  } else {
+    buffer[next] = record;
+  }
+  next = (next + 1) % capacity;
+}
+
+void LostParticles::clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  buffer.clear();
+  next = 0;
+  numTotal = numRecovered = 0;
+}
+
+uint64_t LostParticles::total() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return numTotal;
+}
+
+uint64_t LostParticles::num_recovered() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return numRecovered;
+}
+
+std::vector<LostParticles::Record> LostParticles::records() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  // until the buffer is full the oldest record is the first
+  if (buffer.size() < capacity) return buffer;
+  std::vector<Record> result(buffer.begin() + next, buffer.end());
+  result.insert(result.end(), buffer.begin(), buffer.begin() + next);
+  return result;
+}
+
+std::vector<LostParticles::Cluster> LostParticles::clusters(
+    double radius) const {
+  std::vector<Record> kept = records();
+  std::vector<Cluster> result;
+  // the first record of each cluster
+  std::vector<const Record*> leaders;
+  for (const Record& record : kept) {
+    size_t c = 0;
+    double dist = 0.0;
+    for (; c < leaders.size(); c++) {
+      dist = 0.0;
+      for (int d = 0; d < 3; d++)
+        dist += (record.xyz[d] - leaders[c]->xyz[d]) *
+                (record.xyz[d] - leaders[c]->xyz[d]);
+      dist = std::sqrt(dist);
+      if (dist <= radius) break;
+    }
+    if (c == leaders.size()) {
+      leaders.push_back(&record);
+      result.emplace_back();
+      std::fill(result.back().center, result.back().center + 3, 0.0);
+      dist = 0.0;
+    }
+
+    Cluster& cluster = result[c];
+    for (int d = 0; d < 3; d++) cluster.center[d] += record.xyz[d];
+    cluster.radius = std::max(cluster.radius, dist);
+    cluster.count++;
+    if (record.recovered) cluster.recovered++;
+    if (std::find(cluster.volumes.begin(), cluster.volumes.end(),
+                  record.volume) == cluster.volumes.end())
+      cluster.volumes.push_back(record.volume);
+    if (record.surface &&
+        std::find(cluster.surfaces.begin(), cluster.surfaces.end(),
+                  record.surface) == cluster.surfaces.end())
+      cluster.surfaces.push_back(record.surface);
+  }
+
+  for (Cluster& cluster : result)
+    for (int d = 0; d < 3; d++) cluster.center[d] /= cluster.count;
+  std::stable_sort(
+      result.begin(), result.end(),
+      [](const Cluster& a, const Cluster& b) { return a.count > b.count; });
+  return result;
+}
+
+void LostParticles::write_report(std::ostream& os, double radius,
+                                 const std::vector<int>& vol_ids,
+                                 const std::vector<int>& surf_ids) const {
+  auto id = [](const std::vector<int>& ids, int idx) {
+    return idx > 0 && (size_t)idx < ids.size() ? ids[idx] : 0;
+  };
+  auto write_ids = [&](const std::vector<int>& ids,
+                       const std::vector<int>& indices) {
+    if (indices.empty()) os << "-";
+    for (size_t i = 0; i < indices.size(); i++)
+      os << (i ? "," : "") << id(ids, indices[i]);
+  };
+
+  std::vector<Record> kept = records();
+  std::vector<Cluster> groups = clusters(radius);
+  os << "# DAGMC lost particle report\n"
+     << "# lost " << total() << ", recovered " << num_recovered() << ", "
+     << kept.size() << " kept in " << groups.size()
+     << " clusters of radius " << radius << "\n"
+     << "# clusters: count recovered x y z radius volume_ids surface_ids\n";
+  for (const Cluster& cluster : groups) {
+    os << "cluster " << cluster.count << " " << cluster.recovered << " "
+       << cluster.center[0] << " " << cluster.center[1] << " "
+       << cluster.center[2] << " " << cluster.radius << " ";
+    write_ids(vol_ids, cluster.volumes);
+    os << " ";
+    write_ids(surf_ids, cluster.surfaces);
+    os << "\n";
+  }
+
+  os << "# records: query x y z u v w volume_id surface_id facet distance "
+        "recovered_volume_id nudge\n";
+  for (const Record& record : kept) {
+    os << "lost " << record.query;
+    for (int d = 0; d < 3; d++) os << " " << record.xyz[d];
+    for (int d = 0; d < 3; d++) os << " " << record.uvw[d];
+    os << " " << id(vol_ids, record.volume) << " "
+       << id(surf_ids, record.surface) << " " << record.facet << " "
+       << record.distance << " " << id(vol_ids, record.recovered) << " "
+       << record.nudge << "\n";
+  }
+}
+
+}  // namespace moab
@@ -0,0 +1,103 @@
+#ifndef DAGMC_LOSTPARTICLES_HPP
+#define DAGMC_LOSTPARTICLES_HPP
+
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "moab/Types.hpp"
+
+namespace moab {
+
+/**\brief Ring buffer of the particles lost by the geometry queries
+ *
+ * Keeps the most recent lost particles, with what was known about them when
+ * they were lost and the outcome of the attempt to recover them, so that
+ * the geometry defects causing them can be found from a report written at
+ * the end of the run rather than by rerunning the job. Nearby losses are
+ * grouped into clusters in the report, as a defect usually loses many
+ * particles in the same place. Records may be added from any thread.
+ */
+class LostParticles {
+ public:
+  struct Record {
+    /** location and direction of the particle */
+    double xyz[3];
+    double uvw[3];
+    /** index of the volume the particle was lost in */
+    int volume = 0;
+    /** the query that failed */
+    std::string query;
+    /** index of the nearest surface of the volume, 0 if not known */
+    int surface = 0;
+    /** the nearest facet of the volume, 0 if not known */
+    EntityHandle facet = 0;
+    /** distance to the nearest facet, negative if not known */
+    double distance = -1.0;
+    /** index of the volume the particle was found in, 0 if not recovered */
+    int recovered = 0;
+    /** distance the particle was moved along uvw to find that volume */
+    double nudge = 0.0;
+  };
+
+  /** a group of records near each other */
+  struct Cluster {
+    /** mean location of the records */
+    double center[3];
+    /** largest distance of a record from the first of the cluster */
+    double radius = 0.0;
+    int count = 0;
+    int recovered = 0;
+    /** indices of the volumes lost in and of the nearest surfaces */
+    std::vector<int> volumes;
+    std::vector<int> surfaces;
+  };
+
+  /**\param capacity number of records kept, older ones are overwritten */
+  explicit LostParticles(size_t capacity = 1024) : capacity(capacity) {}
+
+  /** add a record, overwriting the oldest if the buffer is full */
+  void add(const Record& record);
+
+  /** forget all records and counts */
+  void clear();
+
+  /** number of records added since the last clear(), including those
+   *  overwritten */
+  uint64_t total() const;
+
+  /** number of those records that were recovered */
+  uint64_t num_recovered() const;
+
+  /** the records kept, oldest first */
+  std::vector<Record> records() const;
+
+  /** Group the records kept: each record joins the first cluster whose
+   *  first record is within radius of it. Largest clusters first. */
+  std::vector<Cluster> clusters(double radius) const;
+
+  /**\brief Write a text report of the clusters and records kept
+   *
+   *\param radius cluster radius, see clusters()
+   *\param vol_ids, surf_ids global ids by index, used to name the volumes
+   *       and surfaces
+   */
+  void write_report(std::ostream& os, double radius,
+                    const std::vector<int>& vol_ids,
+                    const std::vector<int>& surf_ids) const;
+
+ private:
+  size_t capacity;
+  mutable std::mutex mutex;
+  /** the ring buffer, next is the slot the next record goes in */
+  std::vector<Record> buffer;
+  size_t next = 0;
+  uint64_t numTotal = 0;
+  uint64_t numRecovered = 0;
+};
+
+}  // namespace moab
+
+#endif
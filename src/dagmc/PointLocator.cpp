@@ -0,0 +1,234 @@
+#include "PointLocator.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace moab {
+
+ErrorCode PointLocator::build(Interface* mbi,
+                              const std::vector<EntityHandle>& surfs,
+                              const std::vector<int>& surf_vols,
+                              int max_cells, double tol) {
+  clear();
+  maxCells = max_cells;
+
+  // read the triangles of every surface
+  std::vector<std::vector<double>> surf_coords(surfs.size());
+  double lower[3], upper[3];
+  for (int d = 0; d < 3; d++) {
+    lower[d] = std::numeric_limits<double>::max();
+    upper[d] = -std::numeric_limits<double>::max();
+  }
+  for (size_t i = 1; i < surfs.size(); i++) {
+    std::vector<EntityHandle> tris, conn;
+    ErrorCode rval = mbi->get_entities_by_type(surfs[i], MBTRI, tris);
+    MB_CHK_SET_ERR(rval, "Failed to get the triangles of surface " << i);
+    if (tris.empty()) continue;
+    rval = mbi->get_connectivity(tris.data(), tris.size(), conn);
+    MB_CHK_SET_ERR(rval, "Failed to get the triangle connectivity");
+    std::vector<double>& coords = surf_coords[i];
+    coords.resize(3 * conn.size());
+    rval = mbi->get_coords(conn.data(), conn.size(), coords.data());
+    MB_CHK_SET_ERR(rval, "Failed to get the triangle coordinates");
+    for (size_t j = 0; j < coords.size(); j += 3) {
+      for (int d = 0; d < 3; d++) {
+        lower[d] = std::min(lower[d], coords[j + d]);
+        upper[d] = std::max(upper[d], coords[j + d]);
+      }
+    }
+  }
+  if (lower[0] > upper[0]) {
+    MB_SET_ERR(MB_ENTITY_NOT_FOUND, "The model has no triangles");
+  }
+
+  double extent[3];
+  for (int d = 0; d < 3; d++) {
+    lower[d] -= 2.0 * tol;
+    upper[d] += 2.0 * tol;
+    extent[d] = upper[d] > lower[d] ? upper[d] - lower[d] : 1.0;
+  }
+
+  // cells as close to cubic as possible; axes along which the model is
+  // thinner than a cell get a single layer of cells
+  double size = 0.0;
+  bool thin[3] = {false, false, false};
+  for (int pass = 0; pass < 3; pass++) {
+    double free_volume = 1.0;
+    int num_free = 0;
+    for (int d = 0; d < 3; d++) {
+      if (thin[d]) continue;
+      free_volume *= extent[d];
+      num_free++;
+    }
+    if (0 == num_free) break;
+    size = std::pow(free_volume / std::max(1, max_cells), 1.0 / num_free);
+
+    bool changed = false;
+    for (int d = 0; d < 3; d++) {
+      if (!thin[d] && extent[d] < size) thin[d] = changed = true;
+    }
+    if (!changed) break;
+  }
+  for (int d = 0; d < 3; d++) {
+    dims[d] = thin[d] ? 1 : std::max(1, (int)(extent[d] / size));
+    gridLower[d] = lower[d];
+    cellSize[d] = extent[d] / dims[d];
+  }
+  int num_cells = dims[0] * dims[1] * dims[2];
+
+  // bin the expanded box of every triangle, one entry per surface and cell
+  std::vector<std::pair<int, int>> cell_surfs;
+  std::vector<int> cells;
+  for (size_t i = 1; i < surfs.size(); i++) {
+    const std::vector<double>& coords = surf_coords[i];
+    cells.clear();
+    for (size_t j = 0; j < coords.size(); j += 9) {
+      double tri_lower[3], tri_upper[3];
+      for (int d = 0; d < 3; d++) {
+        tri_lower[d] =
+            std::min({coords[j + d], coords[j + 3 + d], coords[j + 6 + d]});
+        tri_upper[d] =
+            std::max({coords[j + d], coords[j + 3 + d], coords[j + 6 + d]});
+        tri_lower[d] -= tol;
+        tri_upper[d] += tol;
+      }
+      int first[3], last[3];
+      if (!cell_range(tri_lower, tri_upper, first, last)) continue;
+      for (int z = first[2]; z <= last[2]; z++)
+        for (int y = first[1]; y <= last[1]; y++)
+          for (int x = first[0]; x <= last[0]; x++)
+            cells.push_back((z * dims[1] + y) * dims[0] + x);
+    }
+    std::sort(cells.begin(), cells.end());
+    cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+    for (int cell : cells) cell_surfs.emplace_back(cell, i);
+  }
+
+  // the candidates of a cell are the volumes on either side of its surfaces
+  std::vector<std::pair<int, int>> cell_vols;
+  cell_vols.reserve(2 * cell_surfs.size());
+  cellRegion.assign(num_cells, 0);
+  for (const auto& entry : cell_surfs) {
+    cellRegion[entry.first] = -1;
+    for (int side = 0; side < 2; side++) {
+      int vol_idx = surf_vols[2 * entry.second + side];
+      if (vol_idx) cell_vols.emplace_back(entry.first, vol_idx);
+    }
+  }
+  std::vector<std::pair<int, int>>().swap(cell_surfs);
+  std::sort(cell_vols.begin(), cell_vols.end());
+  cell_vols.erase(std::unique(cell_vols.begin(), cell_vols.end()),
+                  cell_vols.end());
+
+  cellBegin.assign(num_cells + 1, 0);
+  cellVols.resize(cell_vols.size());
+  for (size_t i = 0; i < cell_vols.size(); i++) {
+    cellBegin[cell_vols[i].first + 1]++;
+    cellVols[i] = cell_vols[i].second;
+  }
+  for (int c = 0; c < num_cells; c++) cellBegin[c + 1] += cellBegin[c];
+
+  find_regions();
+  return MB_SUCCESS;
+}
+
+void PointLocator::find_regions() {
+  int num_cells = cellRegion.size();
+  // mark the free cells as unvisited
+  for (int c = 0; c < num_cells; c++)
+    if (cellRegion[c] == 0) cellRegion[c] = -2;
+
+  std::vector<int> stack;
+  for (int c = 0; c < num_cells; c++) {
+    if (cellRegion[c] != -2) continue;
+
+    int region = regionCells.size();
+    regionCells.push_back(c);
+    cellRegion[c] = region;
+    stack.push_back(c);
+    while (!stack.empty()) {
+      int cell = stack.back();
+      stack.pop_back();
+      int ijk[3] = {cell % dims[0], (cell / dims[0]) % dims[1],
+                    cell / (dims[0] * dims[1])};
+      int stride[3] = {1, dims[0], dims[0] * dims[1]};
+      for (int d = 0; d < 3; d++) {
+        if (ijk[d] > 0 && cellRegion[cell - stride[d]] == -2) {
+          cellRegion[cell - stride[d]] = region;
+          stack.push_back(cell - stride[d]);
+        }
+        if (ijk[d] + 1 < dims[d] && cellRegion[cell + stride[d]] == -2) {
+          cellRegion[cell + stride[d]] = region;
+          stack.push_back(cell + stride[d]);
+        }
+      }
+    }
+  }
+  regionVols.assign(regionCells.size(), 0);
+}
+
+void PointLocator::clear() {
+  maxCells = 0;
+  dims[0] = dims[1] = dims[2] = 0;
+  cellRegion.clear();
+  cellBegin.clear();
+  cellVols.clear();
+  regionCells.clear();
+  regionVols.clear();
+}
+
+void PointLocator::region_point(int region, double xyz[3]) const {
+  int cell = regionCells[region];
+  int ijk[3] = {cell % dims[0], (cell / dims[0]) % dims[1],
+                cell / (dims[0] * dims[1])};
+  for (int d = 0; d < 3; d++)
+    xyz[d] = gridLower[d] + (ijk[d] + 0.5) * cellSize[d];
+}
+
+int PointLocator::locate(const double xyz[3], const int*& candidates,
+                         int& num_candidates) const {
+  num_candidates = 0;
+  int cell = cell_index(xyz);
+  if (cell < 0) return 0;
+
+  int region = cellRegion[cell];
+  if (region >= 0) return regionVols[region];
+
+  candidates = cellVols.data() + cellBegin[cell];
+  num_candidates = cellBegin[cell + 1] - cellBegin[cell];
+  return 0;
+}
+
+size_t PointLocator::memory_use() const {
+  return sizeof(int) * (cellRegion.size() + cellBegin.size() +
+                        cellVols.size() + regionCells.size() +
+                        regionVols.size());
+}
+
+int PointLocator::cell_index(const double xyz[3]) const {
+  if (empty()) return -1;
+
+  int ijk[3];
+  for (int d = 0; d < 3; d++) {
+    double x = (xyz[d] - gridLower[d]) / cellSize[d];
+    // also rejects NaN
+    if (!(x >= 0.0 && x < dims[d])) return -1;
+    ijk[d] = std::min((int)x, dims[d] - 1);
+  }
+  return (ijk[2] * dims[1] + ijk[1]) * dims[0] + ijk[0];
+}
+
+bool PointLocator::cell_range(const double lower[3], const double upper[3],
+                              int first[3], int last[3]) const {
+  for (int d = 0; d < 3; d++) {
+    double lo = std::floor((lower[d] - gridLower[d]) / cellSize[d]);
+    double hi = std::floor((upper[d] - gridLower[d]) / cellSize[d]);
+    if (hi < 0.0 || lo >= dims[d]) return false;
+    first[d] = lo < 0.0 ? 0 : (int)lo;
+    last[d] = hi >= dims[d] ? dims[d] - 1 : (int)hi;
+  }
+  return true;
+}
+
+}  // namespace moab
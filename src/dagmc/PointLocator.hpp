@@ -0,0 +1,103 @@
+#ifndef DAGMC_POINTLOCATOR_HPP
+#define DAGMC_POINTLOCATOR_HPP
+
+#include <vector>
+
+#include "moab/Interface.hpp"
+
+namespace moab {
+
+/**\brief Uniform grid used to find the volume containing a point
+ *
+ * Every cell of the grid lists the volumes on either side of the surfaces
+ * whose triangles overlap the cell. Volumes do not overlap, so a point in
+ * such a cell lies in one of the volumes listed for it and only those need
+ * to be tested. A cell overlapped by no triangle lies entirely within one
+ * volume; face-connected cells free of triangles form regions that are each
+ * located once, when the grid is built, so points falling in them are
+ * located without firing any rays.
+ *
+ * Volumes are referred to by their DAGMC (1-based) index. Queries only read
+ * the grid and are safe to call concurrently.
+ */
+class PointLocator {
+ public:
+  /**\brief Bin the triangles of all surfaces into the grid
+   *
+   * The grid covers the bounding box of the triangles with cells as close
+   * to cubic as possible. Afterwards every region of cells free of triangles
+   * must be located with set_region_volume().
+   *
+   *\param surfs surface handles by DAGMC index (entry 0 unused)
+   *\param surf_vols index of the volume on the forward (2 * i) and reverse
+   *       (2 * i + 1) side of surface i, 0 if none
+   *\param max_cells upper bound on the number of cells in the grid
+   *\param tol distance by which the triangles are expanded when binned
+   */
+  ErrorCode build(Interface* mbi, const std::vector<EntityHandle>& surfs,
+                  const std::vector<int>& surf_vols, int max_cells, double tol);
+
+  /** release all storage */
+  void clear();
+
+  /** true if the grid has been built */
+  bool empty() const { return cellRegion.empty(); }
+
+  /** number of regions of cells free of triangles */
+  int num_regions() const { return regionCells.size(); }
+
+  /** a point of a region, at least half a cell away from every triangle */
+  void region_point(int region, double xyz[3]) const;
+
+  /** record the index of the volume a region lies in, 0 if unknown */
+  void set_region_volume(int region, int vol_idx) {
+    regionVols[region] = vol_idx;
+  }
+
+  /**\brief Find the volumes that may contain a point
+   *
+   *\param candidates output, the volumes the point may lie in, in order of
+   *       increasing index; only set if 0 is returned
+   *\param num_candidates output, number of candidates, 0 if the point is
+   *       outside the grid or the volume of its region is unknown
+   *\return the index of the volume containing the point if it lies in a
+   *        region free of triangles, otherwise 0
+   */
+  int locate(const double xyz[3], const int*& candidates,
+             int& num_candidates) const;
+
+  /** the max_cells the grid was built with */
+  int max_cells() const { return maxCells; }
+
+  /** approximate size of the grid in bytes */
+  size_t memory_use() const;
+
+ private:
+  /** index of the cell containing a point, -1 if outside the grid */
+  int cell_index(const double xyz[3]) const;
+
+  /** range of cells overlapped by a box, false if it misses the grid */
+  bool cell_range(const double lower[3], const double upper[3], int first[3],
+                  int last[3]) const;
+
+  /** label the face-connected regions of cells free of triangles */
+  void find_regions();
+
+  int maxCells = 0;
+  double gridLower[3];
+  double cellSize[3];
+  int dims[3] = {0, 0, 0};
+
+  /** region of each cell, -1 for cells overlapped by triangles */
+  std::vector<int> cellRegion;
+  /** offsets of the candidates of each cell in cellVols */
+  std::vector<int> cellBegin;
+  std::vector<int> cellVols;
+  /** first cell and volume index of each region */
+  std::vector<int> regionCells;
+  std::vector<int> regionVols;
+};
+
+}  // namespace moab
+
+#endif
@@ -0,0 +1,104 @@
+#include "QueryStats.hpp"
+
+namespace moab {
+
+const int QueryStats::NUM_BINS;
+
+void QueryStats::resize(size_t num_vols) {
+  numVols = num_vols;
+  counters.reset(new Counters[num_vols * NUM_QUERIES]);
+  reset();
+}
+
+void QueryStats::reset() {
+  for (size_t i = 0; i < numVols * NUM_QUERIES; i++) {
+    Counters& c = counters[i];
+    c.calls = c.nanoseconds = c.nodes = c.leaves = c.triangles = 0;
+    for (auto& bin : c.bins) bin = 0;
+  }
+}
+
+void QueryStats::record(int vol_idx, Query query, uint64_t nanoseconds,
+                        const Counts& counts, uint64_t num_calls) {
+  if (vol_idx <= 0 || (size_t)vol_idx >= numVols || 0 == num_calls) return;
+  Counters& c = counters[vol_idx * NUM_QUERIES + query];
+  const std::memory_order relaxed = std::memory_order_relaxed;
+  c.calls.fetch_add(num_calls, relaxed);
+  c.nanoseconds.fetch_add(nanoseconds, relaxed);
+  if (counts.nodes) c.nodes.fetch_add(counts.nodes, relaxed);
+  if (counts.leaves) c.leaves.fetch_add(counts.leaves, relaxed);
+  if (counts.triangles) c.triangles.fetch_add(counts.triangles, relaxed);
+
+  // calls made together are binned by their mean duration
+  int bin = 0;
+  for (uint64_t mean = nanoseconds / num_calls; mean >>= 1;) bin++;
+  c.bins[bin < NUM_BINS ? bin : NUM_BINS - 1].fetch_add(num_calls, relaxed);
+}
+
+uint64_t QueryStats::calls(int vol_idx, Query query) const {
+  if (vol_idx <= 0 || (size_t)vol_idx >= numVols) return 0;
+  return at(vol_idx, query).calls.load(std::memory_order_relaxed);
+}
+
+QueryStats::Counts QueryStats::counts(int vol_idx, Query query) const {
+  Counts result;
+  if (vol_idx <= 0 || (size_t)vol_idx >= numVols) return result;
+  const Counters& c = at(vol_idx, query);
+  result.nodes = c.nodes.load(std::memory_order_relaxed);
+  result.leaves = c.leaves.load(std::memory_order_relaxed);
+  result.triangles = c.triangles.load(std::memory_order_relaxed);
+  return result;
+}
+
+const char* QueryStats::name(Query query) {
+  switch (query) {
+    case RAY_FIRE:
+      return "ray_fire";
+    case POINT_IN_VOLUME:
+      return "point_in_volume";
+    case POINT_IN_VOLUME_SLOW:
+      return "point_in_volume_slow";
+    case CLOSEST_TO_LOCATION:
+      return "closest_to_location";
+    default:
+      return "unknown";
+  }
+}
+
+void QueryStats::write_json(std::ostream& os,
+                            const std::vector<int>& ids) const {
+  os << "{\n  \"histogram_bins\": \"bin b counts calls taking [2^b, "
+        "2^(b+1)) ns\",\n  \"volumes\": [";
+  bool first_vol = true;
+  for (size_t i = 1; i < numVols; i++) {
+    bool any = false;
+    for (int q = 0; q < NUM_QUERIES; q++)
+      any = any || calls(i, Query(q)) > 0;
+    if (!any) continue;
+
+    os << (first_vol ? "\n" : ",\n") << "    {\"index\": " << i
+       << ", \"id\": " << (i < ids.size() ? ids[i] : 0);
+    first_vol = false;
+    for (int q = 0; q < NUM_QUERIES; q++) {
+      const Counters& c = at(i, Query(q));
+      uint64_t num_calls = c.calls.load(std::memory_order_relaxed);
+      if (!num_calls) continue;
+      os << ",\n     \"" << name(Query(q)) << "\": {\"calls\": " << num_calls
+         << ", \"seconds\": " << 1e-9 * c.nanoseconds.load()
+         << ", \"nodes\": " << c.nodes.load()
+         << ", \"leaves\": " << c.leaves.load()
+         << ", \"triangles\": " << c.triangles.load()
+         << ", \"histogram\": [";
+      // trailing empty bins are left out
+      int num_bins = NUM_BINS;
+      while (num_bins > 0 && !c.bins[num_bins - 1].load()) num_bins--;
+      for (int b = 0; b < num_bins; b++)
+        os << (b ? ", " : "") << c.bins[b].load();
+      os << "]}";
+    }
+    os << "}";
+  }
+  os << (first_vol ? "]\n}\n" : "\n  ]\n}\n");
+}
+
+}  // namespace moab
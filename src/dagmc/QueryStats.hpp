@@ -0,0 +1,90 @@
+#ifndef DAGMC_QUERYSTATS_HPP
+#define DAGMC_QUERYSTATS_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+namespace moab {
+
+/**\brief Per-volume counters and timings of the geometry queries
+ *
+ * For each volume and kind of query, counts the calls, their total time,
+ * the nodes, leaves and triangles visited by their traversals and a
+ * histogram of their durations, bin b counting the calls that took
+ * [2^b, 2^(b+1)) nanoseconds. The counters are relaxed atomics, so any
+ * number of threads may record concurrently.
+ */
+class QueryStats {
+ public:
+  enum Query {
+    RAY_FIRE,
+    POINT_IN_VOLUME,
+    POINT_IN_VOLUME_SLOW,
+    CLOSEST_TO_LOCATION,
+    NUM_QUERIES
+  };
+
+  /** number of histogram bins, the last also counts longer calls */
+  static const int NUM_BINS = 32;
+
+  /** traversal work done by one query */
+  struct Counts {
+    uint64_t nodes = 0;
+    uint64_t leaves = 0;
+    uint64_t triangles = 0;
+  };
+
+  /** discard all counters and size them for num_vols volumes (by DAGMC
+   *  index, entry 0 unused) */
+  void resize(size_t num_vols);
+
+  /** number of volumes the counters are sized for */
+  size_t size() const { return numVols; }
+
+  /** zero all counters */
+  void reset();
+
+  /** record num_calls calls made together, taking nanoseconds and doing
+   *  the work of counts in all; calls for volumes out of range are ignored */
+  void record(int vol_idx, Query query, uint64_t nanoseconds,
+              const Counts& counts, uint64_t num_calls = 1);
+
+  /** number of calls of a query recorded for a volume */
+  uint64_t calls(int vol_idx, Query query) const;
+
+  /** total traversal work of a query recorded for a volume */
+  Counts counts(int vol_idx, Query query) const;
+
+  /** name of a query as used in the JSON output */
+  static const char* name(Query query);
+
+  /**\brief Write the counters of every volume with any calls as JSON
+   *
+   *\param ids the global id of each volume, by DAGMC index
+   */
+  void write_json(std::ostream& os, const std::vector<int>& ids) const;
+
+ private:
+  struct Counters {
+    std::atomic<uint64_t> calls;
+    std::atomic<uint64_t> nanoseconds;
+    std::atomic<uint64_t> nodes;
+    std::atomic<uint64_t> leaves;
+    std::atomic<uint64_t> triangles;
+    std::atomic<uint64_t> bins[NUM_BINS];
+  };
+
+  const Counters& at(int vol_idx, Query query) const {
+    return counters[vol_idx * NUM_QUERIES + query];
+  }
+
+  size_t numVols = 0;
+  std::unique_ptr<Counters[]> counters;
+};
+
+}  // namespace moab
+
+#endif
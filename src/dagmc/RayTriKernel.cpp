@@ -0,0 +1,582 @@
+#include "RayTriKernel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <limits>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define DAGMC_RAYTRI_X86
+#include <immintrin.h>
+#endif
+
+namespace moab {
+
+namespace RayTriKernel {
+
+// Plucker coordinates smaller than this are taken to be zero (as in MOAB)
+static const double NEAR_ZERO = 10 * std::numeric_limits<double>::epsilon();
+
+// bound on the rounding errors of a single precision Plucker coordinate,
+// relative to the extents of the edge and of the ray origin in the block frame
+static const float SINGLE_TOL = 32 * std::numeric_limits<float>::epsilon();
+// single precision Plucker coordinates at most this large may be zero in
+// double precision
+static const float SINGLE_FLOOR = 4 * NEAR_ZERO;
+
+// MOAB's ordering of the vertices of an edge
+static bool first(const double a[3], const double b[3]) {
+  if (a[0] != b[0]) return a[0] < b[0];
+  if (a[1] != b[1]) return a[1] < b[1];
+  return a[2] < b[2];
+}
+
+Ray::Ray(const double ray_origin[3], const double direction[3]) {
+  for (int d = 0; d < 3; d++) {
+    origin[d] = ray_origin[d];
+    dir[d] = direction[d];
+  }
+  moment[0] = dir[1] * origin[2] - dir[2] * origin[1];
+  moment[1] = dir[2] * origin[0] - dir[0] * origin[2];
+  moment[2] = dir[0] * origin[1] - dir[1] * origin[0];
+
+  // to minimize numerical error, the distance is measured along the largest
+  // component of the direction
+  axis = 0;
+  for (int d = 1; d < 3; d++)
+    if (std::fabs(dir[d]) > std::fabs(dir[axis])) axis = d;
+}
+
+// bit e is set if vertex e is first on the edge from vertex e to e + 1
+static uint8_t edge_flags_of(const double coords[9]) {
+  uint8_t flags = 0;
+  for (int e = 0; e < 3; e++) {
+    if (first(coords + 3 * e, coords + 3 * ((e + 1) % 3))) flags |= 1 << e;
+  }
+  return flags;
+}
+
+void pack(double* block, uint8_t* edge_flags, int lane,
+          const double coords[9]) {
+  for (int c = 0; c < 9; c++) block[c * BLOCK + lane] = coords[c];
+  edge_flags[lane] = edge_flags_of(coords);
+}
+
+void pack(float* block, const double anchor[3], uint8_t* edge_flags, int lane,
+          const double coords[9]) {
+  for (int c = 0; c < 9; c++)
+    block[c * BLOCK + lane] = coords[c] - anchor[c % 3];
+  edge_flags[lane] = edge_flags_of(coords);
+}
+
+void unpack(const double* block, int lane, double coords[9]) {
+  for (int c = 0; c < 9; c++) coords[c] = block[c * BLOCK + lane];
+}
+
+// Plucker coordinate of the ray with respect to the edge from a to b
+static double edge_test(const double a[3], const double b[3], bool a_first,
+                        const Ray& ray) {
+  const double* start = a_first ? a : b;
+  const double* end = a_first ? b : a;
+  double edge[3] = {end[0] - start[0], end[1] - start[1], end[2] - start[2]};
+  double normal[3] = {edge[1] * start[2] - edge[2] * start[1],
+                      edge[2] * start[0] - edge[0] * start[2],
+                      edge[0] * start[1] - edge[1] * start[0]};
+  double pip = (ray.dir[0] * normal[0] + ray.dir[1] * normal[1] +
+                ray.dir[2] * normal[2]) +
+               (ray.moment[0] * edge[0] + ray.moment[1] * edge[1] +
+                ray.moment[2] * edge[2]);
+  if (!a_first) pip = -pip;
+  if (NEAR_ZERO > std::fabs(pip)) pip = 0.0;
+  return pip;
+}
+
+static bool intersect_lane(const double coords[9], uint8_t edge_flags,
+                           const Ray& ray, double t_min, double t_max,
+                           double& dist) {
+  double pc[3];
+  for (int e = 0; e < 3; e++) {
+    pc[e] = edge_test(coords + 3 * e, coords + 3 * ((e + 1) % 3),
+                      edge_flags & (1 << e), ray);
+  }
+
+  // all Plucker coordinates must have the same sign, and not all be zero
+  bool pos = pc[0] > 0 || pc[1] > 0 || pc[2] > 0;
+  bool neg = pc[0] < 0 || pc[1] < 0 || pc[2] < 0;
+  if (pos == neg) return false;
+
+  const double inverse_sum = 1.0 / (pc[0] + pc[1] + pc[2]);
+  const int ax = ray.axis;
+  double intersection = pc[0] * inverse_sum * coords[6 + ax] +
+                        pc[1] * inverse_sum * coords[ax] +
+                        pc[2] * inverse_sum * coords[3 + ax];
+  dist = (intersection - ray.origin[ax]) / ray.dir[ax];
+  return dist >= t_min && dist <= t_max;
+}
+
+static unsigned intersect_scalar(const double* block,
+                                 const uint8_t* edge_flags, const Ray& ray,
+                                 double t_min, double t_max,
+                                 double dists[BLOCK]) {
+  unsigned mask = 0;
+  for (int lane = 0; lane < BLOCK; lane++) {
+    double coords[9];
+    unpack(block, lane, coords);
+    if (intersect_lane(coords, edge_flags[lane], ray, t_min, t_max,
+                       dists[lane]))
+      mask |= 1u << lane;
+  }
+  return mask;
+}
+
+bool intersect_triangle(const double coords[9], const Ray& ray, double t_min,
+                        double t_max, double& dist) {
+  return intersect_lane(coords, edge_flags_of(coords), ray, t_min, t_max,
+                        dist);
+}
+
+// clamp a distance limit to the range of float
+static float to_float(double t) {
+  const double max = std::numeric_limits<float>::max();
+  if (t > max) return std::numeric_limits<float>::infinity();
+  if (t < -max) return -std::numeric_limits<float>::infinity();
+  return t;
+}
+
+// a ray and search window in the single precision frame of a block
+struct FloatRay {
+  FloatRay(const Ray& ray, const double anchor[3], double min, double max)
+      : t_min(to_float(min)), t_max(to_float(max)) {
+    for (int d = 0; d < 3; d++) {
+      origin[d] = ray.origin[d] - anchor[d];
+      dir[d] = ray.dir[d];
+    }
+    dir_norm = std::fabs(dir[0]) + std::fabs(dir[1]) + std::fabs(dir[2]);
+    origin_norm =
+        std::fabs(origin[0]) + std::fabs(origin[1]) + std::fabs(origin[2]);
+  }
+
+  float origin[3];
+  float dir[3];
+  // L1 norms of dir and origin
+  float dir_norm;
+  float origin_norm;
+  float t_min;
+  float t_max;
+};
+
+static unsigned candidates_scalar(const float* block, const double anchor[3],
+                                  const uint8_t* edge_flags, const Ray& ray,
+                                  double t_min, double t_max) {
+  const FloatRay r(ray, anchor, t_min, t_max);
+  const float tol_scale = SINGLE_TOL * r.dir_norm;
+  unsigned mask = 0;
+  for (int lane = 0; lane < BLOCK; lane++) {
+    float c[9];
+    for (int k = 0; k < 9; k++) c[k] = block[k * BLOCK + lane];
+
+    // the Plucker coordinate of the edge is dir . (edge x (start - origin));
+    // it is only known to be positive or negative if it exceeds the bound on
+    // its rounding error (or the tolerance of the double precision test)
+    float pc[3];
+    float bound = 0;
+    bool pos = false, neg = false;
+    for (int e = 0; e < 3; e++) {
+      const float* a = c + 3 * e;
+      const float* b = c + 3 * ((e + 1) % 3);
+      bool a_first = edge_flags[lane] & (1 << e);
+      const float* start = a_first ? a : b;
+      const float* end = a_first ? b : a;
+      float edge[3] = {end[0] - start[0], end[1] - start[1], end[2] - start[2]};
+      float arm[3] = {start[0] - r.origin[0], start[1] - r.origin[1],
+                      start[2] - r.origin[2]};
+      float normal[3] = {edge[1] * arm[2] - edge[2] * arm[1],
+                         edge[2] * arm[0] - edge[0] * arm[2],
+                         edge[0] * arm[1] - edge[1] * arm[0]};
+      float pip = r.dir[0] * normal[0] + r.dir[1] * normal[1] +
+                  r.dir[2] * normal[2];
+      if (!a_first) pip = -pip;
+
+      float start_norm =
+          std::fabs(start[0]) + std::fabs(start[1]) + std::fabs(start[2]);
+      float edge_norm =
+          std::fabs(edge[0]) + std::fabs(edge[1]) + std::fabs(edge[2]);
+      float tol = tol_scale * (start_norm + edge_norm) *
+                      (start_norm + r.origin_norm) +
+                  SINGLE_FLOOR;
+      pos |= pip > tol;
+      neg |= pip < -tol;
+      pc[e] = pip;
+      bound += tol;
+    }
+    if (pos && neg) continue;
+
+    // the distance error grows as the ray becomes parallel to the triangle;
+    // degenerate (NaN) distances are kept as candidates
+    const int ax = ray.axis;
+    float sum = pc[0] + pc[1] + pc[2];
+    float intersection =
+        (pc[0] * c[6 + ax] + pc[1] * c[ax] + pc[2] * c[3 + ax]) / sum;
+    float dist = (intersection - r.origin[ax]) / r.dir[ax];
+    float extent = std::max(std::max(std::fabs(c[ax]), std::fabs(c[3 + ax])),
+                            std::fabs(c[6 + ax])) +
+                   std::fabs(r.origin[ax]);
+    float slack = 4 * (bound / std::fabs(sum) + 16 * FLT_EPSILON) * extent /
+                  std::fabs(r.dir[ax]);
+    if (dist < r.t_min - slack || dist > r.t_max + slack) continue;
+
+    mask |= 1u << lane;
+  }
+  return mask;
+}
+
+#ifdef DAGMC_RAYTRI_X86
+
+__attribute__((target("avx2"))) static unsigned intersect_avx2(
+    const double* block, const uint8_t* edge_flags, const Ray& ray,
+    double t_min, double t_max, double dists[BLOCK]) {
+  const __m256d zero = _mm256_setzero_pd();
+  const __m256d near_zero = _mm256_set1_pd(NEAR_ZERO);
+  const __m256d sign = _mm256_set1_pd(-0.0);
+  const __m256i one = _mm256_set1_epi64x(1);
+  __m256d dir[3], moment[3];
+  for (int d = 0; d < 3; d++) {
+    dir[d] = _mm256_set1_pd(ray.dir[d]);
+    moment[d] = _mm256_set1_pd(ray.moment[d]);
+  }
+
+  unsigned mask = 0;
+  for (int half = 0; half < BLOCK; half += 4) {
+    __m256d v[3][3];
+    for (int i = 0; i < 3; i++)
+      for (int d = 0; d < 3; d++)
+        v[i][d] = _mm256_loadu_pd(block + (3 * i + d) * BLOCK + half);
+
+    __m256d pc[3];
+    for (int e = 0; e < 3; e++) {
+      const __m256d* a = v[e];
+      const __m256d* b = v[(e + 1) % 3];
+      const uint8_t* f = edge_flags + half;
+      __m256i bits = _mm256_set_epi64x((f[3] >> e) & 1, (f[2] >> e) & 1,
+                                       (f[1] >> e) & 1, (f[0] >> e) & 1);
+      __m256d a_first = _mm256_castsi256_pd(_mm256_cmpeq_epi64(bits, one));
+
+      __m256d start[3], edge[3];
+      for (int d = 0; d < 3; d++) {
+        start[d] = _mm256_blendv_pd(b[d], a[d], a_first);
+        edge[d] =
+            _mm256_sub_pd(_mm256_blendv_pd(a[d], b[d], a_first), start[d]);
+      }
+      __m256d normal[3] = {
+          _mm256_sub_pd(_mm256_mul_pd(edge[1], start[2]),
+                        _mm256_mul_pd(edge[2], start[1])),
+          _mm256_sub_pd(_mm256_mul_pd(edge[2], start[0]),
+                        _mm256_mul_pd(edge[0], start[2])),
+          _mm256_sub_pd(_mm256_mul_pd(edge[0], start[1]),
+                        _mm256_mul_pd(edge[1], start[0]))};
+      __m256d pip = _mm256_add_pd(
+          _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dir[0], normal[0]),
+                                      _mm256_mul_pd(dir[1], normal[1])),
+                        _mm256_mul_pd(dir[2], normal[2])),
+          _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(moment[0], edge[0]),
+                                      _mm256_mul_pd(moment[1], edge[1])),
+                        _mm256_mul_pd(moment[2], edge[2])));
+      pip = _mm256_blendv_pd(_mm256_xor_pd(pip, sign), pip, a_first);
+      __m256d small =
+          _mm256_cmp_pd(_mm256_andnot_pd(sign, pip), near_zero, _CMP_LT_OQ);
+      pc[e] = _mm256_andnot_pd(small, pip);
+    }
+
+    __m256d pos = _mm256_or_pd(
+        _mm256_or_pd(_mm256_cmp_pd(pc[0], zero, _CMP_GT_OQ),
+                     _mm256_cmp_pd(pc[1], zero, _CMP_GT_OQ)),
+        _mm256_cmp_pd(pc[2], zero, _CMP_GT_OQ));
+    __m256d neg = _mm256_or_pd(
+        _mm256_or_pd(_mm256_cmp_pd(pc[0], zero, _CMP_LT_OQ),
+                     _mm256_cmp_pd(pc[1], zero, _CMP_LT_OQ)),
+        _mm256_cmp_pd(pc[2], zero, _CMP_LT_OQ));
+    int hits = _mm256_movemask_pd(_mm256_xor_pd(pos, neg));
+    if (!hits) continue;
+
+    const int ax = ray.axis;
+    __m256d inverse_sum = _mm256_div_pd(
+        _mm256_set1_pd(1.0),
+        _mm256_add_pd(_mm256_add_pd(pc[0], pc[1]), pc[2]));
+    __m256d intersection = _mm256_add_pd(
+        _mm256_add_pd(
+            _mm256_mul_pd(_mm256_mul_pd(pc[0], inverse_sum), v[2][ax]),
+            _mm256_mul_pd(_mm256_mul_pd(pc[1], inverse_sum), v[0][ax])),
+        _mm256_mul_pd(_mm256_mul_pd(pc[2], inverse_sum), v[1][ax]));
+    __m256d dist =
+        _mm256_div_pd(_mm256_sub_pd(intersection, _mm256_set1_pd(ray.origin[ax])),
+                      _mm256_set1_pd(ray.dir[ax]));
+    __m256d in_window = _mm256_and_pd(
+        _mm256_cmp_pd(dist, _mm256_set1_pd(t_min), _CMP_GE_OQ),
+        _mm256_cmp_pd(dist, _mm256_set1_pd(t_max), _CMP_LE_OQ));
+    hits &= _mm256_movemask_pd(in_window);
+
+    _mm256_storeu_pd(dists + half, dist);
+    mask |= hits << half;
+  }
+  return mask;
+}
+
+__attribute__((target("avx2"))) static inline __m256 abs_ps(__m256 x) {
+  return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), x);
+}
+
+__attribute__((target("avx2"))) static unsigned candidates_avx2(
+    const float* block, const double anchor[3], const uint8_t* edge_flags,
+    const Ray& ray, double t_min, double t_max) {
+  const FloatRay r(ray, anchor, t_min, t_max);
+  const __m256 sign = _mm256_set1_ps(-0.0f);
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256 tol_scale = _mm256_set1_ps(SINGLE_TOL * r.dir_norm);
+  const __m256 origin_norm = _mm256_set1_ps(r.origin_norm);
+  __m256 dir[3], origin[3];
+  for (int d = 0; d < 3; d++) {
+    dir[d] = _mm256_set1_ps(r.dir[d]);
+    origin[d] = _mm256_set1_ps(r.origin[d]);
+  }
+
+  __m256 v[3][3];
+  for (int i = 0; i < 3; i++)
+    for (int d = 0; d < 3; d++)
+      v[i][d] = _mm256_loadu_ps(block + (3 * i + d) * BLOCK);
+
+  __m256 pc[3];
+  __m256 bound = _mm256_setzero_ps();
+  __m256 pos = _mm256_setzero_ps();
+  __m256 neg = _mm256_setzero_ps();
+  for (int e = 0; e < 3; e++) {
+    const __m256* a = v[e];
+    const __m256* b = v[(e + 1) % 3];
+    const uint8_t* f = edge_flags;
+    __m256i bits = _mm256_set_epi32(
+        (f[7] >> e) & 1, (f[6] >> e) & 1, (f[5] >> e) & 1, (f[4] >> e) & 1,
+        (f[3] >> e) & 1, (f[2] >> e) & 1, (f[1] >> e) & 1, (f[0] >> e) & 1);
+    __m256 a_first = _mm256_castsi256_ps(_mm256_cmpeq_epi32(bits, one));
+
+    __m256 start[3], edge[3], arm[3];
+    for (int d = 0; d < 3; d++) {
+      start[d] = _mm256_blendv_ps(b[d], a[d], a_first);
+      edge[d] = _mm256_sub_ps(_mm256_blendv_ps(a[d], b[d], a_first), start[d]);
+      arm[d] = _mm256_sub_ps(start[d], origin[d]);
+    }
+    __m256 normal[3] = {_mm256_sub_ps(_mm256_mul_ps(edge[1], arm[2]),
+                                      _mm256_mul_ps(edge[2], arm[1])),
+                        _mm256_sub_ps(_mm256_mul_ps(edge[2], arm[0]),
+                                      _mm256_mul_ps(edge[0], arm[2])),
+                        _mm256_sub_ps(_mm256_mul_ps(edge[0], arm[1]),
+                                      _mm256_mul_ps(edge[1], arm[0]))};
+    __m256 pip =
+        _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dir[0], normal[0]),
+                                    _mm256_mul_ps(dir[1], normal[1])),
+                      _mm256_mul_ps(dir[2], normal[2]));
+    pip = _mm256_blendv_ps(_mm256_xor_ps(pip, sign), pip, a_first);
+
+    __m256 start_norm =
+        _mm256_add_ps(_mm256_add_ps(abs_ps(start[0]), abs_ps(start[1])),
+                      abs_ps(start[2]));
+    __m256 edge_norm = _mm256_add_ps(
+        _mm256_add_ps(abs_ps(edge[0]), abs_ps(edge[1])), abs_ps(edge[2]));
+    __m256 tol = _mm256_add_ps(
+        _mm256_mul_ps(
+            _mm256_mul_ps(tol_scale, _mm256_add_ps(start_norm, edge_norm)),
+            _mm256_add_ps(start_norm, origin_norm)),
+        _mm256_set1_ps(SINGLE_FLOOR));
+    pos = _mm256_or_ps(pos, _mm256_cmp_ps(pip, tol, _CMP_GT_OQ));
+    neg = _mm256_or_ps(
+        neg, _mm256_cmp_ps(pip, _mm256_xor_ps(tol, sign), _CMP_LT_OQ));
+    pc[e] = pip;
+    bound = _mm256_add_ps(bound, tol);
+  }
+  unsigned mask = ~_mm256_movemask_ps(_mm256_and_ps(pos, neg)) & 0xff;
+  if (!mask) return 0;
+
+  const int ax = ray.axis;
+  __m256 sum = _mm256_add_ps(_mm256_add_ps(pc[0], pc[1]), pc[2]);
+  __m256 intersection = _mm256_div_ps(
+      _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(pc[0], v[2][ax]),
+                                  _mm256_mul_ps(pc[1], v[0][ax])),
+                    _mm256_mul_ps(pc[2], v[1][ax])),
+      sum);
+  __m256 dist = _mm256_div_ps(_mm256_sub_ps(intersection, origin[ax]),
+                              _mm256_set1_ps(r.dir[ax]));
+  __m256 extent = _mm256_add_ps(
+      _mm256_max_ps(_mm256_max_ps(abs_ps(v[0][ax]), abs_ps(v[1][ax])),
+                    abs_ps(v[2][ax])),
+      _mm256_set1_ps(std::fabs(r.origin[ax])));
+  __m256 slack = _mm256_div_ps(
+      _mm256_mul_ps(
+          _mm256_mul_ps(_mm256_set1_ps(4.0f),
+                        _mm256_add_ps(_mm256_div_ps(bound, abs_ps(sum)),
+                                      _mm256_set1_ps(16 * FLT_EPSILON))),
+          extent),
+      _mm256_set1_ps(std::fabs(r.dir[ax])));
+  __m256 outside = _mm256_or_ps(
+      _mm256_cmp_ps(dist, _mm256_sub_ps(_mm256_set1_ps(r.t_min), slack),
+                    _CMP_LT_OQ),
+      _mm256_cmp_ps(dist, _mm256_add_ps(_mm256_set1_ps(r.t_max), slack),
+                    _CMP_GT_OQ));
+  mask &= ~_mm256_movemask_ps(outside);
+  return mask;
+}
+
+__attribute__((target("avx512f"))) static unsigned intersect_avx512(
+    const double* block, const uint8_t* edge_flags, const Ray& ray,
+    double t_min, double t_max, double dists[BLOCK]) {
+  const __m512d zero = _mm512_setzero_pd();
+  const __m512d near_zero = _mm512_set1_pd(NEAR_ZERO);
+  __m512d dir[3], moment[3];
+  for (int d = 0; d < 3; d++) {
+    dir[d] = _mm512_set1_pd(ray.dir[d]);
+    moment[d] = _mm512_set1_pd(ray.moment[d]);
+  }
+
+  __m512d v[3][3];
+  for (int i = 0; i < 3; i++)
+    for (int d = 0; d < 3; d++)
+      v[i][d] = _mm512_loadu_pd(block + (3 * i + d) * BLOCK);
+
+  __m512d pc[3];
+  for (int e = 0; e < 3; e++) {
+    const __m512d* a = v[e];
+    const __m512d* b = v[(e + 1) % 3];
+    __mmask8 a_first = 0;
+    for (int lane = 0; lane < BLOCK; lane++)
+      a_first |= ((edge_flags[lane] >> e) & 1) << lane;
+
+    __m512d start[3], edge[3];
+    for (int d = 0; d < 3; d++) {
+      start[d] = _mm512_mask_blend_pd(a_first, b[d], a[d]);
+      edge[d] =
+          _mm512_sub_pd(_mm512_mask_blend_pd(a_first, a[d], b[d]), start[d]);
+    }
+    __m512d normal[3] = {
+        _mm512_sub_pd(_mm512_mul_pd(edge[1], start[2]),
+                      _mm512_mul_pd(edge[2], start[1])),
+        _mm512_sub_pd(_mm512_mul_pd(edge[2], start[0]),
+                      _mm512_mul_pd(edge[0], start[2])),
+        _mm512_sub_pd(_mm512_mul_pd(edge[0], start[1]),
+                      _mm512_mul_pd(edge[1], start[0]))};
+    __m512d pip = _mm512_add_pd(
+        _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(dir[0], normal[0]),
+                                    _mm512_mul_pd(dir[1], normal[1])),
+                      _mm512_mul_pd(dir[2], normal[2])),
+        _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(moment[0], edge[0]),
+                                    _mm512_mul_pd(moment[1], edge[1])),
+                      _mm512_mul_pd(moment[2], edge[2])));
+    pip = _mm512_mask_blend_pd(a_first, _mm512_sub_pd(zero, pip), pip);
+    __mmask8 small =
+        _mm512_cmp_pd_mask(_mm512_abs_pd(pip), near_zero, _CMP_LT_OQ);
+    pc[e] = _mm512_mask_blend_pd(small, pip, zero);
+  }
+
+  __mmask8 pos = _mm512_cmp_pd_mask(pc[0], zero, _CMP_GT_OQ) |
+                 _mm512_cmp_pd_mask(pc[1], zero, _CMP_GT_OQ) |
+                 _mm512_cmp_pd_mask(pc[2], zero, _CMP_GT_OQ);
+  __mmask8 neg = _mm512_cmp_pd_mask(pc[0], zero, _CMP_LT_OQ) |
+                 _mm512_cmp_pd_mask(pc[1], zero, _CMP_LT_OQ) |
+                 _mm512_cmp_pd_mask(pc[2], zero, _CMP_LT_OQ);
+  __mmask8 hits = pos ^ neg;
+  if (!hits) return 0;
+
+  const int ax = ray.axis;
+  __m512d inverse_sum =
+      _mm512_div_pd(_mm512_set1_pd(1.0),
+                    _mm512_add_pd(_mm512_add_pd(pc[0], pc[1]), pc[2]));
+  __m512d intersection = _mm512_add_pd(
+      _mm512_add_pd(
+          _mm512_mul_pd(_mm512_mul_pd(pc[0], inverse_sum), v[2][ax]),
+          _mm512_mul_pd(_mm512_mul_pd(pc[1], inverse_sum), v[0][ax])),
+      _mm512_mul_pd(_mm512_mul_pd(pc[2], inverse_sum), v[1][ax]));
+  __m512d dist =
+      _mm512_div_pd(_mm512_sub_pd(intersection, _mm512_set1_pd(ray.origin[ax])),
+                    _mm512_set1_pd(ray.dir[ax]));
+  hits &= _mm512_cmp_pd_mask(dist, _mm512_set1_pd(t_min), _CMP_GE_OQ) &
+          _mm512_cmp_pd_mask(dist, _mm512_set1_pd(t_max), _CMP_LE_OQ);
+
+  _mm512_storeu_pd(dists, dist);
+  return hits;
+}
+
+#endif
+
+typedef unsigned (*Kernel)(const double*, const uint8_t*, const Ray&, double,
+                           double, double*);
+typedef unsigned (*CandidateKernel)(const float*, const double*,
+                                    const uint8_t*, const Ray&, double,
+                                    double);
+
+static Kernel kernel_for(Isa isa) {
+#ifdef DAGMC_RAYTRI_X86
+  if (AVX512 == isa) return intersect_avx512;
+  if (AVX2 == isa) return intersect_avx2;
+#endif
+  return intersect_scalar;
+}
+
+// a single precision block fits in one AVX2 register
+static CandidateKernel candidate_kernel_for(Isa isa) {
+#ifdef DAGMC_RAYTRI_X86
+  if (AVX2 <= isa) return candidates_avx2;
+#endif
+  return candidates_scalar;
+}
+
+Isa supported_isa() {
+#ifdef DAGMC_RAYTRI_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) return AVX512;
+  if (__builtin_cpu_supports("avx2")) return AVX2;
+#endif
+  return SCALAR;
+}
+
+static std::atomic<Isa>& current_isa() {
+  static std::atomic<Isa> isa(supported_isa());
+  return isa;
+}
+
+static std::atomic<Kernel>& current_kernel() {
+  static std::atomic<Kernel> kernel(kernel_for(current_isa()));
+  return kernel;
+}
+
+static std::atomic<CandidateKernel>& current_candidate_kernel() {
+  static std::atomic<CandidateKernel> kernel(
+      candidate_kernel_for(current_isa()));
+  return kernel;
+}
+
+Isa active_isa() { return current_isa(); }
+
+Isa set_isa(Isa isa) {
+  Isa supported = supported_isa();
+  if (isa > supported) isa = supported;
+  current_isa() = isa;
+  current_kernel() = kernel_for(isa);
+  current_candidate_kernel() = candidate_kernel_for(isa);
+  return isa;
+}
+
+unsigned intersect(const double* block, const uint8_t* edge_flags,
+                   const Ray& ray, double t_min, double t_max,
+                   double dists[BLOCK]) {
+  Kernel kernel = current_kernel().load(std::memory_order_relaxed);
+  return kernel(block, edge_flags, ray, t_min, t_max, dists);
+}
+
+unsigned candidates(const float* block, const double anchor[3],
+                    const uint8_t* edge_flags, const Ray& ray, double t_min,
+                    double t_max) {
+  CandidateKernel kernel =
+      current_candidate_kernel().load(std::memory_order_relaxed);
+  return kernel(block, anchor, edge_flags, ray, t_min, t_max);
+}
+
+}  // namespace RayTriKernel
+
+}  // namespace moab
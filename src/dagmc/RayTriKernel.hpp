@@ -0,0 +1,113 @@
+#ifndef DAGMC_RAYTRIKERNEL_HPP
+#define DAGMC_RAYTRIKERNEL_HPP
+
+#include <cstdint>
+
+namespace moab {
+
+/**\brief Ray-triangle intersection for blocks of triangles
+ *
+ * Implements the Plucker coordinate test of GeomUtil::plucker_ray_tri_intersect
+ * (without an orientation) for BLOCK triangles at once. The vertex coordinates
+ * of a block are stored structure-of-arrays: the 9 coordinates (x0, y0, z0,
+ * x1, ..., z2) of each triangle, each as a row of BLOCK values.
+ *
+ * The edges of a triangle are evaluated from their lexicographically first
+ * vertex, as in MOAB, so the edge shared by two triangles gives the same
+ * result for both and rays cannot leak through. Which vertex comes first is
+ * recorded per triangle in the edge flags when the block is packed.
+ *
+ * The AVX2 and AVX-512 kernels are selected at runtime depending on the CPU;
+ * all kernels give identical results.
+ *
+ * Blocks may also be stored in single precision, twice as many triangles per
+ * vector, relative to an anchor point near the triangles of the block so the
+ * rounding errors scale with the size of the block rather than with the
+ * distance to the model origin. The single precision test only finds
+ * candidates: it is relaxed by a bound on the rounding errors so that no
+ * triangle hit in double precision is missed, and each candidate is
+ * confirmed with intersect_triangle().
+ */
+namespace RayTriKernel {
+
+/** number of triangles in a block */
+const int BLOCK = 8;
+
+/** number of values in a block */
+const int BLOCK_SIZE = 9 * BLOCK;
+
+/** instruction sets the kernel is available for */
+enum Isa { SCALAR = 0, AVX2 = 1, AVX512 = 2 };
+
+/** ray data shared by all the blocks tested against a ray */
+struct Ray {
+  Ray(const double origin[3], const double direction[3]);
+
+  double origin[3];
+  double dir[3];
+  /** moment of the ray, dir x origin */
+  double moment[3];
+  /** component of dir with the largest magnitude */
+  int axis;
+};
+
+/**\brief Store a triangle in a lane of a block
+ *
+ *\param block the block coordinates
+ *\param edge_flags the BLOCK edge flags of the block
+ *\param coords vertex coordinates of the triangle
+ */
+void pack(double* block, uint8_t* edge_flags, int lane,
+          const double coords[9]);
+
+/** Read the vertex coordinates of the triangle in a lane of a block */
+void unpack(const double* block, int lane, double coords[9]);
+
+/** Store a triangle in a lane of a single precision block, relative to the
+ *  anchor of the block; the edge flags are those of the double precision
+ *  coordinates */
+void pack(float* block, const double anchor[3], uint8_t* edge_flags, int lane,
+          const double coords[9]);
+
+/**\brief Intersect a ray with the triangles of a block
+ *
+ * Lanes not holding a triangle must be zero filled, they never intersect.
+ *
+ *\param t_min, t_max the distances along the ray to accept intersections in
+ *\param dists output, distance to the intersection for each lane hit
+ *\return bit mask of the lanes hit
+ */
+unsigned intersect(const double* block, const uint8_t* edge_flags,
+                   const Ray& ray, double t_min, double t_max,
+                   double dists[BLOCK]);
+
+/**\brief Find the triangles of a single precision block a ray may hit
+ *
+ * Every lane intersect() would report for the double precision coordinates
+ * of the triangles is included, along with some near misses.
+ *
+ *\return bit mask of the candidate lanes
+ */
+unsigned candidates(const float* block, const double anchor[3],
+                    const uint8_t* edge_flags, const Ray& ray, double t_min,
+                    double t_max);
+
+/** Intersect a ray with a single triangle, as intersect() does for a block */
+bool intersect_triangle(const double coords[9], const Ray& ray, double t_min,
+                        double t_max, double& dist);
+
+/** best instruction set supported by the CPU */
+Isa supported_isa();
+
+/** instruction set used by intersect() */
+Isa active_isa();
+
+/** select the instruction set used by intersect(), limited to the supported
+ *  one; returns the instruction set selected */
+Isa set_isa(Isa isa);
+
+}  // namespace RayTriKernel
+
+}  // namespace moab
+
+#endif
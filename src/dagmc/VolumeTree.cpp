@@ -0,0 +1,174 @@
+#include "VolumeTree.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+namespace moab {
+
+// entries per leaf
+static const int MAX_LEAF = 4;
+
+void VolumeTree::build(const std::vector<int>& ids,
+                       const std::vector<double>& boxes) {
+  clear();
+  if (ids.empty()) return;
+  entryIds = ids;
+  entryBoxes = boxes;
+  items.resize(ids.size());
+  for (size_t i = 0; i < ids.size(); i++) items[i] = i;
+  nodes.emplace_back();
+  build_node(0, 0, items.size(), boxes);
+}
+
+void VolumeTree::build_node(int node_idx, int begin, int end,
+                            const std::vector<double>& boxes) {
+  double lower[3], upper[3];
+  for (int d = 0; d < 3; d++) {
+    lower[d] = std::numeric_limits<double>::max();
+    upper[d] = -std::numeric_limits<double>::max();
+  }
+  for (int i = begin; i < end; i++) {
+    const double* box = &boxes[6 * items[i]];
+    for (int d = 0; d < 3; d++) {
+      lower[d] = std::min(lower[d], box[d]);
+      upper[d] = std::max(upper[d], box[3 + d]);
+    }
+  }
+  std::copy(lower, lower + 3, nodes[node_idx].lower);
+  std::copy(upper, upper + 3, nodes[node_idx].upper);
+
+  if (end - begin <= MAX_LEAF) {
+    nodes[node_idx].first = begin;
+    nodes[node_idx].count = end - begin;
+    return;
+  }
+
+  // split at the median center along the longest axis
+  int axis = 0;
+  for (int d = 1; d < 3; d++)
+    if (upper[d] - lower[d] > upper[axis] - lower[axis]) axis = d;
+  int mid = begin + (end - begin) / 2;
+  std::nth_element(items.begin() + begin, items.begin() + mid,
+                   items.begin() + end, [&](int a, int b) {
+                     return boxes[6 * a + axis] + boxes[6 * a + 3 + axis] <
+                            boxes[6 * b + axis] + boxes[6 * b + 3 + axis];
+                   });
+
+  int first = nodes.size();
+  nodes[node_idx].first = first;
+  nodes[node_idx].count = 0;
+  nodes.resize(first + 2);
+  build_node(first, begin, mid, boxes);
+  build_node(first + 1, mid, end, boxes);
+}
+
+void VolumeTree::clear() {
+  nodes.clear();
+  items.clear();
+  entryIds.clear();
+  entryBoxes.clear();
+}
+
+void VolumeTree::find_point(const double xyz[3], double tol,
+                            std::vector<int>& found) const {
+  if (nodes.empty()) return;
+
+  auto contains = [&](const double* lower, const double* upper) {
+    for (int d = 0; d < 3; d++)
+      if (xyz[d] < lower[d] - tol || xyz[d] > upper[d] + tol) return false;
+    return true;
+  };
+
+  std::vector<int> stack(1, 0);
+  while (!stack.empty()) {
+    const Node& node = nodes[stack.back()];
+    stack.pop_back();
+    if (!contains(node.lower, node.upper)) continue;
+    if (0 == node.count) {
+      stack.push_back(node.first);
+      stack.push_back(node.first + 1);
+      continue;
+    }
+    for (int i = node.first; i < node.first + node.count; i++) {
+      const double* box = &entryBoxes[6 * items[i]];
+      if (contains(box, box + 3)) found.push_back(entryIds[items[i]]);
+    }
+  }
+}
+
+bool VolumeTree::ray_box(const double lower[3], const double upper[3],
+                         const double point[3], const double inv[3],
+                         double t_min, double t_max, double tol,
+                         double& t_enter) {
+  for (int d = 0; d < 3; d++) {
+    double lo = lower[d] - tol, hi = upper[d] + tol;
+    // ray parallel to this slab
+    if (std::isinf(inv[d])) {
+      if (point[d] < lo || point[d] > hi) return false;
+      continue;
+    }
+    double t_near = ((inv[d] < 0 ? hi : lo) - point[d]) * inv[d];
+    double t_far = ((inv[d] < 0 ? lo : hi) - point[d]) * inv[d];
+    t_min = std::max(t_min, t_near);
+    t_max = std::min(t_max, t_far);
+    if (t_min > t_max) return false;
+  }
+  t_enter = t_min;
+  return true;
+}
+
+void VolumeTree::find_ray(const double point[3], const double dir[3],
+                          double t_min, double t_max, double tol,
+                          const RayVisitor& visit) const {
+  if (nodes.empty()) return;
+  double inv[3] = {1.0 / dir[0], 1.0 / dir[1], 1.0 / dir[2]};
+
+  // nodes to visit with the distance at which the ray enters them
+  std::vector<std::pair<int, double>> stack;
+  double t_root;
+  if (!ray_box(nodes[0].lower, nodes[0].upper, point, inv, t_min, t_max, tol,
+               t_root))
+    return;
+  stack.emplace_back(0, t_root);
+
+  std::vector<std::pair<double, int>> entered;
+  while (!stack.empty()) {
+    std::pair<int, double> top = stack.back();
+    stack.pop_back();
+    if (top.second > t_max) continue;
+    const Node& node = nodes[top.first];
+
+    if (0 == node.count) {
+      // push the farther child first so the nearer one is visited first
+      std::pair<int, double> children[2];
+      int num_children = 0;
+      for (int child = node.first; child < node.first + 2; child++) {
+        double t_enter;
+        if (ray_box(nodes[child].lower, nodes[child].upper, point, inv, t_min,
+                    t_max, tol, t_enter))
+          children[num_children++] = std::make_pair(child, t_enter);
+      }
+      if (2 == num_children && children[0].second < children[1].second)
+        std::swap(children[0], children[1]);
+      for (int c = 0; c < num_children; c++) stack.push_back(children[c]);
+      continue;
+    }
+
+    entered.clear();
+    for (int i = node.first; i < node.first + node.count; i++) {
+      const double* box = &entryBoxes[6 * items[i]];
+      double t_enter;
+      if (ray_box(box, box + 3, point, inv, t_min, t_max, tol, t_enter))
+        entered.emplace_back(t_enter, items[i]);
+    }
+    std::sort(entered.begin(), entered.end());
+    for (const auto& entry : entered) {
+      if (entry.first > t_max) break;
+      t_max = visit(entryIds[entry.second], entry.first);
+    }
+  }
+}
+
+}  // namespace moab
@@ -0,0 +1,96 @@
+#ifndef DAGMC_VOLUMETREE_HPP
+#define DAGMC_VOLUMETREE_HPP
+
+#include <functional>
+#include <vector>
+
+#include "moab/Types.hpp"
+
+namespace moab {
+
+/**\brief Top-level bounding volume hierarchy over the boxes of volumes
+ *
+ * A binary tree of axis-aligned boxes over one box per entry, split at the
+ * median center along the longest axis. The tree only finds the entries
+ * whose boxes contain a point or are crossed by a ray; the entries are then
+ * tested with their own (bottom-level) trees, so the cost of locating a
+ * point grows with the logarithm of the number of entries rather than
+ * linearly. It is cheap to build and independent of the bottom-level trees.
+ *
+ * Entries are identified by the integer given with their box. Queries only
+ * read the tree and are safe to call concurrently.
+ */
+class VolumeTree {
+ public:
+  /** called for each entry crossed by a ray with the distance at which the
+   *  ray enters its box; returns the (possibly reduced) search distance */
+  typedef std::function<double(int id, double t_enter)> RayVisitor;
+
+  /**\brief Build the tree
+   *
+   *\param ids identifier of each entry
+   *\param boxes lower and upper corner of each entry, 6 values per entry
+   */
+  void build(const std::vector<int>& ids, const std::vector<double>& boxes);
+
+  /** release all storage */
+  void clear();
+
+  /** true if the tree has no entries */
+  bool empty() const { return items.empty(); }
+
+  /** number of entries */
+  size_t size() const { return items.size(); }
+
+  /** append the entries whose boxes, expanded by tol, contain a point */
+  void find_point(const double xyz[3], double tol,
+                  std::vector<int>& found) const;
+
+  /**\brief Visit the entries whose boxes a ray enters before t_max
+   *
+   * Nearer boxes are visited first, and boxes entered beyond the search
+   * distance returned by the visitor are skipped, so a visitor keeping the
+   * distance to the nearest hit prunes the search.
+   */
+  void find_ray(const double point[3], const double dir[3], double t_max,
+                const RayVisitor& visit) const {
+    find_ray(point, dir, 0.0, t_max, 0.0, visit);
+  }
+
+  /** find_ray() over the window [t_min, t_max], which may start behind the
+   *  origin, with the boxes expanded by tol */
+  void find_ray(const double point[3], const double dir[3], double t_min,
+                double t_max, double tol, const RayVisitor& visit) const;
+
+ private:
+  struct Node {
+    double lower[3];
+    double upper[3];
+    /** leaf: first entry in items, interior: first of two adjacent
+     *  children */
+    int first;
+    /** leaf: number of entries, interior: 0 */
+    int count;
+  };
+
+  /** build the subtree over items [begin, end) into nodes[node_idx] */
+  void build_node(int node_idx, int begin, int end,
+                  const std::vector<double>& boxes);
+
+  /** distance at which a ray enters a box expanded by tol within
+   *  [t_min, t_max], false if it misses it */
+  static bool ray_box(const double lower[3], const double upper[3],
+                      const double point[3], const double inv[3], double t_min,
+                      double t_max, double tol, double& t_enter);
+
+  std::vector<Node> nodes;
+  /** entry index of each leaf slot, in leaf order */
+  std::vector<int> items;
+  /** identifier and box of each entry */
+  std::vector<int> entryIds;
+  std::vector<double> entryBoxes;
+};
+
+}  // namespace moab
+
+#endif
@@ -2,7 +2,9 @@
 
 #include <algorithm>
 #include <cstdint>
+#include <cstdlib>
 #include <iostream>
+#include <limits>
 #include <set>
 #include <sstream>
 
@@ -35,22 +37,23 @@ void dagmcMetaData::load_property_data() {
   parse_boundary_data();
   parse_tally_volume_data();
   parse_tally_surface_data();
+  compile_properties();
 }
 
 // get the given volume property on a given entity handle
-std::string dagmcMetaData::get_volume_property(std::string property,
-                                               moab::EntityHandle eh) {
+std::string dagmcMetaData::get_volume_property(const std::string& property,
+                                               moab::EntityHandle eh) const {
   std::string value = "";
   if (property == "material_density") {
-    value = volume_material_property_data_eh[eh];
+    value = lookup(volume_material_property_data_eh, eh);
   } else if (property == "material") {
-    value = volume_material_data_eh[eh];
+    value = lookup(volume_material_data_eh, eh);
   } else if (property == "density") {
-    value = volume_density_data_eh[eh];
+    value = lookup(volume_density_data_eh, eh);
   } else if (property == "importance") {
-    value = volume_importance_data_eh[eh];
+    value = lookup(volume_importance_data_eh, eh);
   } else if (property == "tally") {
-    value = tally_data_eh[eh];
+    value = lookup(tally_data_eh, eh);
   } else {
     logger.error("Not a valid property for volumes");
   }
@@ -58,8 +61,8 @@ std::string dagmcMetaData::get_volume_property(std::string property,
 }
 
 // overloaded get_volume_property for indices and id's'
-std::string dagmcMetaData::get_volume_property(std::string property, int vol,
-                                               bool idx) {
+std::string dagmcMetaData::get_volume_property(const std::string& property,
+                                               int vol, bool idx) const {
   // if this is an index query
   moab::EntityHandle eh;
   if (idx == true) {
@@ -71,13 +74,13 @@ std::string dagmcMetaData::get_volume_property(std::string property, int vol,
 }
 
 // Get a given property on a surface
-std::string dagmcMetaData::get_surface_property(std::string property,
-                                                moab::EntityHandle eh) {
+std::string dagmcMetaData::get_surface_property(const std::string& property,
+                                                moab::EntityHandle eh) const {
   std::string value = "";
   if (property == "boundary") {
-    value = surface_boundary_data_eh[eh];
+    value = lookup(surface_boundary_data_eh, eh);
   } else if (property == "tally") {
-    value = tally_data_eh[eh];
+    value = lookup(tally_data_eh, eh);
   } else {
     std::stringstream ss;
     ss << property << " is not a valid property for surfaces";
@@ -87,8 +90,8 @@ std::string dagmcMetaData::get_surface_property(std::string property,
 }
 
 // overloaded get_surface_property for indices and ids
-std::string dagmcMetaData::get_surface_property(std::string property, int vol,
-                                                bool idx) {
+std::string dagmcMetaData::get_surface_property(const std::string& property,
+                                                int vol, bool idx) const {
   // if this is an index query
   moab::EntityHandle eh;
   if (idx == true) {
@@ -99,6 +102,76 @@ std::string dagmcMetaData::get_surface_property(std::string property, int vol,
   return get_surface_property(property, eh);
 }
 
+// look up a property without inserting an empty one
+const std::string& dagmcMetaData::lookup(
+    const std::map<moab::EntityHandle, std::string>& data,
+    moab::EntityHandle eh) {
+  static const std::string none;
+  auto it = data.find(eh);
+  return it == data.end() ? none : it->second;
+}
+
+// compile the property maps into the typed arrays
+void dagmcMetaData::compile_properties() {
+  int num_vols = DAG->num_entities(3);
+  int num_surfs = DAG->num_entities(2);
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+
+  importanceParticles.assign(imp_particles.begin(), imp_particles.end());
+  size_t num_particles = importanceParticles.size();
+  volumeMaterial.assign(num_vols + 1, "");
+  volumeMaterialId.assign(num_vols + 1, -1);
+  volumeDensity.assign(num_vols + 1, nan);
+  volumeKind.assign(num_vols + 1, MATERIAL);
+  volumeImportance.assign((num_vols + 1) * num_particles, 1.0);
+
+  for (int i = 1; i <= num_vols; ++i) {
+    moab::EntityHandle eh = DAG->entity_by_index(3, i);
+    const std::string& material = lookup(volume_material_data_eh, eh);
+    volumeMaterial[i] = material;
+    if (material == graveyard_str || material == vacuum_str) {
+      volumeKind[i] = material == graveyard_str ? GRAVEYARD : VACUUM;
+      volumeMaterialId[i] = 0;
+    } else if (!material.empty() && try_to_make_int(material)) {
+      volumeMaterialId[i] = std::strtol(material.c_str(), nullptr, 10);
+    }
+
+    const std::string& density = lookup(volume_density_data_eh, eh);
+    char* end;
+    double value = std::strtod(density.c_str(), &end);
+    if (!density.empty() && '\0' == *end) volumeDensity[i] = value;
+
+    auto imp = importance_map.find(eh);
+    if (imp == importance_map.end()) continue;
+    for (size_t p = 0; p < num_particles; p++) {
+      auto it = imp->second.find(importanceParticles[p]);
+      if (it != imp->second.end())
+        volumeImportance[i * num_particles + p] = it->second;
+    }
+  }
+
+  surfaceBoundary.assign(num_surfs + 1, NO_BOUNDARY);
+  for (int i = 1; i <= num_surfs; ++i) {
+    const std::string& boundary =
+        lookup(surface_boundary_data_eh, DAG->entity_by_index(2, i));
+    if (boundary == vacuum_str)
+      surfaceBoundary[i] = VACUUM_BOUNDARY;
+    else if (boundary == reflecting_str)
+      surfaceBoundary[i] = REFLECTING_BOUNDARY;
+    else if (boundary == white_str)
+      surfaceBoundary[i] = WHITE_BOUNDARY;
+    else if (boundary == periodic_str)
+      surfaceBoundary[i] = PERIODIC_BOUNDARY;
+  }
+}
+
+int dagmcMetaData::importance_particle(const std::string& particle) const {
+  auto it = std::lower_bound(importanceParticles.begin(),
+                             importanceParticles.end(), particle);
+  if (it == importanceParticles.end() || *it != particle) return -1;
+  return it - importanceParticles.begin();
+}
+
 // parse the material data
 void dagmcMetaData::parse_material_data() {
   auto material_assignments = get_property_assignments("mat", 3, ":/", true);
@@ -429,13 +502,18 @@ dagmcMetaData::get_property_assignments(std::string property, int dimension,
   // get initial sizes
   int num_entities = DAG->num_entities(dimension);
 
-  // parse data from geometry
-  moab::ErrorCode rval = DAG->parse_properties(
-      metadata_keywords, keyword_synonyms, delimiters.c_str());
-
-  if (moab::MB_SUCCESS != rval) {
-    logger.error("DAGMC failed to parse metadata properties");
-    exit(EXIT_FAILURE);
+  // parse data from geometry, unless the last parse used the same
+  // delimiters and duplicates are removed: parsing again would only append
+  // duplicate values
+  moab::ErrorCode rval = moab::MB_SUCCESS;
+  if (delimiters != parsed_delimiters || !remove_duplicates) {
+    rval = DAG->parse_properties(metadata_keywords, keyword_synonyms,
+                                 delimiters.c_str());
+    if (moab::MB_SUCCESS != rval) {
+      logger.error("DAGMC failed to parse metadata properties");
+      exit(EXIT_FAILURE);
+    }
+    parsed_delimiters = delimiters;
   }
 
   // loop over all entities
@@ -19,19 +19,66 @@ class dagmcMetaData {
   void load_property_data();
 
   // get a given property on a volume
-  std::string get_volume_property(std::string property, moab::EntityHandle vol);
+  std::string get_volume_property(const std::string& property,
+                                  moab::EntityHandle vol) const;
   // get a property for the specified volume, treats the vol parameter as
   // an index by default and as an ID if idx is false.
-  std::string get_volume_property(std::string property, int vol,
-                                  bool idx = true);
+  std::string get_volume_property(const std::string& property, int vol,
+                                  bool idx = true) const;
 
   // get a given property on a surface
-  std::string get_surface_property(std::string property,
-                                   moab::EntityHandle surface);
+  std::string get_surface_property(const std::string& property,
+                                   moab::EntityHandle surface) const;
   // get a property for the specified surface, treats the surface parameter as
   // an index by default and as an ID if idx is false.
-  std::string get_surface_property(std::string property, int surface,
-                                   bool idx = true);
+  std::string get_surface_property(const std::string& property, int surface,
+                                   bool idx = true) const;
+
+  // boundary condition of a surface
+  enum Boundary {
+    NO_BOUNDARY,
+    VACUUM_BOUNDARY,
+    REFLECTING_BOUNDARY,
+    WHITE_BOUNDARY,
+    PERIODIC_BOUNDARY
+  };
+
+  // Typed properties by DAGMC index, compiled by load_property_data() from
+  // the maps below. The accessors neither allocate nor check the index, so
+  // they may be used while tracking.
+
+  // material of a volume, "" if none
+  const std::string& volume_material(int vol_idx) const {
+    return volumeMaterial[vol_idx];
+  }
+  // material of a volume as a number, 0 for the graveyard and vacuum and -1
+  // if the material is not named by a number
+  int volume_material_id(int vol_idx) const {
+    return volumeMaterialId[vol_idx];
+  }
+  // density of a volume, NaN if none is given or it is not a number
+  double volume_density(int vol_idx) const { return volumeDensity[vol_idx]; }
+  bool volume_is_graveyard(int vol_idx) const {
+    return GRAVEYARD == volumeKind[vol_idx];
+  }
+  bool volume_is_vacuum(int vol_idx) const {
+    return VACUUM == volumeKind[vol_idx];
+  }
+  // the particles given importances, in the order of volume_importance()
+  const std::vector<std::string>& importance_particles() const {
+    return importanceParticles;
+  }
+  // position of a particle in importance_particles(), -1 if not there
+  int importance_particle(const std::string& particle) const;
+  // importance of a volume for the particle at that position of
+  // importance_particles(), 1.0 where none is given
+  double volume_importance(int vol_idx, int particle) const {
+    return volumeImportance[vol_idx * importanceParticles.size() + particle];
+  }
+  // boundary condition of a surface
+  Boundary surface_boundary(int surf_idx) const {
+    return surfaceBoundary[surf_idx];
+  }
 
   // unpack the packed string of the form
   // delimeter<data>delimiter<data>delimiter into a vector of the form
@@ -65,6 +112,12 @@ class dagmcMetaData {
   void parse_tally_volume_data();
   // finalise the count data
   void finalise_counters();
+  // fill the typed property arrays from the property maps
+  void compile_properties();
+  // the value of a property map for an entity, "" if it has none
+  static const std::string& lookup(
+      const std::map<moab::EntityHandle, std::string>& data,
+      moab::EntityHandle eh);
 
   // Parse property for entities with the specified dimension and delimiters.
   // Optionally remove duplicate property values if necessary.
@@ -120,6 +173,8 @@ class dagmcMetaData {
   std::vector<std::string>
       metadata_keywords;  // Keywords supported by the metadata manager
   std::map<std::string, std::string> keyword_synonyms;  // Keyword synonyms
+  std::string parsed_delimiters;  // Delimiters of the last parse of the
+                                  // group names, empty if none
   // Some constant keyword values
   const std::string graveyard_str{"Graveyard"};
   const std::string vacuum_str{"Vacuum"};
@@ -128,6 +183,17 @@ class dagmcMetaData {
   const std::string periodic_str{"Periodic"};
 
   DagMC_Logger logger;
+
+  // typed properties by DAGMC index, entry 0 unused
+  enum VolumeKind { MATERIAL, GRAVEYARD, VACUUM };
+  std::vector<std::string> volumeMaterial;
+  std::vector<int> volumeMaterialId;
+  std::vector<double> volumeDensity;
+  std::vector<VolumeKind> volumeKind;
+  std::vector<std::string> importanceParticles;
+  // importance of volume i for particle p at i * #particles + p
+  std::vector<double> volumeImportance;
+  std::vector<Boundary> surfaceBoundary;
 };
 
 #endif  // SRC_DAGMC_DAGMCMETADATA_HPP_
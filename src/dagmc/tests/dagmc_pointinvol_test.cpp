@@ -1,6 +1,8 @@
 #include <gtest/gtest.h>
 
+#include <array>
 #include <iostream>
+#include <vector>
 
 #include "DagMC.hpp"
 #include "moab/Core.hpp"
@@ -232,3 +234,63 @@ TEST_F(DagmcPointInVolTest, dagmc_point_on_corner_8) {
 
   EXPECT_EQ(expected_result, result);
 }
+
+TEST_F(DagmcPointInVolTest, dagmc_point_in_vol_flat_bvh) {
+  // points inside, outside and far from volume 1 (a cube of side 10)
+  std::vector<std::array<double, 3>> points = {
+      {0.0, 0.0, 0.0},  {4.9, -4.9, 4.9}, {5.1, 0.0, 0.0},
+      {-2.0, 6.0, 1.0}, {0.0, 0.0, -4.0}, {100.0, 0.0, 0.0}};
+  double dir[3] = {0.0, 0.6, 0.8};
+
+  for (int vol_idx = 1; vol_idx <= (int)DAG->num_entities(3); vol_idx++) {
+    EntityHandle vol_h = DAG->entity_by_index(3, vol_idx);
+    for (const auto& xyz : points) {
+      int obb_result = -1, flat_result = -1;
+      DAG->clear_flat_bvh();
+      ErrorCode rval = DAG->point_in_volume(vol_h, xyz.data(), obb_result, dir);
+      EXPECT_EQ(MB_SUCCESS, rval);
+      rval = DAG->build_flat_bvh();
+      EXPECT_EQ(MB_SUCCESS, rval);
+      rval = DAG->point_in_volume(vol_h, xyz.data(), flat_result, dir);
+      EXPECT_EQ(MB_SUCCESS, rval);
+      EXPECT_EQ(obb_result, flat_result);
+    }
+  }
+}
+
+TEST_F(DagmcPointInVolTest, dagmc_parallel_build) {
+  std::shared_ptr<DagMC> dag = std::make_shared<DagMC>();
+  ErrorCode rval = dag->load_file(input_file);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  dag->set_build_threads(4);
+  rval = dag->init_OBBTree();
+  EXPECT_EQ(MB_SUCCESS, rval);
+
+  // the flat BVH is built first, then the deferred OBB trees
+  EXPECT_TRUE(dag->has_flat_bvh());
+  EXPECT_TRUE(dag->has_acceleration_datastructures());
+
+  EntityHandle vol_h = dag->entity_by_index(3, 1);
+  double origin[3] = {0.0, 0.0, 0.0};
+  double outside[3] = {7.0, 0.0, 0.0};
+  double dir[3] = {-1.0, 0.0, 0.0};
+  int result = -1;
+  rval = dag->point_in_volume(vol_h, origin, result);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(1, result);
+  rval = dag->point_in_volume(vol_h, outside, result, dir);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(0, result);
+
+  EntityHandle next_surf;
+  double next_surf_dist;
+  rval = dag->ray_fire(vol_h, origin, dir, next_surf, next_surf_dist);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_NEAR(5.0, next_surf_dist, 1e-6);
+
+  // queries without a flat implementation use the OBB trees built at setup
+  double dist;
+  rval = dag->closest_to_location(vol_h, origin, dist);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_NEAR(5.0, dist, 1e-6);
+}
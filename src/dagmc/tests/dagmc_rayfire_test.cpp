@@ -1,10 +1,19 @@
 #include <gtest/gtest.h>
 
+#include <array>
+#include <cmath>
+#include <cstdio>
 #include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
 
 #include "DagMC.hpp"
+#include "RayTriKernel.hpp"
+#include "moab/CartVect.hpp"
 #include "moab/Core.hpp"
 #include "moab/GeomQueryTool.hpp"
+#include "moab/GeomUtil.hpp"
 #include "moab/Interface.hpp"
 
 using namespace moab;
@@ -153,3 +162,856 @@ TEST_F(DagmcRayFireTest, dagmc_outside_face_rayfire_history) {
   EntityHandle ZERO = 0;
   EXPECT_EQ(ZERO, next_surf);
 }
+
+TEST_F(DagmcRayFireTest, dagmc_rayfire_batch) {
+  EntityHandle vol_h = DAG->entity_by_index(3, 1);
+  // rays from the origin along each axis, interleaved with rays fired at the
+  // volume from outside
+  std::vector<double> x = {0.0, 0.0, 0.0, -10.0, 0.0, 0.0};
+  std::vector<double> y = {0.0, 0.0, 0.0, 0.0, -10.0, 0.0};
+  std::vector<double> z = {0.0, 0.0, 0.0, 0.0, 0.0, 10.0};
+  std::vector<double> u = {-1.0, 0.0, 0.0, 1.0, 0.0, 0.0};
+  std::vector<double> v = {0.0, 1.0, 0.0, 0.0, 1.0, 0.0};
+  std::vector<double> w = {0.0, 0.0, -1.0, 0.0, 0.0, -1.0};
+  size_t num_rays = x.size();
+  std::vector<EntityHandle> vols(num_rays, vol_h);
+  const double* starts[3] = {x.data(), y.data(), z.data()};
+  const double* dirs[3] = {u.data(), v.data(), w.data()};
+
+  std::vector<EntityHandle> surfs(num_rays);
+  std::vector<double> dists(num_rays);
+  ErrorCode rval = DAG->ray_fire_batch(num_rays, vols.data(), starts, dirs,
+                                       surfs.data(), dists.data());
+  EXPECT_EQ(MB_SUCCESS, rval);
+
+  // every ray in the batch should match the result of a single ray fire
+  for (size_t i = 0; i < num_rays; i++) {
+    double point[3] = {x[i], y[i], z[i]};
+    double dir[3] = {u[i], v[i], w[i]};
+    EntityHandle next_surf;
+    double next_surf_dist;
+    DAG->ray_fire(vol_h, point, dir, next_surf, next_surf_dist);
+    EXPECT_EQ(next_surf, surfs[i]);
+    EXPECT_NEAR(next_surf_dist, dists[i], eps);
+  }
+  EXPECT_NEAR(5.0, dists[0], eps);
+  EXPECT_NEAR(15.0, dists[3], eps);
+
+  // with a flat BVH the rays are traversed as a packet, visiting each node
+  // once rather than once per ray
+  rval = DAG->build_flat_bvh();
+  EXPECT_EQ(MB_SUCCESS, rval);
+  DAG->set_query_stats(true);
+  const QueryStats* stats = DAG->query_stats();
+  std::vector<EntityHandle> single_surfs(num_rays);
+  std::vector<double> single_dists(num_rays);
+  for (size_t i = 0; i < num_rays; i++) {
+    double point[3] = {x[i], y[i], z[i]};
+    double dir[3] = {u[i], v[i], w[i]};
+    rval = DAG->ray_fire(vol_h, point, dir, single_surfs[i], single_dists[i]);
+    EXPECT_EQ(MB_SUCCESS, rval);
+  }
+  QueryStats::Counts single = stats->counts(1, QueryStats::RAY_FIRE);
+
+  DAG->reset_query_stats();
+  rval = DAG->ray_fire_batch(num_rays, vols.data(), starts, dirs,
+                             surfs.data(), dists.data());
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(single_surfs, surfs);
+  EXPECT_EQ(single_dists, dists);
+  EXPECT_EQ(num_rays, stats->calls(1, QueryStats::RAY_FIRE));
+  QueryStats::Counts packet = stats->counts(1, QueryStats::RAY_FIRE);
+  EXPECT_LT(packet.nodes, single.nodes);
+  DAG->set_query_stats(false);
+}
+
+TEST_F(DagmcRayFireTest, dagmc_index_queries) {
+  double point[3] = {1.0, 2.0, -3.0};
+  double dir[3] = {-0.48, 0.6, 0.64};
+
+  // the index queries agree with the handle queries, with either tree
+  for (int flat = 0; flat < 2; flat++) {
+    if (flat) {
+      ErrorCode rval = DAG->build_flat_bvh();
+      EXPECT_EQ(MB_SUCCESS, rval);
+    }
+    for (unsigned int i = 1; i <= DAG->num_entities(3); i++) {
+      EntityHandle vol_h = DAG->entity_by_index(3, i);
+      EntityHandle next_surf;
+      double next_surf_dist, next_surf_idx_dist;
+      int next_surf_idx;
+      ErrorCode rval =
+          DAG->ray_fire(vol_h, point, dir, next_surf, next_surf_dist);
+      EXPECT_EQ(MB_SUCCESS, rval);
+      rval =
+          DAG->ray_fire_idx(i, point, dir, next_surf_idx, next_surf_idx_dist);
+      EXPECT_EQ(MB_SUCCESS, rval);
+      EXPECT_EQ(next_surf, DAG->entity_by_index(2, next_surf_idx));
+      EXPECT_EQ(next_surf_dist, next_surf_idx_dist);
+
+      int result, result_idx;
+      rval = DAG->point_in_volume(vol_h, point, result, dir);
+      EXPECT_EQ(MB_SUCCESS, rval);
+      rval = DAG->point_in_volume_idx(i, point, result_idx, dir);
+      EXPECT_EQ(MB_SUCCESS, rval);
+      EXPECT_EQ(result, result_idx);
+    }
+  }
+
+  for (unsigned int i = 1; i <= DAG->num_entities(3); i++) {
+    EntityHandle vol_h = DAG->entity_by_index(3, i);
+    for (unsigned int j = 1; j <= DAG->num_entities(2); j++) {
+      EntityHandle surf_h = DAG->entity_by_index(2, j);
+      int sense = 2, sense_idx = 2;
+      ErrorCode rval = DAG->surface_sense(vol_h, surf_h, sense);
+      ErrorCode rval_idx = DAG->surface_sense_idx(i, j, sense_idx);
+      EXPECT_EQ(rval, rval_idx);
+      if (MB_SUCCESS == rval) {
+        EXPECT_EQ(sense, sense_idx);
+      }
+    }
+  }
+
+  double xyz[3] = {5.0, 0.0, 0.0};
+  double angle[3], angle_idx[3];
+  EntityHandle surf_h = DAG->entity_by_index(2, 1);
+  ErrorCode rval = DAG->get_angle(surf_h, xyz, angle);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = DAG->get_angle_idx(1, xyz, angle_idx);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  for (int i = 0; i < 3; i++) EXPECT_EQ(angle[i], angle_idx[i]);
+}
+
+TEST_F(DagmcRayFireTest, dagmc_rayfire_concurrent_contexts) {
+  // concurrent queries read the flat BVH (see DagMC::QueryContext)
+  ErrorCode rval = DAG->build_flat_bvh();
+  EXPECT_EQ(MB_SUCCESS, rval);
+
+  EntityHandle vol_h = DAG->entity_by_index(3, 1);
+  const int num_threads = 4;
+  const int rays_per_thread = 1000;
+  std::vector<int> failures(num_threads, 0);
+
+  // each thread streams along its own axis using a private query context
+  auto worker = [&](int tid) {
+    DagMC::QueryContext context;
+    double dir[3] = {0.0, 0.0, 0.0};
+    dir[tid % 3] = (tid < 3) ? 1.0 : -1.0;
+    double origin[3] = {0.0, 0.0, 0.0};
+    for (int i = 0; i < rays_per_thread; i++) {
+      context.reset();
+      EntityHandle next_surf;
+      double next_surf_dist;
+      ErrorCode rval = DAG->ray_fire(context, vol_h, origin, dir, next_surf,
+                                     next_surf_dist);
+      int result = -1;
+      rval = rval == MB_SUCCESS
+                 ? DAG->point_in_volume(context, vol_h, origin, result, dir)
+                 : rval;
+      if (rval != MB_SUCCESS || std::fabs(next_surf_dist - 5.0) > eps ||
+          result != 1)
+        failures[tid]++;
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int tid = 0; tid < num_threads; tid++)
+    threads.emplace_back(worker, tid);
+  for (auto& t : threads) t.join();
+
+  for (int tid = 0; tid < num_threads; tid++) EXPECT_EQ(0, failures[tid]);
+}
+
+TEST_F(DagmcRayFireTest, dagmc_flat_bvh_frontier_resume) {
+  ErrorCode rval = DAG->build_flat_bvh();
+  EXPECT_EQ(MB_SUCCESS, rval);
+
+  // stream along x in steps shorter than the distance limit, each ray
+  // resuming from the frontier of the previous one
+  DagMC::QueryContext context;
+  context.dist_limit = 2.0;
+  double dir[3] = {1.0, 0.0, 0.0};
+  double point[3] = {-4.0, 0.5, 0.5};
+  for (int step = 0; step < 4; step++) {
+    int next_surf_idx;
+    double next_surf_dist;
+    rval = DAG->ray_fire_idx(context, 1, point, dir, next_surf_idx,
+                             next_surf_dist);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    EXPECT_EQ(0, next_surf_idx);
+    point[0] += 2.0;
+  }
+  context.dist_limit = 0;
+  int next_surf_idx;
+  double next_surf_dist;
+  rval = DAG->ray_fire_idx(context, 1, point, dir, next_surf_idx,
+                           next_surf_dist);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_NE(0, next_surf_idx);
+  EXPECT_NEAR(1.0, next_surf_dist, eps);
+
+  // a ray along another line starts from the root again
+  double back[3] = {-1.0, 0.0, 0.0};
+  rval = DAG->ray_fire_idx(context, 1, point, back, next_surf_idx,
+                           next_surf_dist);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_NEAR(9.0, next_surf_dist, eps);
+}
+
+TEST_F(DagmcRayFireTest, dagmc_flat_bvh_rayfire) {
+  EntityHandle vol_h = DAG->entity_by_index(3, 1);
+  // rays from inside and outside the volume, along and off the axes
+  std::vector<std::array<double, 6>> rays = {
+      {0.0, 0.0, 0.0, -1.0, 0.0, 0.0},   {0.0, 0.0, 0.0, 0.6, 0.8, 0.0},
+      {1.0, 2.0, -3.0, 0.0, 0.0, 1.0},   {-10.0, 0.0, 0.0, 1.0, 0.0, 0.0},
+      {0.0, -10.0, 0.5, 0.0, 1.0, 0.0},  {2.0, 2.0, 2.0, -0.48, 0.6, 0.64},
+      {-10.0, 0.0, 0.0, -1.0, 0.0, 0.0}, {0.0, 0.0, 0.0, 0.0, 0.0, -1.0}};
+  std::vector<int> orientations = {1, -1};
+
+  for (int orientation : orientations) {
+    for (const auto& ray : rays) {
+      EntityHandle obb_surf, flat_surf;
+      double obb_dist, flat_dist;
+      DagMC::RayHistory obb_history, flat_history;
+
+      DAG->clear_flat_bvh();
+      EXPECT_FALSE(DAG->has_flat_bvh());
+      ErrorCode rval = DAG->ray_fire(vol_h, &ray[0], &ray[3], obb_surf,
+                                     obb_dist, &obb_history, 0, orientation);
+      EXPECT_EQ(MB_SUCCESS, rval);
+
+      rval = DAG->build_flat_bvh();
+      EXPECT_EQ(MB_SUCCESS, rval);
+      EXPECT_TRUE(DAG->has_flat_bvh());
+      rval = DAG->ray_fire(vol_h, &ray[0], &ray[3], flat_surf, flat_dist,
+                           &flat_history, 0, orientation);
+      EXPECT_EQ(MB_SUCCESS, rval);
+
+      EXPECT_EQ(obb_surf, flat_surf);
+      if (obb_surf) {
+        EXPECT_NEAR(obb_dist, flat_dist, eps);
+      }
+      EXPECT_EQ(obb_history.size(), flat_history.size());
+    }
+  }
+}
+
+TEST_F(DagmcRayFireTest, dagmc_flat_bvh_rayfire_history) {
+  ErrorCode rval = DAG->build_flat_bvh();
+  EXPECT_EQ(MB_SUCCESS, rval);
+
+  DagMC::RayHistory history;
+  EntityHandle vol_h = DAG->entity_by_index(3, 1);
+  double dir[3] = {1.0, 0.0, 0.0};
+  double origin[3] = {-10.0, 0.0, 0.0};
+  double next_surf_dist;
+  EntityHandle next_surf;
+
+  // same sequence as dagmc_outside_face_rayfire_history
+  DAG->ray_fire(vol_h, origin, dir, next_surf, next_surf_dist, &history, 0, 1);
+  EXPECT_NEAR(15.0, next_surf_dist, eps);
+  double xyz[3] = {origin[0] + next_surf_dist * dir[0], origin[1], origin[2]};
+  DAG->ray_fire(vol_h, xyz, dir, next_surf, next_surf_dist, &history, 0, 1);
+  DAG->ray_fire(vol_h, xyz, dir, next_surf, next_surf_dist, &history, 0, 1);
+  EXPECT_EQ(EntityHandle(0), next_surf);
+}
+
+TEST_F(DagmcRayFireTest, dagmc_flat_bvh_single_precision) {
+  EntityHandle vol_h = DAG->entity_by_index(3, 1);
+  std::vector<std::array<double, 6>> rays = {
+      {0.0, 0.0, 0.0, -1.0, 0.0, 0.0},   {0.0, 0.0, 0.0, 0.6, 0.8, 0.0},
+      {1.0, 2.0, -3.0, 0.0, 0.0, 1.0},   {-10.0, 0.0, 0.0, 1.0, 0.0, 0.0},
+      {0.0, -10.0, 0.5, 0.0, 1.0, 0.0},  {2.0, 2.0, 2.0, -0.48, 0.6, 0.64},
+      {-10.0, 0.0, 0.0, -1.0, 0.0, 0.0}, {0.0, 0.0, 0.0, 0.0, 0.0, -1.0}};
+  std::vector<int> orientations = {1, -1};
+
+  ErrorCode rval = DAG->build_flat_bvh();
+  EXPECT_EQ(MB_SUCCESS, rval);
+  std::vector<EntityHandle> expected_surfs;
+  std::vector<double> expected_dists;
+  std::vector<int> expected_results;
+  for (int orientation : orientations) {
+    for (const auto& ray : rays) {
+      EntityHandle next_surf;
+      double next_surf_dist;
+      rval = DAG->ray_fire(vol_h, &ray[0], &ray[3], next_surf, next_surf_dist,
+                           NULL, 0, orientation);
+      EXPECT_EQ(MB_SUCCESS, rval);
+      expected_surfs.push_back(next_surf);
+      expected_dists.push_back(next_surf_dist);
+    }
+  }
+  for (const auto& ray : rays) {
+    int result;
+    rval = DAG->point_in_volume(vol_h, &ray[0], result, &ray[3]);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    expected_results.push_back(result);
+  }
+
+  // the hits are refined in double precision, so the results are identical
+  DAG->set_single_precision(true);
+  rval = DAG->build_flat_bvh();
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_TRUE(DAG->single_precision());
+  size_t i = 0;
+  for (int orientation : orientations) {
+    for (const auto& ray : rays) {
+      EntityHandle next_surf;
+      double next_surf_dist;
+      rval = DAG->ray_fire(vol_h, &ray[0], &ray[3], next_surf, next_surf_dist,
+                           NULL, 0, orientation);
+      EXPECT_EQ(MB_SUCCESS, rval);
+      EXPECT_EQ(expected_surfs[i], next_surf);
+      EXPECT_EQ(expected_dists[i], next_surf_dist);
+      i++;
+    }
+  }
+  for (i = 0; i < rays.size(); i++) {
+    int result;
+    rval = DAG->point_in_volume(vol_h, &rays[i][0], result, &rays[i][3]);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    EXPECT_EQ(expected_results[i], result);
+  }
+
+  DAG->set_single_precision(false);
+  DAG->clear_flat_bvh();
+}
+
+TEST_F(DagmcRayFireTest, dagmc_winding_number_point_in_volume) {
+  EntityHandle vol_h = DAG->entity_by_index(3, 1);
+  // points inside, outside, near and on the boundary of the 10 cm cube
+  std::vector<std::array<double, 3>> points = {
+      {0.0, 0.0, 0.0},        {4.999, 0.0, 0.0},       {5.001, 0.0, 0.0},
+      {-10.0, 0.0, 0.0},      {2.0, 2.0, 2.0},         {4.9999, 4.9999, 4.9999},
+      {0.0, 0.0, 5.0000001},  {5.0, 0.0, 0.0}};
+  std::vector<int> expected = {1, 1, 0, 0, 1, 1, 0, 1};
+  double dir[3] = {-1.0, 0.0, 0.0};
+
+  DAG->set_winding_numbers(true);
+  ErrorCode rval = DAG->build_flat_bvh();
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_TRUE(DAG->winding_numbers());
+  for (size_t i = 0; i < points.size(); i++) {
+    int result;
+    rval = DAG->point_in_volume(vol_h, points[i].data(), result, dir);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    EXPECT_EQ(expected[i], result);
+  }
+
+  DAG->set_winding_numbers(false);
+  rval = DAG->build_flat_bvh();
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_FALSE(DAG->winding_numbers());
+  DAG->clear_flat_bvh();
+  EXPECT_FALSE(DAG->winding_numbers());
+}
+
+TEST_F(DagmcRayFireTest, dagmc_flat_bvh_empty_entities) {
+  // without OBB trees, so the flat BVH is constructed from the triangles
+  std::shared_ptr<DagMC> dag = std::make_shared<DagMC>();
+  ErrorCode rval = dag->load_file(input_file);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EntityHandle vol_h = dag->entity_by_index(3, 1);
+
+  // a surface without facets on the cube and a volume without surfaces
+  EntityHandle empty_surf, empty_vol;
+  rval = dag->moab_instance()->create_meshset(MESHSET_SET, empty_surf);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = dag->moab_instance()->create_meshset(MESHSET_SET, empty_vol);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = dag->geom_tool()->add_geo_set(empty_surf, 2);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = dag->geom_tool()->add_geo_set(empty_vol, 3);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = dag->moab_instance()->add_parent_child(vol_h, empty_surf);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = dag->geom_tool()->set_sense(empty_surf, vol_h, 1);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = dag->setup_impl_compl();
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = dag->setup_indices();
+  EXPECT_EQ(MB_SUCCESS, rval);
+
+  dag->set_winding_numbers(true);
+  rval = dag->build_flat_bvh();
+  EXPECT_EQ(MB_SUCCESS, rval);
+
+  double origin[3] = {0.0, 0.0, 0.0};
+  double dir[3] = {-1.0, 0.0, 0.0};
+  EntityHandle next_surf;
+  double next_surf_dist;
+  rval = dag->ray_fire(vol_h, origin, dir, next_surf, next_surf_dist);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_NEAR(5.0, next_surf_dist, eps);
+  int result = -1;
+  rval = dag->point_in_volume(vol_h, origin, result, dir);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(1, result);
+
+  // nothing bounds the empty volume
+  rval = dag->ray_fire(empty_vol, origin, dir, next_surf, next_surf_dist);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(0u, next_surf);
+  rval = dag->point_in_volume(empty_vol, origin, result, dir);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(0, result);
+
+  // refitting the empty surface leaves the rest of the tree intact
+  rval = dag->update_surfaces({empty_surf});
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = dag->ray_fire(vol_h, origin, dir, next_surf, next_surf_dist);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_NEAR(5.0, next_surf_dist, eps);
+  rval = dag->point_in_volume(vol_h, origin, result, dir);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(1, result);
+}
+
+TEST_F(DagmcRayFireTest, dagmc_implicit_complement_rayfire) {
+  EntityHandle ic_h;
+  ErrorCode rval = DAG->geom_tool()->get_implicit_complement(ic_h);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  // rays from outside the cube, towards it, grazing and away from it
+  std::vector<std::array<double, 6>> rays = {
+      {-10.0, 0.0, 0.0, 1.0, 0.0, 0.0}, {0.0, -10.0, 0.5, 0.0, 1.0, 0.0},
+      {8.0, 8.0, 8.0, -0.6, -0.48, -0.64}, {-10.0, 0.0, 0.0, -1.0, 0.0, 0.0},
+      {-10.0, 6.0, 0.0, 1.0, 0.0, 0.0}};
+
+  for (int orientation = -1; orientation <= 1; orientation += 2) {
+    for (const auto& ray : rays) {
+      EntityHandle obb_surf, flat_surf;
+      double obb_dist, flat_dist;
+
+      DAG->clear_flat_bvh();
+      rval = DAG->ray_fire(ic_h, &ray[0], &ray[3], obb_surf, obb_dist, NULL, 0,
+                           orientation);
+      EXPECT_EQ(MB_SUCCESS, rval);
+
+      rval = DAG->build_flat_bvh();
+      EXPECT_EQ(MB_SUCCESS, rval);
+      rval = DAG->ray_fire(ic_h, &ray[0], &ray[3], flat_surf, flat_dist, NULL,
+                           0, orientation);
+      EXPECT_EQ(MB_SUCCESS, rval);
+
+      EXPECT_EQ(obb_surf, flat_surf);
+      if (obb_surf) {
+        EXPECT_NEAR(obb_dist, flat_dist, eps);
+      }
+    }
+  }
+
+  // every ray went through the complement tree, counted with query stats
+  DAG->set_query_stats(true);
+  DAG->reset_complement_stats();
+  EntityHandle next_surf;
+  double next_surf_dist;
+  rval = DAG->ray_fire(ic_h, &rays[0][0], &rays[0][3], next_surf,
+                       next_surf_dist);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_NEAR(5.0, next_surf_dist, eps);
+  FlatBVH::ComplementStats stats = DAG->complement_stats();
+  EXPECT_EQ(1u, stats.rays);
+  EXPECT_GE(stats.volumes, 1u);
+  EXPECT_GT(stats.surfaces, 0u);
+}
+
+TEST_F(DagmcRayFireTest, dagmc_query_stats) {
+  EXPECT_EQ(nullptr, DAG->query_stats());
+  DAG->set_query_stats(true);
+  const QueryStats* stats = DAG->query_stats();
+  ASSERT_NE(nullptr, stats);
+
+  EntityHandle vol_h = DAG->entity_by_index(3, 1);
+  double origin[3] = {0.0, 0.0, 0.0};
+  double dir[3] = {1.0, 0.0, 0.0};
+  EntityHandle next_surf;
+  double next_surf_dist;
+  int result;
+  for (int i = 0; i < 3; i++) {
+    ErrorCode rval =
+        DAG->ray_fire(vol_h, origin, dir, next_surf, next_surf_dist);
+    EXPECT_EQ(MB_SUCCESS, rval);
+  }
+  ErrorCode rval = DAG->point_in_volume(vol_h, origin, result);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(3u, stats->calls(1, QueryStats::RAY_FIRE));
+  EXPECT_EQ(1u, stats->calls(1, QueryStats::POINT_IN_VOLUME));
+  EXPECT_EQ(0u, stats->calls(1, QueryStats::CLOSEST_TO_LOCATION));
+  EXPECT_GT(stats->counts(1, QueryStats::RAY_FIRE).nodes, 0u);
+
+  // the flat BVH counts its traversals too
+  DAG->reset_query_stats();
+  rval = DAG->build_flat_bvh();
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = DAG->ray_fire(vol_h, origin, dir, next_surf, next_surf_dist);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(1u, stats->calls(1, QueryStats::RAY_FIRE));
+  QueryStats::Counts counts = stats->counts(1, QueryStats::RAY_FIRE);
+  EXPECT_GT(counts.nodes, 0u);
+  EXPECT_GT(counts.leaves, 0u);
+  EXPECT_GE(counts.triangles, counts.leaves);
+
+  std::ostringstream json;
+  rval = DAG->write_query_stats(json);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_NE(std::string::npos, json.str().find("\"ray_fire\": {\"calls\": 1"));
+  EXPECT_EQ(std::string::npos, json.str().find("point_in_volume"));
+
+  DAG->set_query_stats(false);
+  EXPECT_EQ(nullptr, DAG->query_stats());
+}
+
+TEST_F(DagmcRayFireTest, dagmc_lost_particles) {
+  EntityHandle ic_h;
+  ErrorCode rval = DAG->geom_tool()->get_implicit_complement(ic_h);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  int ic_idx = DAG->index_by_handle(ic_h);
+  EXPECT_EQ(0u, DAG->lost_particles().total());
+
+  // lost in the implicit complement at the center of the cube
+  double center[3] = {0.0, 0.0, 0.0};
+  double dir[3] = {1.0, 0.0, 0.0};
+  LostParticles::Record lost;
+  rval = DAG->recover_lost_particle(ic_idx, center, dir, "ray_fire", lost);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(1, lost.recovered);
+  EXPECT_EQ(0.0, lost.nudge);
+  EXPECT_NE(0, lost.surface);
+  EXPECT_NEAR(5.0, lost.distance, eps);
+
+  // just outside the cube, heading into it
+  double outside[3] = {-5.0 - 0.5 * DAG->numerical_precision(), 0.0, 0.0};
+  rval = DAG->recover_lost_particle(ic_idx, outside, dir, "ray_fire", lost);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(1, lost.recovered);
+  EXPECT_NEAR(DAG->numerical_precision(), lost.nudge, eps);
+  EXPECT_NEAR(0.5 * DAG->numerical_precision(), lost.distance, eps);
+
+  EXPECT_EQ(2u, DAG->lost_particles().total());
+  EXPECT_EQ(2u, DAG->lost_particles().num_recovered());
+  EXPECT_EQ(2u, DAG->lost_particles().clusters(1.0).size());
+  std::vector<LostParticles::Cluster> clusters =
+      DAG->lost_particles().clusters(10.0);
+  ASSERT_EQ(1u, clusters.size());
+  EXPECT_EQ(2, clusters[0].count);
+  EXPECT_NEAR(-2.5, clusters[0].center[0], 1e-3);
+
+  std::ostringstream report;
+  rval = DAG->write_lost_particle_report(report, 10.0);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_NE(std::string::npos, report.str().find("# lost 2, recovered 2"));
+  EXPECT_NE(std::string::npos, report.str().find("\nlost ray_fire "));
+}
+
+TEST_F(DagmcRayFireTest, dagmc_transform_volume) {
+  EntityHandle vol_h = DAG->entity_by_index(3, 1);
+  ErrorCode rval = DAG->build_flat_bvh();
+  EXPECT_EQ(MB_SUCCESS, rval);
+
+  // move the cube by 1 cm along x, the flat BVH is refit
+  double matrix[9] = {1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0};
+  double translation[3] = {1.0, 0.0, 0.0};
+  rval = DAG->transform_volume(vol_h, matrix, translation);
+  EXPECT_EQ(MB_SUCCESS, rval);
+
+  double origin[3] = {0.0, 0.0, 0.0};
+  double dirs[2][3] = {{1.0, 0.0, 0.0}, {-1.0, 0.0, 0.0}};
+  double expected_dists[2] = {6.0, 4.0};
+  double inside[3] = {5.5, 0.0, 0.0}, outside[3] = {-4.5, 0.0, 0.0};
+  for (int pass = 0; pass < 2; pass++) {
+    for (int i = 0; i < 2; i++) {
+      EntityHandle next_surf;
+      double next_surf_dist;
+      rval = DAG->ray_fire(vol_h, origin, dirs[i], next_surf, next_surf_dist);
+      EXPECT_EQ(MB_SUCCESS, rval);
+      EXPECT_NEAR(expected_dists[i], next_surf_dist, eps);
+    }
+    int result;
+    rval = DAG->point_in_volume(vol_h, inside, result);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    EXPECT_EQ(1, result);
+    rval = DAG->point_in_volume(vol_h, outside, result);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    EXPECT_EQ(0, result);
+
+    // the OBB trees were rebuilt for the moved surfaces
+    DAG->clear_flat_bvh();
+  }
+}
+
+TEST_F(DagmcRayFireTest, dagmc_instances) {
+  EntityHandle vol_h = DAG->entity_by_index(3, 1);
+  // the cube rotated by 90 degrees about z and moved to x = 100
+  double rotation[9] = {0.0, -1.0, 0.0, 1.0, 0.0, 0.0, 0.0, 0.0, 1.0};
+  double translation[3] = {100.0, 0.0, 0.0};
+  int instance;
+  ErrorCode rval = DAG->add_instance(vol_h, rotation, translation, instance);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(1, DAG->num_instances());
+
+  double origin[3] = {100.0, 0.0, 0.0};
+  double dir[3] = {1.0, 0.0, 0.0};
+  EntityHandle next_surf;
+  double next_surf_dist;
+  DagMC::RayHistory history;
+  rval = DAG->ray_fire_instance(instance, origin, dir, next_surf,
+                                next_surf_dist, &history);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_NEAR(5.0, next_surf_dist, eps);
+
+  // the normal is rotated back into world coordinates
+  double hit[3] = {105.0, 0.0, 0.0}, angle[3];
+  rval = DAG->get_angle_instance(instance, next_surf, hit, angle, &history);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_NEAR(1.0, angle[0], eps);
+  EXPECT_NEAR(0.0, angle[1], eps);
+  EXPECT_NEAR(0.0, angle[2], eps);
+
+  int result;
+  double inside[3] = {103.0, 1.0, 0.0}, outside[3] = {106.0, 0.0, 0.0};
+  rval = DAG->point_in_instance(instance, inside, result);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(1, result);
+  rval = DAG->point_in_instance(instance, outside, result);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(0, result);
+
+  double point[3] = {100.0, 2.0, 0.0}, dist;
+  rval = DAG->closest_to_location_instance(instance, point, dist);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_NEAR(3.0, dist, eps);
+
+  double lower[3], upper[3];
+  rval = DAG->get_instance_box(instance, lower, upper);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  // the box is that of the OBB tree, which may be slightly larger
+  EXPECT_NEAR(95.0, lower[0], 1e-2);
+  EXPECT_NEAR(105.0, upper[0], 1e-2);
+
+  // only rigid transforms are accepted
+  double scaling[9] = {2.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0};
+  rval = DAG->add_instance(vol_h, scaling, translation, instance);
+  EXPECT_NE(MB_SUCCESS, rval);
+
+  // a row of three cubes along x
+  double lattice_origin[3] = {0.0, 50.0, 0.0};
+  double pitch[3] = {20.0, 20.0, 20.0};
+  int counts[3] = {3, 1, 1};
+  int lattice;
+  rval = DAG->add_lattice(vol_h, lattice_origin, pitch, counts, lattice);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(4, DAG->num_instances());
+  double in_second[3] = {24.0, 52.0, 0.0}, beyond[3] = {70.0, 50.0, 0.0};
+  int second = DAG->find_lattice_instance(lattice, in_second);
+  EXPECT_EQ(2, second);
+  EXPECT_EQ(-1, DAG->find_lattice_instance(lattice, beyond));
+  rval = DAG->point_in_instance(second, in_second, result);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(1, result);
+
+  // the instances are located through the top-level tree
+  rval = DAG->build_volume_tree();
+  EXPECT_EQ(MB_SUCCESS, rval);
+  int found;
+  rval = DAG->find_instance(in_second, found);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(second, found);
+  rval = DAG->find_instance(beyond, found);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(-1, found);
+
+  // a ray along the row enters the second cube first
+  double start[3] = {10.0, 50.0, 0.0};
+  rval = DAG->ray_fire_instances(start, dir, found, next_surf, next_surf_dist);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(second, found);
+  EXPECT_NEAR(5.0, next_surf_dist, eps);
+
+  DAG->clear_instances();
+  EXPECT_EQ(0, DAG->num_instances());
+}
+
+// the cache file and shared memory segments are mapped with POSIX calls
+#ifndef _WIN32
+TEST_F(DagmcRayFireTest, dagmc_flat_bvh_cache) {
+  static const char cache_file[] = "test_geom_bvh.cache";
+  std::remove(cache_file);
+
+  // the first run builds the flat BVH and writes the cache
+  std::shared_ptr<DagMC> writer = std::make_shared<DagMC>();
+  ErrorCode rval = writer->load_file(input_file);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = writer->set_bvh_cache(cache_file);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = writer->init_OBBTree();
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_TRUE(writer->has_flat_bvh());
+
+  // the second run maps it instead of building any trees
+  std::shared_ptr<DagMC> reader = std::make_shared<DagMC>();
+  rval = reader->load_file(input_file);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = reader->set_bvh_cache(cache_file);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = reader->init_OBBTree();
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_TRUE(reader->has_flat_bvh());
+  EXPECT_FALSE(reader->has_acceleration_datastructures());
+
+  EntityHandle vol_h = reader->entity_by_index(3, 1);
+  double dir[3] = {1.0, 0.0, 0.0};
+  double origin[3] = {-10.0, 0.0, 0.0};
+  EntityHandle next_surf, expected_surf;
+  double next_surf_dist, expected_dist;
+  rval = reader->ray_fire(vol_h, origin, dir, next_surf, next_surf_dist);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = DAG->ray_fire(DAG->entity_by_index(3, 1), origin, dir, expected_surf,
+                       expected_dist);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_NEAR(15.0, next_surf_dist, eps);
+  EXPECT_EQ(DAG->index_by_handle(expected_surf),
+            reader->index_by_handle(next_surf));
+
+  // a cache written for another model is not used
+  std::shared_ptr<DagMC> other = std::make_shared<DagMC>();
+  rval = other->load_file("test_dagmc.h5m");
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = other->init_OBBTree();
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(MB_FAILURE, other->load_bvh_cache(cache_file));
+  EXPECT_FALSE(other->has_flat_bvh());
+
+  std::remove(cache_file);
+}
+
+TEST_F(DagmcRayFireTest, dagmc_flat_bvh_shared_memory) {
+  static const char segment[] = "dagmc_test_geom_bvh";
+  FlatBVH::unlink_shared(segment);
+
+  // the first process writes the segment, the second maps it
+  std::shared_ptr<DagMC> writer = std::make_shared<DagMC>();
+  ErrorCode rval = writer->load_file(input_file);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(MB_SUCCESS, writer->set_bvh_shared_memory(segment));
+  rval = writer->init_OBBTree();
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_TRUE(writer->has_flat_bvh());
+
+  std::shared_ptr<DagMC> reader = std::make_shared<DagMC>();
+  rval = reader->load_file(input_file);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(MB_SUCCESS, reader->set_bvh_shared_memory(segment, 1.0));
+  rval = reader->init_OBBTree();
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_TRUE(reader->has_flat_bvh());
+  EXPECT_FALSE(reader->has_acceleration_datastructures());
+
+  double dir[3] = {1.0, 0.0, 0.0};
+  double origin[3] = {-10.0, 0.0, 0.0};
+  EntityHandle next_surf, expected_surf;
+  double next_surf_dist, expected_dist;
+  rval = reader->ray_fire(reader->entity_by_index(3, 1), origin, dir,
+                          next_surf, next_surf_dist);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  rval = writer->ray_fire(writer->entity_by_index(3, 1), origin, dir,
+                          expected_surf, expected_dist);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_NEAR(15.0, next_surf_dist, eps);
+  EXPECT_EQ(writer->index_by_handle(expected_surf),
+            reader->index_by_handle(next_surf));
+
+  // only one process writes the segment, which is removed with the writer
+  int fd;
+  EXPECT_EQ(MB_ALREADY_ALLOCATED, FlatBVH::create_shared(segment, fd));
+  writer.reset();
+  EXPECT_EQ(MB_SUCCESS, FlatBVH::create_shared(segment, fd));
+  FlatBVH::unlink_shared(segment, fd);
+
+  // a segment written for another model is replaced, the process replacing
+  // it becomes its writer
+  std::shared_ptr<DagMC> other = std::make_shared<DagMC>();
+  rval = other->load_file("test_dagmc.h5m");
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(MB_SUCCESS, other->set_bvh_shared_memory(segment));
+  rval = other->init_OBBTree();
+  EXPECT_EQ(MB_SUCCESS, rval);
+
+  std::shared_ptr<DagMC> replacer = std::make_shared<DagMC>();
+  rval = replacer->load_file(input_file);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_EQ(MB_SUCCESS, replacer->set_bvh_shared_memory(segment, 1.0));
+  rval = replacer->init_OBBTree();
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_TRUE(replacer->has_flat_bvh());
+  rval = replacer->ray_fire(replacer->entity_by_index(3, 1), origin, dir,
+                            next_surf, next_surf_dist);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_NEAR(15.0, next_surf_dist, eps);
+  replacer.reset();
+  EXPECT_EQ(MB_SUCCESS, FlatBVH::create_shared(segment, fd));
+  FlatBVH::unlink_shared(segment, fd);
+}
+#endif
+
+TEST_F(DagmcRayFireTest, dagmc_ray_tri_kernel) {
+  // pack every triangle of the model in blocks
+  std::vector<EntityHandle> tris;
+  ErrorCode rval = DAG->moab_instance()->get_entities_by_type(0, MBTRI, tris);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  const int BLOCK = RayTriKernel::BLOCK;
+  int num_blocks = (tris.size() + BLOCK - 1) / BLOCK;
+  std::vector<double> blocks(num_blocks * RayTriKernel::BLOCK_SIZE, 0.0);
+  std::vector<uint8_t> edge_flags(num_blocks * BLOCK, 0);
+  std::vector<std::array<CartVect, 3>> verts(tris.size());
+  for (size_t t = 0; t < tris.size(); t++) {
+    const EntityHandle* conn;
+    int len;
+    rval = DAG->moab_instance()->get_connectivity(tris[t], conn, len);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    double coords[9];
+    rval = DAG->moab_instance()->get_coords(conn, 3, coords);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    for (int v = 0; v < 3; v++) verts[t][v] = CartVect(coords + 3 * v);
+    RayTriKernel::pack(&blocks[t / BLOCK * RayTriKernel::BLOCK_SIZE],
+                       &edge_flags[t / BLOCK * BLOCK], t % BLOCK, coords);
+  }
+
+  // rays through faces, edges and vertices of the model
+  std::vector<std::array<double, 6>> rays = {
+      {0.0, 0.0, 0.0, 1.0, 0.0, 0.0},   {0.0, 0.0, 0.0, 0.0, 0.6, 0.8},
+      {-10.0, 0.0, 0.0, 1.0, 0.0, 0.0}, {0.0, 0.0, 0.0, 0.6, 0.0, 0.8},
+      {1.0, 2.0, -3.0, 0.0, 0.0, 1.0},  {2.0, 2.0, 2.0, -0.48, 0.6, 0.64}};
+  const double t_min = -1.0, t_max = 100.0;
+
+  const RayTriKernel::Isa initial = RayTriKernel::active_isa();
+  for (int isa = RayTriKernel::SCALAR; isa <= RayTriKernel::supported_isa();
+       isa++) {
+    EXPECT_EQ(isa, RayTriKernel::set_isa(RayTriKernel::Isa(isa)));
+    for (const auto& r : rays) {
+      RayTriKernel::Ray ray(&r[0], &r[3]);
+      const CartVect origin(&r[0]), direction(&r[3]);
+      for (int b = 0; b < num_blocks; b++) {
+        double dists[RayTriKernel::BLOCK];
+        unsigned hits = RayTriKernel::intersect(
+            &blocks[b * RayTriKernel::BLOCK_SIZE], &edge_flags[b * BLOCK], ray,
+            t_min, t_max, dists);
+        for (int lane = 0; lane < BLOCK; lane++) {
+          size_t t = b * BLOCK + lane;
+          bool hit = hits & (1u << lane);
+          if (t >= tris.size()) {
+            EXPECT_FALSE(hit);
+            continue;
+          }
+          double dist, nonneg_len = t_max, neg_len = t_min;
+          bool expected = GeomUtil::plucker_ray_tri_intersect(
+              verts[t].data(), origin, direction, dist, &nonneg_len, &neg_len);
+          EXPECT_EQ(expected, hit);
+          if (expected && hit) {
+            EXPECT_NEAR(dist, dists[lane], 1e-12);
+          }
+        }
+      }
+    }
+  }
+  RayTriKernel::set_isa(initial);
+}
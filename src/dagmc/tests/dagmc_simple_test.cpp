@@ -1,6 +1,9 @@
 #include <gtest/gtest.h>
 
+#include <array>
+#include <cmath>
 #include <iostream>
+#include <vector>
 
 #include "DagMC.hpp"
 #include "moab/Core.hpp"
@@ -64,6 +67,32 @@ TEST_F(DagmcSimpleTest, dagmc_load_file_dagmc_internal) {
   EXPECT_EQ(rval, MB_SUCCESS);
 }
 
+TEST_F(DagmcSimpleTest, dagmc_load_file_geometry_only) {
+  std::shared_ptr<DagMC> full = std::make_shared<DagMC>();
+  ErrorCode rval = full->load_file(input_file);
+  EXPECT_EQ(rval, MB_SUCCESS);
+  rval = full->init_OBBTree();
+  EXPECT_EQ(rval, MB_SUCCESS);
+
+  std::shared_ptr<DagMC> dagmc = std::make_shared<DagMC>();
+  dagmc->set_load_options("", true);
+  rval = dagmc->load_file(input_file);
+  EXPECT_EQ(rval, MB_SUCCESS);
+  rval = dagmc->init_OBBTree();
+  EXPECT_EQ(rval, MB_SUCCESS);
+  EXPECT_EQ(full->num_entities(2), dagmc->num_entities(2));
+  EXPECT_EQ(full->num_entities(3), dagmc->num_entities(3));
+
+  // the same point is found in the same volume
+  double xyz[3] = {0.0, 0.0, 0.0};
+  int full_result, result;
+  rval = full->point_in_volume(full->entity_by_index(3, 1), xyz, full_result);
+  EXPECT_EQ(rval, MB_SUCCESS);
+  rval = dagmc->point_in_volume(dagmc->entity_by_index(3, 1), xyz, result);
+  EXPECT_EQ(rval, MB_SUCCESS);
+  EXPECT_EQ(full_result, result);
+}
+
 TEST_F(DagmcSimpleTest, dagmc_load_file_dagmc_build_obb) {
   /* 1 - Test with external moab, load file in DAGMC*/
   // make new moab core
@@ -167,6 +196,70 @@ TEST_F(DagmcSimpleTest, dagmc_find_volume) {
   EXPECT_EQ(rval, MB_SUCCESS);
   EXPECT_EQ(expected_vol_h, vol_h);
 }
+
+TEST_F(DagmcSimpleTest, dagmc_find_volume_point_locator) {
+  // points inside and outside the cube, close to and away from its faces
+  std::vector<std::array<double, 3>> points = {
+      {0.0, 0.0, 0.0},  {4.9, 0.0, 0.0},  {-4.99, 3.0, 2.0},
+      {2.0, 2.0, 2.0},  {5.5, 0.0, 0.0},  {0.0, 0.0, -6.0},
+      {-1.0, 4.5, -4.5}};
+  std::vector<EntityHandle> expected_vols;
+  for (const auto& xyz : points) {
+    EntityHandle vol_h = 0;
+    ErrorCode rval = DAG->find_volume(xyz.data(), vol_h);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    expected_vols.push_back(vol_h);
+  }
+  EXPECT_EQ(DAG->entity_by_index(3, 1), expected_vols[0]);
+
+  ErrorCode rval = DAG->build_point_locator(4096);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_TRUE(DAG->has_point_locator());
+  for (size_t i = 0; i < points.size(); i++) {
+    EntityHandle vol_h = 0;
+    rval = DAG->find_volume(points[i].data(), vol_h);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    EXPECT_EQ(expected_vols[i], vol_h);
+  }
+
+  DAG->clear_point_locator();
+  EXPECT_FALSE(DAG->has_point_locator());
+}
+
+TEST_F(DagmcSimpleTest, dagmc_find_volume_volume_tree) {
+  std::vector<std::array<double, 3>> points = {
+      {0.0, 0.0, 0.0}, {4.9, 0.0, 0.0}, {5.5, 0.0, 0.0}, {0.0, 0.0, -6.0}};
+  std::vector<EntityHandle> expected_vols;
+  for (const auto& xyz : points) {
+    EntityHandle vol_h = 0;
+    ErrorCode rval = DAG->find_volume(xyz.data(), vol_h);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    expected_vols.push_back(vol_h);
+  }
+
+  ErrorCode rval = DAG->build_volume_tree();
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_TRUE(DAG->has_volume_tree());
+  for (size_t i = 0; i < points.size(); i++) {
+    EntityHandle vol_h = 0;
+    rval = DAG->find_volume(points[i].data(), vol_h);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    EXPECT_EQ(expected_vols[i], vol_h);
+  }
+
+  // the implicit complement is not among the volumes found
+  std::vector<EntityHandle> volumes;
+  rval = DAG->find_volumes(points[0].data(), volumes);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  ASSERT_EQ(1u, volumes.size());
+  EXPECT_EQ(DAG->entity_by_index(3, 1), volumes[0]);
+  rval = DAG->find_volumes(points[2].data(), volumes);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_TRUE(volumes.empty());
+
+  DAG->clear_volume_tree();
+  EXPECT_FALSE(DAG->has_volume_tree());
+}
 #endif
 
 TEST_F(DagmcSimpleTest, dagmc_test_obb_retreval_rayfire) {
@@ -247,6 +340,39 @@ TEST_F(DagmcSimpleTest, dagmc_closest_to) {
   EXPECT_NEAR(expect_distance, distance, eps);
 }
 
+TEST_F(DagmcSimpleTest, dagmc_safety_distance) {
+  EntityHandle vol_h = DAG->entity_by_index(3, 1);
+  ErrorCode rval = DAG->build_distance_cache(vol_h, 3);
+  EXPECT_EQ(MB_SUCCESS, rval);
+
+  // the cached bounds never exceed the exact distance
+  std::vector<std::array<double, 3>> points = {
+      {0.0, 0.0, 0.0}, {-6.0, 0.0, 0.0}, {1.0, -2.0, 3.5},
+      {4.9, 4.9, 0.0}, {7.0, 8.0, -9.0}, {-3.3, 0.1, 2.2}};
+  for (const auto& xyz : points) {
+    double exact, bound;
+    rval = DAG->closest_to_location(vol_h, xyz.data(), exact);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    rval = DAG->safety_distance(vol_h, xyz.data(), bound);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    EXPECT_LE(bound, exact + 1e-12);
+    EXPECT_GT(bound, 0.0);
+
+    // bounds below min_distance are replaced by the exact distance
+    rval = DAG->safety_distance(vol_h, xyz.data(), bound, 100.0);
+    EXPECT_EQ(MB_SUCCESS, rval);
+    EXPECT_EQ(exact, bound);
+  }
+
+  // at the center of the cube the bound is tight
+  double center[3] = {0.0, 0.0, 0.0}, bound;
+  rval = DAG->safety_distance(vol_h, center, bound);
+  EXPECT_EQ(MB_SUCCESS, rval);
+  EXPECT_NEAR(5.0, bound, 1e-6);
+
+  DAG->clear_distance_caches();
+}
+
 TEST_F(DagmcSimpleTest, dagmc_test_boundary) {
   int vol_idx = 1;
   EntityHandle vol_h = DAG->entity_by_index(3, vol_idx);
@@ -264,6 +390,58 @@ TEST_F(DagmcSimpleTest, dagmc_test_boundary) {
   EXPECT_EQ(expect_result, result);
 }
 
+TEST_F(DagmcSimpleTest, dagmc_next_vol) {
+  // the lookup table agrees with the topology of the model
+  for (unsigned int i = 1; i <= DAG->num_entities(2); i++) {
+    EntityHandle surf_h = DAG->entity_by_index(2, i);
+    for (unsigned int j = 1; j <= DAG->num_entities(3); j++) {
+      EntityHandle vol_h = DAG->entity_by_index(3, j);
+      EntityHandle expected_vol_h = 0, next_vol_h = 0;
+      ErrorCode expected_rval =
+          DAG->geom_tool()->next_vol(surf_h, vol_h, expected_vol_h);
+      ErrorCode rval = DAG->next_vol(surf_h, vol_h, next_vol_h);
+      EXPECT_EQ(expected_rval, rval);
+      if (MB_SUCCESS == expected_rval) {
+        EXPECT_EQ(expected_vol_h, next_vol_h);
+        EXPECT_EQ(DAG->index_by_handle(expected_vol_h),
+                  DAG->next_vol_idx(i, j));
+      } else {
+        EXPECT_EQ(0, DAG->next_vol_idx(i, j));
+      }
+    }
+  }
+}
+
+TEST_F(DagmcSimpleTest, dagmc_surface_sense) {
+  // the sense table agrees with the sense tags of the model
+  std::vector<EntityHandle> surfs;
+  for (unsigned int i = 1; i <= DAG->num_entities(2); i++)
+    surfs.push_back(DAG->entity_by_index(2, i));
+
+  for (unsigned int i = 1; i <= DAG->num_entities(3); i++) {
+    EntityHandle vol_h = DAG->entity_by_index(3, i);
+    std::vector<int> senses(surfs.size(), 2), expected_senses(surfs.size(), 2);
+    ErrorCode expected_rval =
+        DAG->geom_tool()->get_surface_senses(vol_h, surfs.size(), surfs.data(),
+                                             expected_senses.data());
+    ErrorCode rval =
+        DAG->surface_sense(vol_h, surfs.size(), surfs.data(), senses.data());
+    EXPECT_EQ(expected_rval, rval);
+    if (MB_SUCCESS == rval) {
+      EXPECT_EQ(expected_senses, senses);
+    }
+
+    for (EntityHandle surf_h : surfs) {
+      int sense = 2, expected_sense = 2;
+      expected_rval =
+          DAG->geom_tool()->get_sense(surf_h, vol_h, expected_sense);
+      rval = DAG->surface_sense(vol_h, surf_h, sense);
+      EXPECT_EQ(expected_rval, rval);
+      EXPECT_EQ(expected_sense, sense);
+    }
+  }
+}
+
 TEST_F(DagmcSimpleTest, dagmc_test_get_obb) {
   int vol_idx = 1;
   EntityHandle vol_h = DAG->entity_by_index(3, vol_idx);
@@ -278,4 +456,108 @@ TEST_F(DagmcSimpleTest, dagmc_test_get_obb) {
     EXPECT_LE(llc[i], -geom_extent);
     EXPECT_GE(urc[i], geom_extent);
   }
-}
\ No newline at end of file
+}
+
+TEST_F(DagmcSimpleTest, dagmc_measure_all) {
+  std::vector<double> volumes, areas;
+  ErrorCode rval = DAG->measure_all(volumes, areas, false);
+  EXPECT_EQ(rval, MB_SUCCESS);
+  ASSERT_EQ(DAG->num_entities(3) + 1, volumes.size());
+  ASSERT_EQ(DAG->num_entities(2) + 1, areas.size());
+
+  for (unsigned int i = 1; i <= DAG->num_entities(3); i++) {
+    double volume;
+    rval = DAG->measure_volume(DAG->entity_by_index(3, i), volume);
+    EXPECT_EQ(rval, MB_SUCCESS);
+    EXPECT_NEAR(volume, volumes[i], 1e-9 * std::abs(volume));
+  }
+  // the cube of 'test_geom.h5m'
+  EXPECT_NEAR(1000.0, volumes[1], 1e-9);
+  for (unsigned int i = 1; i <= DAG->num_entities(2); i++) {
+    double area;
+    rval = DAG->measure_area(DAG->entity_by_index(2, i), area);
+    EXPECT_EQ(rval, MB_SUCCESS);
+    EXPECT_NEAR(area, areas[i], 1e-9 * area);
+  }
+
+  // the measures tagged on the surfaces are reused unless asked not to
+  Tag measure_tag;
+  rval = DAG->moab_instance()->tag_get_handle("DAGMC_MEASURE", 3,
+                                              MB_TYPE_DOUBLE, measure_tag);
+  ASSERT_EQ(rval, MB_SUCCESS);
+  EntityHandle surf = DAG->entity_by_index(2, 1);
+  double measures[3];
+  rval = DAG->moab_instance()->tag_get_data(measure_tag, &surf, 1, measures);
+  EXPECT_EQ(rval, MB_SUCCESS);
+  EXPECT_DOUBLE_EQ(areas[1], measures[0]);
+  measures[0] = 2.0 * areas[1];
+  rval = DAG->moab_instance()->tag_set_data(measure_tag, &surf, 1, measures);
+  EXPECT_EQ(rval, MB_SUCCESS);
+
+  std::vector<double> cached_volumes, cached_areas;
+  rval = DAG->measure_all(cached_volumes, cached_areas);
+  EXPECT_EQ(rval, MB_SUCCESS);
+  EXPECT_EQ(volumes, cached_volumes);
+  EXPECT_DOUBLE_EQ(2.0 * areas[1], cached_areas[1]);
+
+  rval = DAG->measure_all(cached_volumes, cached_areas, false);
+  EXPECT_EQ(rval, MB_SUCCESS);
+  EXPECT_DOUBLE_EQ(areas[1], cached_areas[1]);
+
+  // but not once a vertex has moved, even without update_surfaces()
+  rval = DAG->moab_instance()->tag_set_data(measure_tag, &surf, 1, measures);
+  EXPECT_EQ(rval, MB_SUCCESS);
+  std::vector<EntityHandle> tris, verts;
+  rval = DAG->moab_instance()->get_entities_by_type(surf, MBTRI, tris);
+  EXPECT_EQ(rval, MB_SUCCESS);
+  rval = DAG->moab_instance()->get_connectivity(&tris[0], 1, verts);
+  EXPECT_EQ(rval, MB_SUCCESS);
+  double xyz[3];
+  rval = DAG->moab_instance()->get_coords(&verts[0], 1, xyz);
+  EXPECT_EQ(rval, MB_SUCCESS);
+  for (int d = 0; d < 3; d++) xyz[d] *= 1.1;
+  rval = DAG->moab_instance()->set_coords(&verts[0], 1, xyz);
+  EXPECT_EQ(rval, MB_SUCCESS);
+
+  rval = DAG->measure_all(cached_volumes, cached_areas);
+  EXPECT_EQ(rval, MB_SUCCESS);
+  for (unsigned int i = 1; i <= DAG->num_entities(2); i++) {
+    double area;
+    rval = DAG->measure_area(DAG->entity_by_index(2, i), area);
+    EXPECT_EQ(rval, MB_SUCCESS);
+    EXPECT_NEAR(area, cached_areas[i], 1e-9 * area);
+  }
+  double volume;
+  rval = DAG->measure_volume(DAG->entity_by_index(3, 1), volume);
+  EXPECT_EQ(rval, MB_SUCCESS);
+  EXPECT_NEAR(volume, cached_volumes[1], 1e-9 * volume);
+  EXPECT_GT(volume, 1000.0);
+}
+
+TEST_F(DagmcSimpleTest, dagmc_measure_all_transform) {
+  std::vector<double> volumes, areas;
+  ErrorCode rval = DAG->measure_all(volumes, areas);
+  EXPECT_EQ(rval, MB_SUCCESS);
+
+  // doubling the cube invalidates the measures tagged on its surfaces
+  double matrix[9] = {2.0, 0.0, 0.0, 0.0, 2.0, 0.0, 0.0, 0.0, 2.0};
+  double translation[3] = {0.0, 0.0, 0.0};
+  rval = DAG->transform_volume(DAG->entity_by_index(3, 1), matrix, translation);
+  EXPECT_EQ(rval, MB_SUCCESS);
+
+  rval = DAG->measure_all(volumes, areas);
+  EXPECT_EQ(rval, MB_SUCCESS);
+  EXPECT_NEAR(8000.0, volumes[1], 1e-9 * 8000.0);
+  for (unsigned int i = 1; i <= DAG->num_entities(3); i++) {
+    double volume;
+    rval = DAG->measure_volume(DAG->entity_by_index(3, i), volume);
+    EXPECT_EQ(rval, MB_SUCCESS);
+    EXPECT_NEAR(volume, volumes[i], 1e-9 * std::abs(volume));
+  }
+  for (unsigned int i = 1; i <= DAG->num_entities(2); i++) {
+    double area;
+    rval = DAG->measure_area(DAG->entity_by_index(2, i), area);
+    EXPECT_EQ(rval, MB_SUCCESS);
+    EXPECT_NEAR(area, areas[i], 1e-9 * area);
+  }
+}
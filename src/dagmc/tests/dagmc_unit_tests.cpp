@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 
@@ -223,6 +224,76 @@ TEST_F(DagmcMetadataTest, TestBoundaryAssigns) {
   EXPECT_EQ(expected_surface_bc, actual_surface_bc);
 }
 //---------------------------------------------------------------------------//
+// FIXTURE-BASED TESTS: Tests to make sure that the typed properties by index
+// agree with the string properties
+//---------------------------------------------------------------------------//
+TEST_F(DagmcMetadataTest, TestTypedProperties) {
+  // new metadata instance
+  dgm = std::make_shared<dagmcMetaData>(DAG.get());
+
+  // process
+  dgm->load_property_data();
+
+  int neutron = dgm->importance_particle("Neutron");
+  EXPECT_GE(neutron, 0);
+  EXPECT_EQ(-1, dgm->importance_particle("Muon"));
+
+  int num_vols = DAG->num_entities(3);
+  for (int i = 1; i <= num_vols; i++) {
+    moab::EntityHandle eh = DAG->entity_by_index(3, i);
+    EXPECT_EQ(dgm->get_volume_property("material", i, true),
+              dgm->volume_material(i));
+    EXPECT_TRUE(std::isnan(dgm->volume_density(i)));
+    EXPECT_DOUBLE_EQ(1.0, dgm->volume_importance(i, neutron));
+    if (!DAG->is_implicit_complement(eh)) {
+      EXPECT_EQ(-1, dgm->volume_material_id(i));
+      EXPECT_FALSE(dgm->volume_is_vacuum(i));
+    } else {
+      EXPECT_EQ(0, dgm->volume_material_id(i));
+      EXPECT_TRUE(dgm->volume_is_vacuum(i));
+    }
+    EXPECT_FALSE(dgm->volume_is_graveyard(i));
+  }
+
+  int reflecting_idx = DAG->index_by_handle(DAG->entity_by_id(2, 1));
+  EXPECT_EQ(dagmcMetaData::REFLECTING_BOUNDARY,
+            dgm->surface_boundary(reflecting_idx));
+  int vacuum_idx = DAG->index_by_handle(DAG->entity_by_id(2, 17));
+  EXPECT_EQ(dagmcMetaData::VACUUM_BOUNDARY, dgm->surface_boundary(vacuum_idx));
+}
+//---------------------------------------------------------------------------//
+// FIXTURE-BASED TESTS: Tests that parsing the group names stores the values
+// of every group of an entity, and that parsing again appends to them
+//---------------------------------------------------------------------------//
+TEST_F(DagmcMetadataTest, TestParseProperties) {
+  std::vector<std::string> keywords = {"mat", "importance", "boundary"};
+  std::map<std::string, std::string> synonyms;
+  EXPECT_EQ(moab::MB_SUCCESS,
+            DAG->parse_properties(keywords, synonyms, ":"));
+
+  moab::EntityHandle vol = DAG->entity_by_id(3, 1);
+  std::vector<std::string> values;
+  EXPECT_EQ(moab::MB_SUCCESS, DAG->prop_values(vol, "mat", values));
+  EXPECT_EQ(std::vector<std::string>({"Hydrogen"}), values);
+
+  values.clear();
+  EXPECT_EQ(moab::MB_SUCCESS, DAG->prop_values(vol, "importance", values));
+  std::sort(values.begin(), values.end());
+  EXPECT_EQ(std::vector<std::string>({"Neutron/1.0", "Photon/1.0"}), values);
+
+  moab::EntityHandle surf = DAG->entity_by_id(2, 1);
+  EXPECT_FALSE(DAG->has_prop(surf, "mat"));
+  values.clear();
+  EXPECT_EQ(moab::MB_SUCCESS, DAG->prop_values(surf, "boundary", values));
+  EXPECT_EQ(std::vector<std::string>({"Reflecting"}), values);
+
+  EXPECT_EQ(moab::MB_SUCCESS,
+            DAG->parse_properties(keywords, synonyms, ":"));
+  values.clear();
+  EXPECT_EQ(moab::MB_SUCCESS, DAG->prop_values(vol, "mat", values));
+  EXPECT_EQ(std::vector<std::string>({"Hydrogen", "Hydrogen"}), values);
+}
+//---------------------------------------------------------------------------//
 // FIXTURE-BASED TESTS: Tests to make sure that all surfaces have successfully
 // been assigned and successfully retreved from the dataset, specifically
 // querying the boundary condition case
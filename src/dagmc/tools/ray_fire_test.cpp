@@ -73,6 +73,7 @@ static bool do_trv_stats = false;
 static double location_az = 2.0 * PI;
 static double direction_az = location_az;
 static const char* pyfile = NULL;
+static const char* statsfile = NULL;
 
 static int random_rays_missed =
     0;  // count of random rays that did not hit a surface
@@ -129,6 +130,9 @@ static void usage(const char* error, const char* opt,
     str << "-p <filename>  if present, save parameters and results to a python "
            "dictionary"
         << std::endl;
+    str << "-j <filename>  if present, write per-volume query statistics as "
+           "JSON"
+        << std::endl;
   }
 
   exit(error ? 1 : 0);
@@ -257,6 +261,9 @@ int main(int argc, char* argv[]) {
         case 'p':
           pyfile = get_option(i, argc, argv);
           break;
+        case 'j':
+          statsfile = get_option(i, argc, argv);
+          break;
       }
     } else {
       if (!filename) {
@@ -284,6 +291,7 @@ int main(int argc, char* argv[]) {
   }
 
   DagMC dagmc{};
+  if (statsfile) dagmc.set_query_stats_file(statsfile);
   rval = dagmc.load_file(filename);
   if (MB_SUCCESS != rval) {
     std::cerr << "Failed to load file '" << filename << "'" << std::endl;
@@ -1,7 +1,13 @@
 #ifndef _DAGMC_UTIL
 #define _DAGMC_UTIL
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <thread>
+#include <vector>
 
 namespace dagmc_util {
 
@@ -10,5 +16,37 @@ inline void lowercase_str(std::string& input) {
                  [](unsigned char c) { return std::tolower(c); });
 }
 
+// FNV-1a hash of a range of bytes, continuing from hash, which starts as
+// FNV_OFFSET
+const uint64_t FNV_OFFSET = 0xcbf29ce484222325ULL;
+inline void hash_bytes(uint64_t& hash, const void* bytes, size_t len) {
+  const unsigned char* c = static_cast<const unsigned char*>(bytes);
+  for (size_t i = 0; i < len; i++) {
+    hash ^= c[i];
+    hash *= 0x100000001b3ULL;
+  }
+}
+
+// run task(i) for every i in [0, n) on up to num_threads threads, all
+// available cores if num_threads <= 0
+template <typename Task>
+void parallel_for(int n, int num_threads, Task task) {
+  if (num_threads <= 0)
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  num_threads = std::min(num_threads, n);
+
+  std::atomic<int> next(0);
+  auto worker = [&]() {
+    for (int i = next++; i < n; i = next++) task(i);
+  };
+  if (num_threads <= 1) {
+    worker();
+    return;
+  }
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; t++) threads.emplace_back(worker);
+  for (auto& thread : threads) thread.join();
+}
+
 }  // namespace dagmc_util
 #endif
\ No newline at end of file
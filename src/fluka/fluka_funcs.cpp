@@ -113,7 +113,6 @@ void g_fire(int& oldRegion, double point[], double dir[], double& propStep,
       DAG->entity_by_index(3, oldRegion);  // get eh of current region
   moab::EntityHandle next_surf;            // next surf we hit
   double next_surf_dist;
-  moab::EntityHandle newvol = 0;
 
   if (debug) print_state(state);
 
@@ -228,11 +227,9 @@ void g_fire(int& oldRegion, double point[], double dir[], double& propStep,
   double proposed_step = propStep;
 
   if (proposed_step >= retStep) {  // will cross into next volume next step
-    moab::ErrorCode rval = DAG->next_vol(next_surf, vol, newvol);
-    if (moab::MB_SUCCESS != rval)
-      fludag_abort("g_fire", "DAGMC failed in next_vol", rval);
-
-    newRegion = DAG->index_by_handle(newvol);
+    newRegion = DAG->next_vol_idx(DAG->index_by_handle(next_surf), oldRegion);
+    if (0 == newRegion)
+      fludag_abort("g_fire", "DAGMC failed in next_vol", moab::MB_FAILURE);
     //      retStep = retStep; // path limited by geometry
     state.next_surface = next_surf;  // no operation - but for clarity
     state.on_boundary = true;
@@ -468,33 +465,38 @@ void f_look(double& pSx, double& pSy, double& pSz, double* pV,
 
     // we think that we are inside ,
     if (is_inside == 1) {  // we are inside the cell tested
-      // test point in vol again, but reverse the direction
-      double new_dir[3];
-      new_dir[0] = -1. * dir[0];
-      new_dir[1] = -1. * dir[1];
-      new_dir[2] = -1. * dir[2];
-
-      int second_test = 0;
-
-      moab::ErrorCode rval =
-          DAG->point_in_volume(volume, xyz, second_test, new_dir);
-      // check for non error
-      if (moab::MB_SUCCESS != rval)
-        fludag_abort("f_look", "DAGMC failed in point_in_volume", rval);
-
-      if (is_inside != second_test) {
-        if (debug) {
-          std::cout << "First test inconclusive, doing the slow test"
-                    << std::endl;
-        }
-
-        rval = DAG->point_in_volume_slow(volume, xyz, second_test);
+      // winding numbers do not depend on the direction, the first test
+      // is conclusive
+      if (!DAG->winding_numbers()) {
+        // test point in vol again, but reverse the direction
+        double new_dir[3];
+        new_dir[0] = -1. * dir[0];
+        new_dir[1] = -1. * dir[1];
+        new_dir[2] = -1. * dir[2];
+
+        int second_test = 0;
+
+        moab::ErrorCode rval =
+            DAG->point_in_volume(volume, xyz, second_test, new_dir);
+        // check for non error
         if (moab::MB_SUCCESS != rval)
-          fludag_abort("f_look", "DAGMC failed in point_in_volume_slow", rval);
-        // firing rays in two opposing directions didnt work, the slow test
-        // didnt work
-        if (second_test == 0) {
-          continue;
+          fludag_abort("f_look", "DAGMC failed in point_in_volume", rval);
+
+        if (is_inside != second_test) {
+          if (debug) {
+            std::cout << "First test inconclusive, doing the slow test"
+                      << std::endl;
+          }
+
+          rval = DAG->point_in_volume_slow(volume, xyz, second_test);
+          if (moab::MB_SUCCESS != rval)
+            fludag_abort("f_look", "DAGMC failed in point_in_volume_slow",
+                         rval);
+          // firing rays in two opposing directions didnt work, the slow test
+          // didnt work
+          if (second_test == 0) {
+            continue;
+          }
         }
       }
 
@@ -540,6 +542,17 @@ void f_lostlook(double& pSx, double& pSy, double& pSz, double* pV, int& oldReg,
   const double xyz[] = {pSx, pSy, pSz};  // location of the particle (xyz)
   const double dir[] = {pV[0], pV[1], pV[2]};
 
+  // record the particle for the lost particle report; a volume found at
+  // the particle's own location saves testing every volume below
+  moab::LostParticles::Record lost;
+  if (moab::MB_SUCCESS == DAG->recover_lost_particle(oldReg, xyz, dir,
+                                                     "f_lostlook", lost) &&
+      lost.recovered && 0.0 == lost.nudge) {
+    nextRegion = lost.recovered;
+    flagErr = nextRegion;
+    return;
+  }
+
   int is_inside = 0;
   int num_vols = DAG->num_entities(3);  // number of volumes
 
@@ -554,34 +567,38 @@ void f_lostlook(double& pSx, double& pSy, double& pSz, double* pV, int& oldReg,
 
     // we think that we are inside ,
     if (is_inside == 1) {  // we are inside the cell tested
-      // test point in vol again, but reverse the direction
-      double new_dir[3];
-      new_dir[0] = -1. * dir[0];
-      new_dir[1] = -1. * dir[1];
-      new_dir[2] = -1. * dir[2];
-
-      int second_test = 0;
-
-      moab::ErrorCode rval =
-          DAG->point_in_volume(volume, xyz, second_test, new_dir);
-      // check for non error
-      if (moab::MB_SUCCESS != rval)
-        fludag_abort("f_lostlook", "DAGMC failed in point_in_volume", rval);
-
-      if (is_inside != second_test) {
-        if (debug) {
-          std::cout << "First test inconclusive, doing the slow test"
-                    << std::endl;
-        }
-
-        rval = DAG->point_in_volume_slow(volume, xyz, second_test);
+      // winding numbers do not depend on the direction, the first test
+      // is conclusive
+      if (!DAG->winding_numbers()) {
+        // test point in vol again, but reverse the direction
+        double new_dir[3];
+        new_dir[0] = -1. * dir[0];
+        new_dir[1] = -1. * dir[1];
+        new_dir[2] = -1. * dir[2];
+
+        int second_test = 0;
+
+        moab::ErrorCode rval =
+            DAG->point_in_volume(volume, xyz, second_test, new_dir);
+        // check for non error
         if (moab::MB_SUCCESS != rval)
-          fludag_abort("f_lostlook", "DAGMC failed in point_in_volume_slow",
-                       rval);
-        // firing rays in two opposing directions didnt work, the slow test
-        // didnt work
-        if (second_test == 0) {
-          continue;
+          fludag_abort("f_lostlook", "DAGMC failed in point_in_volume", rval);
+
+        if (is_inside != second_test) {
+          if (debug) {
+            std::cout << "First test inconclusive, doing the slow test"
+                      << std::endl;
+          }
+
+          rval = DAG->point_in_volume_slow(volume, xyz, second_test);
+          if (moab::MB_SUCCESS != rval)
+            fludag_abort("f_lostlook", "DAGMC failed in point_in_volume_slow",
+                         rval);
+          // firing rays in two opposing directions didnt work, the slow test
+          // didnt work
+          if (second_test == 0) {
+            continue;
+          }
         }
       }
 
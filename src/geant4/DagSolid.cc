@@ -91,7 +91,8 @@ DagSolid::DagSolid()
 // Alternative constructor. Simple define name and geometry type - no facets
 // to define.
 //
-DagSolid::DagSolid(const G4String& name, DagMC* dagmc, int volID)
+DagSolid::DagSolid(const G4String& name, DagMC* dagmc, int volID,
+                   G4int distanceCacheDepth)
     : G4TessellatedSolid(name), cubicVolume(0.), surfaceArea(0.) {
   geometryType = "DagSolid";
   Myname = name;
@@ -100,6 +101,13 @@ DagSolid::DagSolid(const G4String& name, DagMC* dagmc, int volID)
   fvolID = volID;
   fvolEntity = fdagmc->entity_by_index(3, volID);
 
+  // without a cache the safety distances are exact searches of the facets
+  if (distanceCacheDepth > 0 &&
+      fdagmc->build_distance_cache(fvolEntity, distanceCacheDepth) !=
+          MB_SUCCESS) {
+    G4cout << "failed to build the distance cache of " << name << std::endl;
+  }
+
   double min[3], max[3];
   fdagmc->getobb(fvolEntity, min, max);
 
@@ -214,7 +222,8 @@ EInside DagSolid::Inside(const G4ThreeVector& p) const {
     exit(1);
   }
 
-  ec = fdagmc->closest_to_location(fvolEntity, point, minDist);
+  // only whether the point is within the tolerance of the surface matters
+  ec = fdagmc->safety_distance(fvolEntity, point, minDist, 0.5 * kCarTolerance);
 
   // if on surface
   if (minDist <= 0.5 * kCarTolerance) {
@@ -285,7 +294,8 @@ G4double DagSolid::DistanceToIn(const G4ThreeVector& p) const {
   G4double point[3] = {p.x() / cm, p.y() / cm,
                        p.z() / cm};  // convert position to cm
 
-  fdagmc->closest_to_location(fvolEntity, point, minDist);
+  fdagmc->safety_distance(fvolEntity, point, minDist,
+                          kCarTolerance * 0.5 / cm);
   minDist *= cm;  // convert back to mm
   if (minDist <= kCarTolerance * 0.5)
     return 0.0;
@@ -360,7 +370,8 @@ G4double DagSolid::DistanceToOut(const G4ThreeVector& p) const {
   G4double minDist = kInfinity;
   G4double point[3] = {p.x() / cm, p.y() / cm, p.z() / cm};  // convert to cm
 
-  fdagmc->closest_to_location(fvolEntity, point, minDist);
+  fdagmc->safety_distance(fvolEntity, point, minDist,
+                          kCarTolerance / 2.0 / cm);
   minDist *= cm;  // convert back to mm
   if (minDist < kCarTolerance / 2.0)
     return 0.0;
@@ -68,7 +68,12 @@ using namespace moab;
 class DagSolid : public G4TessellatedSolid {
  public:  // with description
   DagSolid();
-  DagSolid(const G4String& name, DagMC* dagmc, int volID);
+  // distanceCacheDepth > 0 builds the distance cache of the volume with that
+  // depth (see DagMC::build_distance_cache), which bounds the safety
+  // distances of Inside, DistanceToIn and DistanceToOut without searching
+  // the facets
+  DagSolid(const G4String& name, DagMC* dagmc, int volID,
+           G4int distanceCacheDepth = 0);
   virtual ~DagSolid();
 
   // Mandatory Functions
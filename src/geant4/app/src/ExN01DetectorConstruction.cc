@@ -109,8 +109,8 @@ G4VPhysicalVolume* ExN01DetectorConstruction::Construct() {
     // get the material_name
     std::string mat_name = DMD->volume_material_property_data_eh[volume];
 
-    // create new volume
-    DagSolid* dag_vol = new DagSolid("vol_" + idx_str, dagmc, dag_idx);
+    // create new volume, with a distance cache for its safety distances
+    DagSolid* dag_vol = new DagSolid("vol_" + idx_str, dagmc, dag_idx, 5);
     dag_volumes.push_back(dag_vol);
     // make new logical volume
     std::string material_name = mat_name;
@@ -118,6 +118,28 @@ TEST_F(DagSolidTest, point_outside_volume) {
   return;
 }
 
+/*
+ * Safety distances bounded by a distance cache give the same results
+ */
+TEST_F(DagSolidTest, distance_cache) {
+  DagMC* dagmc = new moab::DagMC();
+  dagmc->load_file("test_geom.h5m");
+  dagmc->init_OBBTree();
+  DagSolid* cached = new DagSolid("vol_1_cached", dagmc, 1, 4);
+
+  EXPECT_EQ(kInside, cached->Inside(G4ThreeVector(0., 0., 0.)));
+  EXPECT_EQ(kSurface, cached->Inside(G4ThreeVector(50., 0., 0.)));
+  EXPECT_EQ(kOutside, cached->Inside(G4ThreeVector(51., 0., 0.)));
+  G4ThreeVector outside = G4ThreeVector(-100., 0., 0.);
+  EXPECT_LE(cached->DistanceToIn(outside), vol_1->DistanceToIn(outside));
+  EXPECT_GT(cached->DistanceToIn(outside), 0.0);
+  G4ThreeVector inside = G4ThreeVector(0., 0., 0.);
+  EXPECT_LE(cached->DistanceToOut(inside), vol_1->DistanceToOut(inside));
+  EXPECT_GT(cached->DistanceToOut(inside), 0.0);
+
+  return;
+}
+
 /*
  * ray fire test, distance to in
  * only for points external to a volume
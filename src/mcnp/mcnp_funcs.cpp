@@ -36,15 +36,21 @@ static std::ostream* raystat_dump = NULL;
 
 /* Static values used by dagmctrack_ */
 
-static DagMC::RayHistory history;
-static int last_nps = 0;
-static double last_uvw[3] = {0, 0, 0};
-static std::vector<DagMC::RayHistory> history_bank;
-static std::vector<DagMC::RayHistory> pblcm_history_stack;
-static bool visited_surface = false;
+// per-particle query state is thread-local so that OpenMP builds of MCNP can
+// track particles concurrently against the single shared DAG instance, whose
+// flat BVH (built by dagmcinit_) answers the queries without the unsynchronized
+// counters of the GeomQueryTool
+static thread_local DagMC::QueryContext query_context;
+static thread_local DagMC::RayHistory& history = query_context.history;
+static thread_local int last_nps = 0;
+static thread_local double last_uvw[3] = {0, 0, 0};
+static thread_local std::vector<DagMC::RayHistory> history_bank;
+static thread_local std::vector<DagMC::RayHistory> pblcm_history_stack;
+static thread_local bool visited_surface = false;
+static int pblcm_stack_size = 0;
 
 static bool use_dist_limit = false;
-static double dist_limit;  // needs to be thread-local
+static thread_local double& dist_limit = query_context.dist_limit;
 
 static std::string graveyard_str = "Graveyard";
 static std::string vacuum_str = "Vacuum";
@@ -99,12 +105,25 @@ void dagmcinit_(char* cfile, int* clen,   // geom
     exit(EXIT_FAILURE);
   }
 
+  // the flat BVH serves concurrent queries and resumes rays from their
+  // frontier, the OBB trees remain a serial fallback
+  rval = DAG->build_flat_bvh();
+  if (moab::MB_SUCCESS != rval) {
+    std::cerr << "Warning: DAGMC failed to build the flat BVH, particles "
+              << "must be tracked serially" << std::endl;
+  }
+
+  // report the particles lost, if any, when the run ends
+  DAG->set_lost_particle_report("lost_particles.txt");
+
   // intialize the metadata
   DMD = new dagmcMetaData(DAG);
   DMD->load_property_data();
   // all metadata now loaded
 
-  pblcm_history_stack.resize(*max_pbl + 1);  // fortran will index from 1
+  // fortran will index from 1
+  pblcm_stack_size = *max_pbl + 1;
+  pblcm_history_stack.resize(pblcm_stack_size);
 }
 
 void dagmcwritefacets_(char* ffile, int* flen) {  // facet file
@@ -251,12 +270,11 @@ void write_cell_cards(std::ostringstream& lcadfile,
 
     // string to collect importance data
     std::string importances = "";
-    std::set<std::string>::iterator it;
-    std::set<std::string> set = DMD->imp_particles;
+    const std::vector<std::string>& particles = DMD->importance_particles();
     // deal with importances;
     std::string mat_name = DMD->volume_material_property_data_eh[entity];
-    for (it = set.begin(); it != set.end(); ++it) {
-      std::string particle_name = *it;
+    for (size_t p = 0; p < particles.size(); ++p) {
+      const std::string& particle_name = particles[p];
       std::string mcnp_name;
       if (mcnp_version_major[0] == '5') {
         mcnp_name = pyne::particle::mcnp(particle_name);
@@ -276,12 +294,12 @@ void write_cell_cards(std::ostringstream& lcadfile,
         imp = 1.0;
         // otherwise as the map says
       } else {
-        imp = DMD->importance_map[entity][particle_name];
+        imp = DMD->volume_importance(i, p);
       }
       importances += "imp:" + mcnp_name + "=" + _to_string(imp) + " ";
     }
     // its possible no importances were assigned
-    if (set.size() == 0) {
+    if (particles.empty()) {
       if (mat_name.find(graveyard_str) == std::string::npos) {
         importances = "imp:n=1";
       } else {
@@ -311,11 +329,10 @@ void write_surface_cards(std::ostringstream& lcadfile) {
   // loop over all cells
   for (int i = 1; i <= num_surfaces; ++i) {
     int surfid = DAG->id_by_index(2, i);
-    moab::EntityHandle entity = DAG->entity_by_index(2, i);
-    std::string boundary_prop = DMD->surface_boundary_data_eh[entity];
-    if (boundary_prop.find("Reflecting") != std::string::npos)
+    dagmcMetaData::Boundary boundary = DMD->surface_boundary(i);
+    if (boundary == dagmcMetaData::REFLECTING_BOUNDARY)
       surface_property = "*";
-    else if (boundary_prop.find("White") != std::string::npos)
+    else if (boundary == dagmcMetaData::WHITE_BOUNDARY)
       surface_property = "+";
     else
       surface_property = "";
@@ -358,9 +375,8 @@ void write_tally_data(std::ostringstream& lcadfile) {
 }
 
 void dagmcangl_(int* jsu, double* xxx, double* yyy, double* zzz, double* ang) {
-  moab::EntityHandle surf = DAG->entity_by_index(2, *jsu);
   double xyz[3] = {*xxx, *yyy, *zzz};
-  moab::ErrorCode rval = DAG->get_angle(surf, xyz, ang, &history);
+  moab::ErrorCode rval = DAG->get_angle_idx(*jsu, xyz, ang, &history);
   if (moab::MB_SUCCESS != rval) {
     std::cerr << "DAGMC: failed in calling get_angle" << std::endl;
     exit(EXIT_FAILURE);
@@ -431,10 +447,9 @@ void dagmcchkcel_(double* uuu, double* vvv, double* www, double* xxx,
 #endif
 
   int inside;
-  moab::EntityHandle vol = DAG->entity_by_index(3, *i1);
   double xyz[3] = {*xxx, *yyy, *zzz};
   double uvw[3] = {*uuu, *vvv, *www};
-  moab::ErrorCode rval = DAG->point_in_volume(vol, xyz, inside, uvw);
+  moab::ErrorCode rval = DAG->point_in_volume_idx(*i1, xyz, inside, uvw);
 
   if (moab::MB_SUCCESS != rval) {
     std::cerr << "DAGMC: failed in point_in_volume" << std::endl;
@@ -490,19 +505,13 @@ void dagmcdbmin_(int* ih, double* xxx, double* yyy, double* zzz, double* huge,
 }
 
 void dagmcnewcel_(int* jsu, int* icl, int* iap) {
-  moab::EntityHandle surf = DAG->entity_by_index(2, *jsu);
-  moab::EntityHandle vol = DAG->entity_by_index(3, *icl);
-  moab::EntityHandle newvol = 0;
-
-  moab::ErrorCode rval = DAG->next_vol(surf, vol, newvol);
-  if (moab::MB_SUCCESS != rval) {
+  *iap = DAG->next_vol_idx(*jsu, *icl);
+  if (0 == *iap) {
     *iap = -1;
     std::cerr << "DAGMC: error calling next_vol, newcel_ returning -1"
               << std::endl;
   }
 
-  *iap = DAG->index_by_handle(newvol);
-
   visited_surface = true;
 
 #ifdef TRACE_DAGMC_CALLS
@@ -569,9 +578,8 @@ void dagmctrack_(int* ih, double* uuu, double* vvv, double* www, double* xxx,
                  double* yyy, double* zzz, double* huge, double* dls, int* jap,
                  int* jsu, int* nps) {
   // Get data from IDs
-  moab::EntityHandle vol = DAG->entity_by_index(3, *ih);
   moab::EntityHandle prev = DAG->entity_by_index(2, *jsu);
-  moab::EntityHandle next_surf = 0;
+  int next_surf_idx = 0;
   double next_surf_dist;
 
 #ifdef ENABLE_RAYSTAT_DUMPS
@@ -585,6 +593,7 @@ void dagmctrack_(int* ih, double* uuu, double* vvv, double* www, double* xxx,
   if (last_nps != *nps || prev == 0) {
     // not streaming or reflecting: reset history
     history.reset();
+    query_context.frontier.reset();
 #ifdef TRACE_DAGMC_CALLS
     std::cout << "track: new history" << std::endl;
 #endif
@@ -605,20 +614,24 @@ void dagmctrack_(int* ih, double* uuu, double* vvv, double* www, double* xxx,
   } else {
     // not streaming or reflecting
     history.reset();
+    query_context.frontier.reset();
 
 #ifdef TRACE_DAGMC_CALLS
     std::cout << "track: reset" << std::endl;
 #endif
   }
 
-  moab::ErrorCode result =
-      DAG->ray_fire(vol, point, dir, next_surf, next_surf_dist, &history,
-                    (use_dist_limit ? dist_limit : 0)
 #ifdef ENABLE_RAYSTAT_DUMPS
-                        ,
-                    raystat_dump ? &trv : NULL
+  moab::ErrorCode result = DAG->ray_fire_idx(
+      *ih, point, dir, next_surf_idx, next_surf_dist, &history,
+      (use_dist_limit ? dist_limit : 0), 1, raystat_dump ? &trv : NULL);
+#else
+  // dist_limit is that of the context; a streaming particle resumes the
+  // traversal of its last ray
+  if (!use_dist_limit) query_context.dist_limit = 0;
+  moab::ErrorCode result = DAG->ray_fire_idx(query_context, *ih, point, dir,
+                                             next_surf_idx, next_surf_dist);
 #endif
-      );
 
   if (moab::MB_SUCCESS != result) {
     std::cerr << "DAGMC: failed in ray_fire" << std::endl;
@@ -632,8 +645,8 @@ void dagmctrack_(int* ih, double* uuu, double* vvv, double* www, double* xxx,
 
   // Return results: if next_surf exists, then next_surf_dist will be nearer
   // than dist_limit (if any)
-  if (next_surf != 0) {
-    *jap = DAG->index_by_handle(next_surf);
+  if (next_surf_idx != 0) {
+    *jap = next_surf_idx;
     *dls = next_surf_dist;
   } else {
     // no next surface
@@ -644,6 +657,16 @@ void dagmctrack_(int* ih, double* uuu, double* vvv, double* www, double* xxx,
     } else {
       // Dist limit off: return huge value, triggering lost particle
       *dls = *huge;
+      // unless the particle is found just across the nearest surface, which
+      // it is then moved to
+      moab::LostParticles::Record lost;
+      if (moab::MB_SUCCESS == DAG->recover_lost_particle(*ih, point, dir,
+                                                         "ray_fire", lost) &&
+          lost.recovered && lost.surface &&
+          DAG->next_vol_idx(lost.surface, *ih) == lost.recovered) {
+        *jap = lost.surface;
+        *dls = lost.nudge;
+      }
     }
   }
 
@@ -727,10 +750,15 @@ void dagmc_savpar_(int* n) {
 #ifdef TRACE_DAGMC_CALLS
   std::cout << "savpar: " << *n << " (" << history.size() << ")" << std::endl;
 #endif
+  // worker threads get their own stack on first use
+  if (pblcm_history_stack.size() < (unsigned)pblcm_stack_size)
+    pblcm_history_stack.resize(pblcm_stack_size);
   pblcm_history_stack[*n] = history;
 }
 
 void dagmc_getpar_(int* n) {
+  if (pblcm_history_stack.size() < (unsigned)pblcm_stack_size)
+    pblcm_history_stack.resize(pblcm_stack_size);
 #ifdef TRACE_DAGMC_CALLS
   std::cout << "getpar: " << *n << " (" << pblcm_history_stack[*n].size() << ")"
             << std::endl;
@@ -739,27 +767,23 @@ void dagmc_getpar_(int* n) {
 }
 
 void dagmcvolume_(int* mxa, double* vols, int* mxj, double* aras) {
-  moab::ErrorCode rval;
+  // measure every cell and surface at once, reusing the measures saved with
+  // the geometry file
+  std::vector<double> volumes, areas;
+  moab::ErrorCode rval = DAG->measure_all(volumes, areas);
+  if (moab::MB_SUCCESS != rval) {
+    std::cerr << "DAGMC: could not measure the volumes and surfaces"
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
 
   // get size of each volume
   int num_vols = DAG->num_entities(3);
-  for (int i = 0; i < num_vols; ++i) {
-    rval = DAG->measure_volume(DAG->entity_by_index(3, i + 1), vols[i * 2]);
-    if (moab::MB_SUCCESS != rval) {
-      std::cerr << "DAGMC: could not measure volume " << i + 1 << std::endl;
-      exit(EXIT_FAILURE);
-    }
-  }
+  for (int i = 0; i < num_vols; ++i) vols[i * 2] = volumes[i + 1];
 
   // get size of each surface
   int num_surfs = DAG->num_entities(2);
-  for (int i = 0; i < num_surfs; ++i) {
-    rval = DAG->measure_area(DAG->entity_by_index(2, i + 1), aras[i * 2]);
-    if (moab::MB_SUCCESS != rval) {
-      std::cerr << "DAGMC: could not measure surface " << i + 1 << std::endl;
-      exit(EXIT_FAILURE);
-    }
-  }
+  for (int i = 0; i < num_surfs; ++i) aras[i * 2] = areas[i + 1];
 }
 
 void dagmc_setdis_(double* d) {
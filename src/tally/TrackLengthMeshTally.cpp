@@ -5,6 +5,7 @@
 #include <set>
 #include <sstream>
 
+#include "FlatBVH.hpp"
 #include "moab/AdaptiveKDTree.hpp"
 #include "moab/CN.hpp"
 #include "moab/Core.hpp"
@@ -120,6 +121,7 @@ namespace moab {
 TrackLengthMeshTally::TrackLengthMeshTally(const TallyInput& input)
     : MeshTally(input),
       mb(new moab::Core()),
+      flat_bvh(NULL),
       obb_tool(new OrientedBoxTreeTool(mb)),
       last_visited_tet(0),
       last_cell(-1),
@@ -158,6 +160,7 @@ TrackLengthMeshTally::TrackLengthMeshTally(const TallyInput& input)
 // DESTRUCTOR
 //---------------------------------------------------------------------------//
 TrackLengthMeshTally::~TrackLengthMeshTally() {
+  delete flat_bvh;
   delete mb;
   delete obb_tool;
 }
@@ -512,6 +515,16 @@ void TrackLengthMeshTally::build_trees(Range& all_tets) {
   std::cout << "  Tally mesh has " << new_triangles.size() << " triangles."
             << std::flush;
 
+  // build the flat BVH of the triangles used for ray intersections
+  std::cout << "  Building flat BVH... " << std::flush;
+  flat_bvh = new FlatBVH();
+  ErrorCode rval = flat_bvh->construct(mb, new_triangles);
+  if (rval != MB_SUCCESS) {
+    std::cout << "Failed to build the flat BVH" << std::endl;
+    exit(1);
+  }
+  std::cout << "done." << std::endl;
+
   // put tris with tets to be rolled into KD tree
   all_tets.merge(new_triangles);
 
@@ -569,9 +582,9 @@ bool TrackLengthMeshTally::point_in_tet(const CartVect& point,
 ErrorCode TrackLengthMeshTally::get_all_intersections(
     const CartVect& position, const CartVect& direction, double track_length,
     std::vector<EntityHandle>& triangles, std::vector<double>& intersections) {
-  ErrorCode result = kdtree->ray_intersect_triangles(
-      kdtree_root, TRIANGLE_INTERSECTION_TOL, direction.array(),
-      position.array(), triangles, intersections, 0, track_length);
+  ErrorCode result = flat_bvh->ray_intersect_triangles(
+      1, position.array(), direction.array(), track_length,
+      TRIANGLE_INTERSECTION_TOL, triangles, intersections);
   if (result != MB_SUCCESS) {
     std::cerr << "There is a problem!!" << std::endl;
   }
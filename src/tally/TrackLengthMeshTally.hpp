@@ -18,6 +18,7 @@ namespace moab {
 
 /* Forward Declarations */
 class AdaptiveKDTree;
+class FlatBVH;
 class OrientedBoxTreeTool;
 
 //===========================================================================//
@@ -111,6 +112,9 @@ class TrackLengthMeshTally : public MeshTally {
   moab::AdaptiveKDTree* kdtree;
   moab::EntityHandle kdtree_root;
 
+  // Flat BVH of the mesh triangles used to find ray intersections
+  moab::FlatBVH* flat_bvh;
+
   // Oriented Box Tree variables
   OrientedBoxTreeTool* obb_tool;
   EntityHandle obbtree_root;
@@ -160,7 +164,7 @@ class TrackLengthMeshTally : public MeshTally {
   ErrorCode compute_barycentric_data(const Range& all_tets);
 
   /**
-   * \brief Constructs the KD and OBB trees from the mesh data
+   * \brief Constructs the KD tree and flat BVH from the mesh data
    * \param[in, out] all_tets the set of tets extracted from the input mesh
    *
    * Also adds the set of skin triangles to all_tets.